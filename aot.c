@@ -0,0 +1,71 @@
+// aot.c
+#include "aot.h"
+#include "trace.h"
+
+void aot_init(AotRunner *runner, const AotProgram *program) {
+    runner->program = program;
+    runner->generation = 0;
+    runner->matches = -1;
+}
+
+// Translated code is only valid for the exact image it came from
+static int image_matches(const AotProgram *program, CPU *cpu) {
+    if ((uint64_t)program->base + (uint64_t)program->count * 4 > cpu->inst_mem_size) {
+        return 0;
+    }
+    for (uint32_t n = 0; n < program->count; n++) {
+        if (cpu_read_inst_word(cpu, program->base + n * 4) != program->words[n]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+CpuExitReason aot_run(AotRunner *runner, CPU *cpu, uint64_t max_instructions,
+                      CpuExitInfo *exit_info) {
+    uint64_t executed = 0;
+    
+    if (runner->matches < 0 || runner->generation != cpu->code_generation) {
+        runner->matches = image_matches(runner->program, cpu);
+        runner->generation = cpu->code_generation;
+        if (!runner->matches) {
+            TRACE_ERROR("Instruction memory differs from the translated image; interpreting\n");
+        }
+    }
+    
+    // Observers and breakpoints need every instruction to pass through them
+    if (!runner->matches || cpu->breakpoints || cpu->trace || cpu->profile || cpu->caches ||
+        trace_get_verbosity() >= TRACE_LEVEL_INST) {
+        return cpu_run_budget(cpu, max_instructions, exit_info);
+    }
+    
+    if (cpu->breakpoint) {
+        cpu->breakpoint = 0;
+        cpu->halted = 0;
+    }
+    
+    while (!cpu->halted && executed < max_instructions) {
+        uint64_t done = runner->program->run(cpu, max_instructions - executed);
+        if (done) {
+            cpu->instruction_count += done;
+            executed += done;
+            continue;
+        }
+        
+        // Off the translated entries, on an untranslated word, or the
+        // budget ends inside the next block
+        CpuExitInfo step;
+        cpu_run_budget(cpu, 1, &step);
+        executed += step.executed;
+    }
+    
+    CpuExitReason reason = cpu_exit_reason(cpu);
+    if (exit_info) {
+        exit_info->reason = reason;
+        exit_info->executed = executed;
+        exit_info->pc = cpu->pc;
+        exit_info->error = cpu->error;
+        exit_info->addr = cpu->error_addr;
+    }
+    return reason;
+}
@@ -0,0 +1,39 @@
+// aot.h
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define AOT_BLOCK_MAX_OPS 256   // Longest block between budget checks in translated code
+
+// Translated code for one guest image, generated by rv2c. run executes
+// from cpu->pc while it sits on a block entry and the budget covers the
+// whole block, then returns the instructions executed (0 if it could not
+// start). It stops before anything it does not translate: ECALL, EBREAK,
+// halt and illegal words.
+typedef struct {
+    uint32_t base;                  // Guest address of words[0]
+    uint32_t count;                 // Instruction words translated
+    const uint32_t *words;          // Image the code was translated from
+    uint64_t (*run)(CPU *cpu, uint64_t max_instructions);
+} AotProgram;
+
+// Translated code bound to a CPU
+typedef struct {
+    const AotProgram *program;
+    uint32_t generation;            // CPU code_generation last checked
+    int matches;                    // Instruction memory held the translated image then
+} AotRunner;
+
+void aot_init(AotRunner *runner, const AotProgram *program);
+
+// Run like cpu_run_budget(). Translated code runs where it can; the
+// reference paths take over one instruction at a time where it cannot,
+// and for the whole run if instruction memory no longer matches the
+// image, breakpoints are set, or a trace, profile or cache simulator is
+// attached. In guard mode, call under guard_arm() as cpu_run_budget() is.
+CpuExitReason aot_run(AotRunner *runner, CPU *cpu, uint64_t max_instructions,
+                      CpuExitInfo *exit_info);
+
+#endif
@@ -0,0 +1,109 @@
+// aotmain.c
+// Driver for a program translated with rv2c: link with the generated file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aot.h"
+#include "elf.h"
+#include "syscalls.h"
+#include "trace.h"
+
+extern const AotProgram aot_program;
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-v level] [-m bytes] [-b instructions] [-L] program\n", prog);
+    printf("  -v level   Trace verbosity: 0 off, 1 errors, 2 per-instruction (interprets)\n");
+    printf("  -m bytes   Size of instruction memory (default 64 KiB)\n");
+    printf("  -b count   Instruction budget (default: run until the program stops)\n");
+    printf("  -L         Emulate Linux syscalls on ECALL\n");
+    printf("  program    The image given to rv2c; translated code checks it matches\n");
+}
+
+int main(int argc, char *argv[]) {
+    CPU cpu;
+    ElfImage image;
+    int have_image = 0;
+    const char *program_path = NULL;
+    unsigned int mem_size = 64 * 1024;
+    uint64_t budget = UINT64_MAX;
+    int use_syscalls = 0;
+    Syscalls syscalls;
+    
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-v") == 0 && arg + 1 < argc) {
+            trace_set_verbosity(atoi(argv[++arg]));
+        } else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            mem_size = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            budget = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-L") == 0) {
+            use_syscalls = 1;
+        } else if (argv[arg][0] != '-' && !program_path) {
+            program_path = argv[arg];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!program_path) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // Data segments and the entry point still come from the image
+    cpu_init(&cpu, mem_size, CPU_DATA_MEM_FULL);
+    if (elf_is_elf_file(program_path)) {
+        if (elf_load(&cpu, program_path, &image) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        have_image = 1;
+    } else if (cpu_load_inst_binary(&cpu, program_path) != 0) {
+        cpu_destroy(&cpu);
+        return 1;
+    }
+    if (use_syscalls) {
+        uint32_t brk_base = have_image && image.data_end ? image.data_end : SYSCALL_DEFAULT_BRK;
+        syscall_init(&syscalls, &cpu, brk_base);
+    }
+    
+    AotRunner runner;
+    CpuExitInfo exit_info;
+    aot_init(&runner, &aot_program);
+    fflush(stdout);     // Guest writes bypass stdio
+    aot_run(&runner, &cpu, budget, &exit_info);
+    
+    switch (exit_info.reason) {
+        case CPU_EXIT_HALT:
+            printf("\nHALT\n");
+            break;
+        case CPU_EXIT_BUDGET:
+            printf("Instruction limit reached\n");
+            break;
+        case CPU_EXIT_BREAKPOINT:
+            printf("\nBreakpoint at 0x%08x\n", exit_info.pc);
+            break;
+        default:
+            printf("Stopped on error: %s (0x%08x)\n",
+                   cpu_error_string(exit_info.error), exit_info.addr);
+            break;
+    }
+    
+    printf("\n=== Final State ===\n");
+    cpu_dump_registers(&cpu);
+    
+    int status = 0;
+    if (use_syscalls) {
+        if (syscalls.exited) {
+            printf("Exited with status %d after %llu syscalls\n", syscalls.exit_code,
+                   (unsigned long long)syscalls.calls);
+            status = syscalls.exit_code;
+        }
+        syscall_destroy(&syscalls, &cpu);
+    }
+    if (have_image) {
+        elf_image_destroy(&image);
+    }
+    cpu_destroy(&cpu);
+    return status;
+}
@@ -0,0 +1,183 @@
+// batch.c
+#include "batch.h"
+#include "threaded.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+// Jobs a worker still owns. The owner and thieves both claim jobs with
+// an atomic increment of next, so no locks are needed.
+typedef struct {
+    _Atomic size_t next;
+    size_t end;
+    char pad[64 - sizeof(size_t) * 2];
+} WorkRange;
+
+typedef struct {
+    const BatchJob *jobs;
+    BatchResult *results;
+    const BatchConfig *config;
+    WorkRange *ranges;
+    unsigned int workers;
+} BatchPool;
+
+typedef struct {
+    BatchPool *pool;
+    unsigned int id;
+} BatchWorker;
+
+void batch_config_default(BatchConfig *config) {
+    config->inst_mem_size = 64 * 1024;
+    config->data_mem_size = 64 * 1024;
+    config->threads = 0;
+    config->max_instructions = 1000000;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *bytes, size_t length) {
+    for (size_t n = 0; n < length; n++) {
+        hash = (hash ^ bytes[n]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static int claim(WorkRange *range, size_t *job) {
+    if (atomic_load_explicit(&range->next, memory_order_relaxed) >= range->end) {
+        return 0;
+    }
+    size_t n = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed);
+    if (n >= range->end) {
+        return 0;
+    }
+    *job = n;
+    return 1;
+}
+
+// Own range first, then steal from the others in turn
+static int next_job(BatchPool *pool, unsigned int id, size_t *job) {
+    for (unsigned int n = 0; n < pool->workers; n++) {
+        if (claim(&pool->ranges[(id + n) % pool->workers], job)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_job(CPU *cpu, const BatchJob *job, BatchResult *result,
+                    const BatchConfig *config, int *loaded_words) {
+    // A program that does not fit is not run at all, rather than truncated,
+    // so loaded_words never exceeds instruction memory
+    if (job->count < 0 || (uint64_t)job->count * 4 > cpu->inst_mem_size) {
+        printf("Batch job of %d words does not fit in %u bytes of instruction memory\n",
+               job->count, cpu->inst_mem_size);
+        memset(result, 0, sizeof(*result));
+        result->error = CPU_ERR_INST_OUT_OF_BOUNDS;
+        return;
+    }
+    
+    // Clear what the previous job left in memory, keeping the allocations
+    if (*loaded_words > job->count) {
+        memset(cpu->inst_memory + job->count * 4, 0, (size_t)(*loaded_words - job->count) * 4);
+        cpu_invalidate_decoded(cpu, job->count * 4, (uint32_t)(*loaded_words - job->count) * 4);
+    }
+    paged_clear(&cpu->data_memory);
+    
+    cpu_reset(cpu);
+    cpu_load_inst_program(cpu, (uint32_t *)job->program, job->count);
+    *loaded_words = job->count;
+    
+    for (int r = 1; r < 32; r++) {
+        cpu->regs[r] = job->regs[r];
+    }
+    
+    uint64_t budget = job->max_instructions ? job->max_instructions : config->max_instructions;
+    execute_threaded(cpu, budget);
+    
+    memcpy(result->regs, cpu->regs, sizeof(result->regs));
+    result->pc = cpu->pc;
+    result->instruction_count = cpu->instruction_count;
+    result->error = cpu->error;
+    result->reg_digest = fnv1a(FNV_OFFSET, (const uint8_t *)cpu->regs, sizeof(cpu->regs));
+    result->mem_digest = paged_digest(&cpu->data_memory);
+}
+
+static void *worker_main(void *arg) {
+    BatchWorker *worker = arg;
+    BatchPool *pool = worker->pool;
+    int loaded_words = 0;
+    size_t job;
+    CPU cpu;
+    
+    // One CPU per worker, reused for every job it runs
+    cpu_init(&cpu, pool->config->inst_mem_size, pool->config->data_mem_size);
+    cpu_set_fusion(&cpu, 1);
+    
+    while (next_job(pool, worker->id, &job)) {
+        run_job(&cpu, &pool->jobs[job], &pool->results[job], pool->config, &loaded_words);
+    }
+    
+    cpu_destroy(&cpu);
+    return NULL;
+}
+
+int batch_run(const BatchJob *jobs, size_t count, BatchResult *results,
+              const BatchConfig *config) {
+    BatchConfig defaults;
+    if (!config) {
+        batch_config_default(&defaults);
+        config = &defaults;
+    }
+    
+    unsigned int workers = config->threads;
+    if (workers == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? (unsigned int)cores : 1;
+    }
+    if (workers > count) {
+        workers = count ? (unsigned int)count : 1;
+    }
+    
+    BatchPool pool = { jobs, results, config, NULL, workers };
+    pool.ranges = calloc(workers, sizeof(WorkRange));
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    BatchWorker *info = calloc(workers, sizeof(BatchWorker));
+    if (!pool.ranges || !threads || !info) {
+        printf("Failed to allocate batch pool\n");
+        free(pool.ranges);
+        free(threads);
+        free(info);
+        return -1;
+    }
+    
+    // Split the jobs into one contiguous range per worker
+    for (unsigned int w = 0; w < workers; w++) {
+        atomic_init(&pool.ranges[w].next, count * w / workers);
+        pool.ranges[w].end = count * (w + 1) / workers;
+        info[w].pool = &pool;
+        info[w].id = w;
+    }
+    
+    // The calling thread works as worker 0
+    unsigned int started = 1;
+    for (unsigned int w = 1; w < workers; w++) {
+        if (pthread_create(&threads[w], NULL, worker_main, &info[w]) != 0) {
+            break;  // Remaining ranges get stolen by running workers
+        }
+        started++;
+    }
+    worker_main(&info[0]);
+    
+    for (unsigned int w = 1; w < started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    
+    free(pool.ranges);
+    free(threads);
+    free(info);
+    return 0;
+}
@@ -0,0 +1,43 @@
+// batch.h
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// One independent guest run
+typedef struct {
+    const uint32_t *program;    // Instruction words, loaded at address 0
+    int count;                  // Number of words in program
+    uint32_t regs[32];          // Initial register values (x0 ignored)
+    uint64_t max_instructions;  // 0 uses the batch default
+} BatchJob;
+
+// Final state of one run
+typedef struct {
+    uint32_t regs[32];
+    uint32_t pc;
+    uint64_t instruction_count;
+    CpuError error;
+    uint64_t reg_digest;        // FNV-1a over the register file
+    uint64_t mem_digest;        // FNV-1a over data memory
+} BatchResult;
+
+typedef struct {
+    unsigned int inst_mem_size;
+    uint64_t data_mem_size;
+    unsigned int threads;       // 0 uses one per online host core
+    uint64_t max_instructions;  // Default per-job budget
+} BatchConfig;
+
+void batch_config_default(BatchConfig *config);
+
+// Run every job on a work-stealing thread pool. results[n] receives the
+// final state of jobs[n]; a job larger than instruction memory is not run
+// and gets CPU_ERR_INST_OUT_OF_BOUNDS. Returns 0, or -1 if the pool could
+// not start.
+int batch_run(const BatchJob *jobs, size_t count, BatchResult *results,
+              const BatchConfig *config);
+
+#endif
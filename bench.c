@@ -0,0 +1,773 @@
+// bench.c
+// Interpreter throughput benchmarks. Each kernel is a straight-line guest
+// program that is re-run from PC 0 until the instruction budget is spent.
+// Results are printed one JSON object per line so runs can be compared
+// across commits.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "cpu.h"
+#include "decode.h"
+#include "threaded.h"
+#include "block.h"
+#include "lockstep.h"
+#include "diffcheck.h"
+#include "guard.h"
+#include "batch.h"
+#include "replay.h"
+#include "syscalls.h"
+#include "trace.h"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+#define BENCH_DEFAULT_BUDGET 20000000ULL
+#define BENCH_MEM_SIZE (64 * 1024)
+#define BENCH_MAX_WORDS (BENCH_MEM_SIZE / 4 - 1)
+#define BENCH_DATA_SIZE (16 * 1024 * 1024)
+#define BENCH_DATA_SPAN (1024 * 1024)
+#define BENCH_REPLAY_INTERVAL 1000      // Checkpoint spacing for -R
+#define BENCH_REPLAY_STRIDE 97          // Instructions between compared states for -R
+#define BENCH_REPLAY_FD 3               // Guest fd the -R program reads
+
+// R-type encoding helper
+#define RTYPE(funct7, rs2, rs1, funct3, rd) \
+    (((uint32_t)(funct7) << 25) | ((rs2) << 20) | ((rs1) << 15) | ((funct3) << 12) | ((rd) << 7) | 0x33)
+
+#define ADD(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x0, rd)
+#define SUB(rd, rs1, rs2)  RTYPE(0x20, rs2, rs1, 0x0, rd)
+#define SLL(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x1, rd)
+#define SLT(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x2, rd)
+#define SLTU(rd, rs1, rs2) RTYPE(0x00, rs2, rs1, 0x3, rd)
+#define XOR(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x4, rd)
+#define SRL(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x5, rd)
+#define SRA(rd, rs1, rs2)  RTYPE(0x20, rs2, rs1, 0x5, rd)
+#define OR(rd, rs1, rs2)   RTYPE(0x00, rs2, rs1, 0x6, rd)
+#define AND(rd, rs1, rs2)  RTYPE(0x00, rs2, rs1, 0x7, rd)
+
+typedef struct {
+    const char *name;
+    int (*build)(uint32_t *program);    // Returns word count, halt included
+} Kernel;
+
+// Everything an engine may run on
+typedef struct {
+    CPU cpu;
+    BlockCache cache;
+    LockstepHarts harts;
+} BenchState;
+
+typedef struct {
+    const char *name;
+    uint64_t (*run)(BenchState *state, uint64_t max_instructions);
+    int jit;
+    int fusion;     // Runs predecoded pairs fused
+} Engine;
+
+static int fusion_disabled;
+static LockstepIsa lockstep_isa = LOCKSTEP_ISA_AVX512;    // Lowered to what the host supports
+
+// Every op depends on the previous one through x1
+static int build_alu_chain(uint32_t *p) {
+    int n = 0;
+    for (int rep = 0; rep < 64; rep++) {
+        p[n++] = ADD(1, 1, 2);
+        p[n++] = XOR(1, 1, 3);
+        p[n++] = SUB(1, 1, 4);
+        p[n++] = OR(1, 1, 5);
+        p[n++] = AND(1, 1, 6);
+        p[n++] = SLTU(7, 1, 2);
+        p[n++] = ADD(1, 1, 7);
+    }
+    p[n++] = 0;
+    return n;
+}
+
+// Eight independent accumulators, no dependency between neighbours
+static int build_alu_independent(uint32_t *p) {
+    int n = 0;
+    for (int rep = 0; rep < 56; rep++) {
+        for (int lane = 0; lane < 8; lane++) {
+            int rd = 8 + lane;
+            p[n++] = (rep & 1) ? XOR(rd, rd, 2 + (lane & 3)) : ADD(rd, rd, 2 + (lane & 3));
+        }
+    }
+    p[n++] = 0;
+    return n;
+}
+
+// Mostly shifts by register amounts
+static int build_shift_heavy(uint32_t *p) {
+    int n = 0;
+    for (int rep = 0; rep < 64; rep++) {
+        p[n++] = SLL(16, 2, 3);
+        p[n++] = SRL(17, 16, 4);
+        p[n++] = SRA(18, 5, 3);
+        p[n++] = SLL(19, 18, 4);
+        p[n++] = SRA(20, 19, 2);
+        p[n++] = XOR(2, 2, 20);
+        p[n++] = SRL(21, 17, 5);
+    }
+    p[n++] = 0;
+    return n;
+}
+
+// One long run of mixed operations filling instruction memory
+static int build_long_block(uint32_t *p) {
+    static const int funct[10][2] = {
+        { 0x00, 0x0 }, { 0x20, 0x0 }, { 0x00, 0x1 }, { 0x00, 0x2 }, { 0x00, 0x3 },
+        { 0x00, 0x4 }, { 0x00, 0x5 }, { 0x20, 0x5 }, { 0x00, 0x6 }, { 0x00, 0x7 }
+    };
+    uint32_t seed = 12345;
+    int n = 0;
+    
+    while (n < BENCH_MAX_WORDS - 1) {
+        seed = seed * 1103515245 + 12345;
+        // Mostly add/sub/xor so the register state does not collapse to zero
+        int k = (seed >> 16) % 16;
+        k = k < 12 ? (k % 3 == 2 ? 5 : k % 3) : k - 10 + 2 * (k & 1);
+        uint32_t rd = 1 + ((seed >> 4) % 31);
+        uint32_t rs1 = (seed >> 9) % 32;
+        uint32_t rs2 = (seed >> 20) % 32;
+        p[n++] = RTYPE(funct[k][0], rs2, rs1, funct[k][1], rd);
+    }
+    p[n++] = 0;
+    return n;
+}
+
+static const Kernel kernels[] = {
+    { "alu_chain", build_alu_chain },
+    { "alu_independent", build_alu_independent },
+    { "shift_heavy", build_shift_heavy },
+    { "long_block", build_long_block },
+};
+
+// The reference interpreter every other engine is measured against
+static uint64_t run_reference(BenchState *state, uint64_t max_instructions) {
+    return cpu_run_reference(&state->cpu, max_instructions);
+}
+
+static uint64_t run_threaded(BenchState *state, uint64_t max_instructions) {
+    return execute_threaded(&state->cpu, max_instructions);
+}
+
+static uint64_t run_blocks(BenchState *state, uint64_t max_instructions) {
+    return block_run(&state->cache, &state->cpu, max_instructions);
+}
+
+// All lanes together. The budget counts every lane's instructions, so each
+// lane runs 1/LOCKSTEP_LANES of it; the checksum is taken from lane 0 and
+// is therefore only comparable between lockstep runs.
+static uint64_t run_lockstep(BenchState *state, uint64_t max_instructions) {
+    LockstepHarts *harts = &state->harts;
+    CPU *cpu = &state->cpu;
+    uint64_t per_lane = (max_instructions + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    
+    harts->pc = cpu->pc;
+    harts->halted = 0;
+    uint64_t executed = lockstep_run(harts, cpu, per_lane) * LOCKSTEP_LANES;
+    
+    cpu->pc = harts->pc;
+    cpu->halted = harts->halted;
+    if (harts->error != CPU_OK) {
+        cpu_raise(cpu, harts->error, harts->pc);
+    }
+    cpu->instruction_count += executed;
+    for (int r = 1; r < 32; r++) {
+        cpu->regs[r] = lockstep_get_reg(harts, 0, r);
+    }
+    return executed;
+}
+
+static const Engine engines[] = {
+    { "reference", run_reference, 0, 0 },
+    { "threaded", run_threaded, 0, 1 },
+    { "block", run_blocks, 0, 0 },
+    { "jit", run_blocks, 1, 0 },
+    { "lockstep", run_lockstep, 0, 0 },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    return usage.ru_maxrss;         // Kilobytes on Linux
+#endif
+}
+
+static void seed_registers(CPU *cpu) {
+    for (int r = 1; r < 32; r++) {
+        cpu_set_reg(cpu, r, 0x9E3779B9u * r);
+    }
+}
+
+// Lane 0 matches seed_registers; the other lanes get distinct values
+static void seed_lanes(LockstepHarts *harts) {
+    lockstep_init(harts);
+    lockstep_set_isa(harts, lockstep_isa);
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        for (int r = 1; r < 32; r++) {
+            lockstep_set_reg(harts, lane, r, 0x9E3779B9u * r + lane * 0x85EBCA6Bu);
+        }
+    }
+}
+
+static int bench_one(const Kernel *kernel, const Engine *engine, uint64_t budget) {
+    static uint32_t program[BENCH_MAX_WORDS + 1];
+    static BenchState state;
+    CPU *cpu = &state.cpu;
+    
+    cpu_init(cpu, BENCH_MEM_SIZE, BENCH_MEM_SIZE);
+    block_cache_init(&state.cache);
+    if (engine->jit && block_cache_enable_jit(&state.cache, BLOCK_JIT_DEFAULT_THRESHOLD) != 0) {
+        block_cache_destroy(&state.cache);
+        cpu_destroy(cpu);
+        return 0;   // No JIT on this host
+    }
+    
+    if (engine->fusion && !fusion_disabled) {
+        cpu_set_fusion(cpu, 1);
+    }
+    int words = kernel->build(program);
+    cpu_load_inst_program(cpu, program, words);
+    seed_registers(cpu);
+    seed_lanes(&state.harts);
+    
+    // Re-run the kernel from the top until the budget is spent
+    double start = now_seconds();
+    while (cpu_get_instruction_count(cpu) < budget) {
+        engine->run(&state, budget - cpu_get_instruction_count(cpu));
+        
+        if (cpu_get_error(cpu) != CPU_OK) {
+            printf("{\"kernel\":\"%s\",\"engine\":\"%s\",\"error\":\"%s\"}\n",
+                   kernel->name, engine->name, cpu_error_string(cpu_get_error(cpu)));
+            block_cache_destroy(&state.cache);
+            cpu_destroy(cpu);
+            return -1;
+        }
+        if (cpu_should_halt(cpu)) {
+            cpu->halted = 0;
+            cpu_set_pc(cpu, 0);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    
+    uint64_t executed = cpu_get_instruction_count(cpu);
+    uint64_t fused = 0;
+    for (int fusion = FUSE_NONE + 1; fusion < FUSE_COUNT; fusion++) {
+        fused += cpu_get_fusion_hits(cpu, (Fusion)fusion);
+    }
+    uint32_t checksum = 0;
+    for (int r = 0; r < 32; r++) {
+        checksum = checksum * 31 + cpu_get_reg(cpu, r);
+    }
+    
+    printf("{\"revision\":\"%s\",\"kernel\":\"%s\",\"engine\":\"%s\","
+           "\"instructions\":%llu,\"seconds\":%.6f,\"mips\":%.2f,"
+           "\"ns_per_inst\":%.3f,\"peak_rss_kb\":%ld,\"fused_pairs\":%llu,\"checksum\":\"%08x\"}\n",
+           BENCH_REVISION, kernel->name, engine->name,
+           (unsigned long long)executed, elapsed, executed / elapsed / 1e6,
+           elapsed * 1e9 / executed, peak_rss_kb(), (unsigned long long)fused, checksum);
+    fflush(stdout);
+    
+    block_cache_destroy(&state.cache);
+    cpu_destroy(cpu);
+    return 0;
+}
+
+// Differential check of the lockstep engine against per-lane scalar runs
+static int check_lockstep(const Kernel *kernel) {
+    static uint32_t program[BENCH_MAX_WORDS + 1];
+    LockstepHarts harts;
+    CPU cpu;
+    
+    cpu_init(&cpu, BENCH_MEM_SIZE, BENCH_MEM_SIZE);
+    cpu_load_inst_program(&cpu, program, kernel->build(program));
+    seed_lanes(&harts);
+    
+    int mismatches = lockstep_check_scalar(&harts, &cpu, BENCH_MAX_WORDS);
+    printf("{\"revision\":\"%s\",\"kernel\":\"%s\",\"check\":\"lockstep\","
+           "\"isa\":\"%s\",\"lanes\":%d,\"mismatches\":%d}\n",
+           BENCH_REVISION, kernel->name, lockstep_isa_name(harts.isa),
+           LOCKSTEP_LANES, mismatches);
+    
+    cpu_destroy(&cpu);
+    return mismatches ? -1 : 0;
+}
+
+// Differential check of two engines on their own CPUs, re-running the
+// kernel like bench_one until the budget is spent
+static int check_engines(const Kernel *kernel, const DiffEngine engines_checked[2],
+                         uint64_t budget, uint64_t interval) {
+    static uint32_t program[BENCH_MAX_WORDS + 1];
+    CPU cpus[2];
+    DiffReport report;
+    uint64_t executed = 0;
+    uint64_t checks = 0;
+    int status = 0;
+    
+    int words = kernel->build(program);
+    for (int c = 0; c < 2; c++) {
+        cpu_init(&cpus[c], BENCH_MEM_SIZE, BENCH_MEM_SIZE);
+        if (engines_checked[c] == DIFF_ENGINE_THREADED && !fusion_disabled) {
+            cpu_set_fusion(&cpus[c], 1);
+        }
+        cpu_load_inst_program(&cpus[c], program, words);
+        seed_registers(&cpus[c]);
+    }
+    
+    while (status == 0 && executed < budget) {
+        status = diffcheck_run(&cpus[0], engines_checked[0], &cpus[1], engines_checked[1],
+                               interval, budget - executed, &report);
+        executed += report.executed;
+        checks += report.checks;
+        if (status != 0 || cpu_get_error(&cpus[0]) != CPU_OK || report.executed == 0) {
+            break;
+        }
+        for (int c = 0; c < 2; c++) {
+            cpus[c].halted = 0;
+            cpu_set_pc(&cpus[c], 0);
+        }
+    }
+    
+    printf("{\"revision\":\"%s\",\"kernel\":\"%s\",\"check\":\"engines\","
+           "\"engines\":\"%s,%s\",\"instructions\":%llu,\"checks\":%llu,\"diverged\":%s",
+           BENCH_REVISION, kernel->name, diffcheck_engine_name(engines_checked[0]),
+           diffcheck_engine_name(engines_checked[1]), (unsigned long long)executed,
+           (unsigned long long)checks, status == 1 ? "true" : "false");
+    if (status == 1) {
+        printf(",\"divergence\":%llu,\"pc\":\"%08x\"",
+               (unsigned long long)report.divergence,
+               report.divergence_pc);
+    }
+    printf("}\n");
+    fflush(stdout);
+    
+    for (int c = 0; c < 2; c++) {
+        cpu_destroy(&cpus[c]);
+    }
+    return status == 0 ? 0 : -1;
+}
+
+// Data accessor throughput, checked paged memory versus guard pages. No
+// guest instruction touches data memory yet, so this drives the
+// cpu_read_data_*/cpu_write_data_* accessors directly over a 1 MiB span.
+static int bench_memory(int guard, uint64_t budget) {
+    static CPU cpu;
+    sigjmp_buf env;
+    
+    cpu_init(&cpu, BENCH_MEM_SIZE, BENCH_DATA_SIZE);
+    if (guard && cpu_enable_guard_memory(&cpu) != 0) {
+        cpu_destroy(&cpu);
+        return 0;   // Not supported on this host
+    }
+    
+    volatile uint32_t checksum = 0;
+    volatile uint64_t accesses = 0;
+    double start = now_seconds();
+    
+    if (sigsetjmp(env, 0) == 0) {
+        guard_arm(&cpu, &env);
+        uint32_t sum = 0;
+        uint64_t done = 0;
+        uint32_t addr = 0;
+        while (done < budget) {
+            addr = (addr + 0x9E4) & (BENCH_DATA_SPAN - 1) & ~3u;
+            cpu_write_data_word(&cpu, addr, sum + addr);
+            sum += cpu_read_data_word(&cpu, addr ^ 0x40);
+            cpu_write_data_halfword(&cpu, addr + 2, (uint16_t)sum);
+            sum += cpu_read_data_halfword(&cpu, addr ^ 0x82);
+            cpu_write_data_byte(&cpu, addr + 1, (uint8_t)sum);
+            sum += cpu_read_data_byte(&cpu, addr ^ 0x101);
+            done += 6;
+        }
+        checksum = sum;
+        accesses = done;
+        
+        // One access past the end must stop the CPU the same way in both modes
+        cpu_read_data_word(&cpu, BENCH_DATA_SIZE + 0x1000);
+    }
+    guard_disarm();
+    double elapsed = now_seconds() - start;
+    
+    uint64_t total = accesses;
+    printf("{\"revision\":\"%s\",\"kernel\":\"data_access\",\"memory\":\"%s\","
+           "\"accesses\":%llu,\"seconds\":%.6f,\"maccesses_per_sec\":%.2f,"
+           "\"ns_per_access\":%.3f,\"peak_rss_kb\":%ld,\"checksum\":\"%08x\","
+           "\"fault\":\"%s\",\"fault_addr\":\"0x%08x\"}\n",
+           BENCH_REVISION, guard ? "guard" : "checked",
+           (unsigned long long)total, elapsed, total / elapsed / 1e6,
+           elapsed * 1e9 / total, peak_rss_kb(), checksum,
+           cpu_error_string(cpu_get_error(&cpu)), cpu_get_error_addr(&cpu));
+    fflush(stdout);
+    
+    int status = cpu_get_error(&cpu) == CPU_ERR_DATA_READ_OUT_OF_BOUNDS ? 0 : -1;
+    cpu_destroy(&cpu);
+    return status;
+}
+
+// Straight-line ALU work like long_block, with a read of 64 bytes from
+// guest fd BENCH_REPLAY_FD every 256 instructions into a buffer that moves
+// on each time. Only x1-x9 and x15-x31 (less x17) are ALU destinations;
+// x13 holds the fd, x14 the buffer step, and a0-a2/a7 the syscall.
+static int build_replay_program(uint32_t *p) {
+    static const uint8_t destinations[] = {
+        1, 2, 3, 4, 5, 6, 7, 8, 9, 15, 16, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31
+    };
+    uint32_t seed = 54321;
+    int n = 0;
+    
+    while (n < BENCH_MAX_WORDS - 3) {
+        if (n % 256 == 255) {
+            p[n++] = ADD(10, 13, 0);
+            p[n++] = ADD(11, 11, 14);
+            p[n++] = INST_ECALL;
+            continue;
+        }
+        seed = seed * 1103515245 + 12345;
+        uint32_t rd = destinations[(seed >> 4) % sizeof(destinations)];
+        uint32_t rs1 = (seed >> 9) % 32;
+        uint32_t rs2 = (seed >> 20) % 32;
+        p[n++] = (seed >> 16) % 3 == 0 ? XOR(rd, rs1, rs2) :
+                 (seed >> 16) % 3 == 1 ? SUB(rd, rs1, rs2) : ADD(rd, rs1, rs2);
+    }
+    p[n++] = 0;
+    return n;
+}
+
+// CPU for -R: the replay program, with syscall emulation reading guest fd
+// BENCH_REPLAY_FD from a pipe filled with the same bytes every time. The
+// pipe is drained as the guest reads it, so re-executed reads only see
+// those bytes if they come from the recording's log.
+static int setup_replay_cpu(CPU *cpu, Syscalls *sys, uint32_t *program, int words) {
+    uint8_t input[8192];
+    uint32_t seed = 99;
+    int fds[2];
+    
+    for (size_t n = 0; n < sizeof(input); n++) {
+        seed = seed * 1103515245 + 12345;
+        input[n] = (uint8_t)(seed >> 16);
+    }
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    if (write(fds[1], input, sizeof(input)) != (ssize_t)sizeof(input)) {
+        perror("pipe write");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    close(fds[1]);
+    
+    cpu_init(cpu, BENCH_MEM_SIZE, BENCH_MEM_SIZE);
+    cpu_enable_state_hash(cpu);
+    cpu_load_inst_program(cpu, program, words);
+    seed_registers(cpu);
+    cpu->regs[11] = 0x1000;
+    cpu->regs[12] = 64;
+    cpu->regs[13] = BENCH_REPLAY_FD;
+    cpu->regs[14] = 0x40;
+    cpu->regs[17] = SYS_READ;
+    syscall_init(sys, cpu, SYSCALL_DEFAULT_BRK);
+    sys->fds[BENCH_REPLAY_FD] = fds[0];
+    sys->owned[BENCH_REPLAY_FD] = 1;
+    return 0;
+}
+
+// Record/replay check: seeking a recorded run to instruction K, forwards
+// and backwards and by reverse steps, must give the state hash a plain run
+// had at K, logged syscall reads included
+static int check_replay(void) {
+    static uint32_t program[BENCH_MAX_WORDS + 1];
+    static uint64_t hashes[BENCH_MAX_WORDS / BENCH_REPLAY_STRIDE + 1];
+    static CPU cpu;
+    Syscalls sys;
+    Recording rec;
+    size_t samples = 0;
+    uint64_t seeks = 0;
+    uint64_t mismatches = 0;
+    
+    int words = build_replay_program(program);
+    
+    // The plain run, sampled every BENCH_REPLAY_STRIDE instructions
+    if (setup_replay_cpu(&cpu, &sys, program, words) != 0) {
+        return -1;
+    }
+    hashes[samples++] = cpu_state_hash(&cpu);
+    while (cpu_run_budget(&cpu, BENCH_REPLAY_STRIDE, NULL) == CPU_EXIT_BUDGET) {
+        hashes[samples++] = cpu_state_hash(&cpu);
+    }
+    uint64_t total = cpu.instruction_count;
+    uint64_t reads = sys.calls;
+    syscall_destroy(&sys, &cpu);
+    cpu_destroy(&cpu);
+    
+    // The recorded run, then seeks in a scattered order
+    if (setup_replay_cpu(&cpu, &sys, program, words) != 0) {
+        return -1;
+    }
+    if (replay_start(&rec, &cpu, BENCH_REPLAY_INTERVAL) != 0) {
+        syscall_destroy(&sys, &cpu);
+        cpu_destroy(&cpu);
+        return -1;
+    }
+    replay_run(&rec, &cpu, UINT64_MAX, NULL);
+    if (cpu.instruction_count != total || sys.calls != reads) {
+        mismatches++;
+    }
+    
+    for (size_t n = 0; n < samples; n++) {
+        size_t sample = n * 7919 % samples;
+        uint64_t target = sample * BENCH_REPLAY_STRIDE;
+        seeks++;
+        if (replay_seek(&rec, &cpu, target) != 0 || cpu_state_hash(&cpu) != hashes[sample]) {
+            mismatches++;
+        }
+        
+        // Every other sample is also reached by stepping back from one past it
+        if (sample % 2 == 0 && target < total) {
+            seeks++;
+            if (replay_seek(&rec, &cpu, target + 1) != 0 || replay_reverse_step(&rec, &cpu) != 0 ||
+                cpu_state_hash(&cpu) != hashes[sample]) {
+                mismatches++;
+            }
+        }
+    }
+    
+    printf("{\"revision\":\"%s\",\"kernel\":\"replay\",\"check\":\"replay\","
+           "\"instructions\":%llu,\"checkpoints\":%u,\"logged_inputs\":%zu,\"seeks\":%llu,"
+           "\"mismatches\":%llu}\n",
+           BENCH_REVISION, (unsigned long long)total, rec.checkpoint_count, rec.input_count,
+           (unsigned long long)seeks, (unsigned long long)mismatches);
+    fflush(stdout);
+    
+    int status = mismatches == 0 && rec.input_count > 0 ? 0 : -1;
+    replay_stop(&rec, &cpu);
+    syscall_destroy(&sys, &cpu);
+    cpu_destroy(&cpu);
+    return status;
+}
+
+static int same_result(const BatchResult *a, const BatchResult *b) {
+    return a->reg_digest == b->reg_digest && a->mem_digest == b->mem_digest &&
+           a->pc == b->pc && a->instruction_count == b->instruction_count && a->error == b->error;
+}
+
+// Batch runner scaling: the same jobs on 1, 2, 4, ... workers up to the
+// host's cores. Jobs cycle through the kernels with their own registers,
+// except that the first eighth are all long_block, so worker 0's range is
+// the heaviest and the others finish by stealing from it. The one-worker
+// run is the serial baseline every later run's results must match.
+static int bench_batch(size_t count) {
+    static uint32_t programs[sizeof(kernels) / sizeof(kernels[0])][BENCH_MAX_WORDS + 1];
+    const size_t kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+    int words[sizeof(kernels) / sizeof(kernels[0])];
+    BatchJob *jobs = calloc(count, sizeof(BatchJob));
+    BatchResult *serial = calloc(count, sizeof(BatchResult));
+    BatchResult *results = calloc(count, sizeof(BatchResult));
+    int status = 0;
+    
+    if (!jobs || !serial || !results) {
+        printf("Failed to allocate %zu batch jobs\n", count);
+        free(jobs);
+        free(serial);
+        free(results);
+        return -1;
+    }
+    
+    for (size_t k = 0; k < kernel_count; k++) {
+        words[k] = kernels[k].build(programs[k]);
+    }
+    for (size_t n = 0; n < count; n++) {
+        size_t k = n < count / 8 ? kernel_count - 1 : n % kernel_count;
+        jobs[n].program = programs[k];
+        jobs[n].count = words[k];
+        for (int r = 1; r < 32; r++) {
+            jobs[n].regs[r] = 0x9E3779B9u * r + (uint32_t)n * 0x85EBCA6Bu;
+        }
+    }
+    
+    BatchConfig config;
+    batch_config_default(&config);
+    config.inst_mem_size = BENCH_MEM_SIZE;
+    config.data_mem_size = BENCH_MEM_SIZE;
+    
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_workers = cores > 0 ? (unsigned int)cores : 1;
+    double serial_seconds = 0;
+    
+    for (unsigned int workers = 1; workers <= max_workers; ) {
+        BatchResult *out = workers == 1 ? serial : results;
+        config.threads = workers;
+        
+        double start = now_seconds();
+        if (batch_run(jobs, count, out, &config) != 0) {
+            status = -1;
+            break;
+        }
+        double elapsed = now_seconds() - start;
+        
+        uint64_t executed = 0;
+        size_t mismatches = 0;
+        for (size_t n = 0; n < count; n++) {
+            executed += out[n].instruction_count;
+            if (!same_result(&out[n], &serial[n])) {
+                mismatches++;
+            }
+        }
+        if (workers == 1) {
+            serial_seconds = elapsed;
+        }
+        
+        printf("{\"revision\":\"%s\",\"kernel\":\"batch\",\"jobs\":%zu,\"workers\":%u,"
+               "\"instructions\":%llu,\"seconds\":%.6f,\"jobs_per_sec\":%.0f,\"mips\":%.2f,"
+               "\"speedup\":%.2f,\"mismatches\":%zu}\n",
+               BENCH_REVISION, count, workers, (unsigned long long)executed, elapsed,
+               count / elapsed, executed / elapsed / 1e6, serial_seconds / elapsed, mismatches);
+        fflush(stdout);
+        if (mismatches) {
+            status = -1;
+        }
+        
+        // Powers of two, then the core count itself
+        workers = workers * 2 > max_workers && workers < max_workers ? max_workers : workers * 2;
+    }
+    
+    free(jobs);
+    free(serial);
+    free(results);
+    return status;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n instructions] [-k kernel] [-e engine] [-s isa] [-c] [-d a,b [-I n]] [-m] [-B jobs] [-R] [-F]\n", prog);
+    printf("  kernels: alu_chain alu_independent shift_heavy long_block\n");
+    printf("  engines: reference threaded block jit lockstep\n");
+    printf("  -s isa   Lockstep vector ISA: scalar avx2 avx512 (default: best available)\n");
+    printf("  -c       Check the lockstep engine against scalar runs instead of timing\n");
+    printf("  -d a,b   Run engines a and b side by side and find where they diverge (not lockstep)\n");
+    printf("  -I n     Instructions between state-hash comparisons for -d (default %d)\n",
+           DIFFCHECK_DEFAULT_INTERVAL);
+    printf("  -m       Time data memory accessors, checked versus guard pages\n");
+    printf("  -B jobs  Run jobs on the batch runner at 1, 2, 4, ... workers up to the core count\n");
+    printf("           and check every job's result against the one-worker run\n");
+    printf("  -R       Check record/replay seeks against a plain run, syscall reads included\n");
+    printf("  -F       Run the threaded engine without pair fusion\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t budget = BENCH_DEFAULT_BUDGET;
+    const char *kernel_name = NULL;
+    const char *engine_name = NULL;
+    int check = 0;
+    const char *diff_spec = NULL;
+    DiffEngine diff_engines[2];
+    uint64_t diff_interval = DIFFCHECK_DEFAULT_INTERVAL;
+    int memory = 0;
+    size_t batch_jobs = 0;
+    int replay = 0;
+    int status = 0;
+    
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+            budget = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-k") == 0 && arg + 1 < argc) {
+            kernel_name = argv[++arg];
+        } else if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc) {
+            engine_name = argv[++arg];
+        } else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+            const char *isa = argv[++arg];
+            lockstep_isa = strcmp(isa, "avx512") == 0 ? LOCKSTEP_ISA_AVX512 :
+                           strcmp(isa, "avx2") == 0 ? LOCKSTEP_ISA_AVX2 : LOCKSTEP_ISA_SCALAR;
+        } else if (strcmp(argv[arg], "-c") == 0) {
+            check = 1;
+        } else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+            diff_spec = argv[++arg];
+        } else if (strcmp(argv[arg], "-I") == 0 && arg + 1 < argc) {
+            diff_interval = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-m") == 0) {
+            memory = 1;
+        } else if (strcmp(argv[arg], "-B") == 0 && arg + 1 < argc) {
+            batch_jobs = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-R") == 0) {
+            replay = 1;
+        } else if (strcmp(argv[arg], "-F") == 0) {
+            fusion_disabled = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    trace_set_verbosity(TRACE_LEVEL_ERRORS);
+    
+    if (diff_spec) {
+        char first[32];
+        size_t length = strcspn(diff_spec, ",");
+        snprintf(first, sizeof(first), "%.*s", (int)length, diff_spec);
+        diff_engines[0] = diffcheck_engine_from_name(first);
+        diff_engines[1] = diff_spec[length] ? diffcheck_engine_from_name(diff_spec + length + 1) :
+                          DIFF_ENGINE_COUNT;
+        if (diff_engines[0] == DIFF_ENGINE_COUNT || diff_engines[1] == DIFF_ENGINE_COUNT) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (memory) {
+        for (int guard = 0; guard <= 1; guard++) {
+            if (bench_memory(guard, budget) != 0) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+    
+    if (replay) {
+        return check_replay() == 0 ? 0 : 1;
+    }
+    
+    if (batch_jobs) {
+        return bench_batch(batch_jobs) == 0 ? 0 : 1;
+    }
+    
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (kernel_name && strcmp(kernel_name, kernels[k].name) != 0) {
+            continue;
+        }
+        if (check) {
+            if (check_lockstep(&kernels[k]) != 0) {
+                status = 1;
+            }
+            continue;
+        }
+        if (diff_spec) {
+            if (check_engines(&kernels[k], diff_engines, budget, diff_interval) != 0) {
+                status = 1;
+            }
+            continue;
+        }
+        for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+            if (engine_name && strcmp(engine_name, engines[e].name) != 0) {
+                continue;
+            }
+            if (bench_one(&kernels[k], &engines[e], budget) != 0) {
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
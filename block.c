@@ -0,0 +1,309 @@
+// block.c
+#include "block.h"
+#include "execute.h"
+#include "jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLOCK_INITIAL_BUCKETS 1024
+
+static uint32_t block_hash(BlockCache *cache, uint32_t pc) {
+    return ((pc >> 2) * 2654435761u) & (cache->bucket_count - 1);
+}
+
+void block_cache_init(BlockCache *cache) {
+    cache->bucket_count = BLOCK_INITIAL_BUCKETS;
+    cache->buckets = calloc(cache->bucket_count, sizeof(Block *));
+    if (!cache->buckets) {
+        printf("Failed to allocate block cache\n");
+        exit(1);
+    }
+    cache->block_count = 0;
+    cache->generation = 0;
+    cache->jit = NULL;
+    cache->jit_threshold = 0;
+    cache->coverage = NULL;
+    cache->coverage_prev = 0;
+    cache->coverage_edges = NULL;
+    cache->coverage_edge_count = 0;
+}
+
+int block_cache_enable_jit(BlockCache *cache, uint64_t threshold) {
+    if (!jit_available() || cache->jit) {
+        return cache->jit ? 0 : -1;
+    }
+    
+    JitArena *arena = malloc(sizeof(JitArena));
+    if (!arena || jit_arena_init(arena, JIT_ARENA_SIZE) != 0) {
+        free(arena);
+        return -1;
+    }
+    
+    cache->jit = arena;
+    cache->jit_threshold = threshold;
+    return 0;
+}
+
+void block_cache_flush(BlockCache *cache) {
+    for (uint32_t b = 0; b < cache->bucket_count; b++) {
+        Block *block = cache->buckets[b];
+        while (block) {
+            Block *next = block->hash_next;
+            free(block);
+            block = next;
+        }
+        cache->buckets[b] = NULL;
+    }
+    cache->block_count = 0;
+    
+    if (cache->jit) {
+        jit_arena_reset(cache->jit);
+    }
+}
+
+void block_cache_destroy(BlockCache *cache) {
+    if (cache->buckets) {
+        block_cache_flush(cache);
+        free(cache->buckets);
+        cache->buckets = NULL;
+    }
+    if (cache->jit) {
+        jit_arena_destroy(cache->jit);
+        free(cache->jit);
+        cache->jit = NULL;
+    }
+}
+
+// Double the bucket array once the table averages more than one block per bucket
+static void block_cache_grow(BlockCache *cache) {
+    uint32_t old_count = cache->bucket_count;
+    Block **old_buckets = cache->buckets;
+    
+    Block **buckets = calloc(old_count * 2, sizeof(Block *));
+    if (!buckets) {
+        return;     // Keep the longer chains rather than fail
+    }
+    
+    cache->buckets = buckets;
+    cache->bucket_count = old_count * 2;
+    
+    for (uint32_t b = 0; b < old_count; b++) {
+        Block *block = old_buckets[b];
+        while (block) {
+            Block *next = block->hash_next;
+            uint32_t h = block_hash(cache, block->pc);
+            block->hash_next = buckets[h];
+            buckets[h] = block;
+            block = next;
+        }
+    }
+    free(old_buckets);
+}
+
+// Translate the straight-line run starting at pc
+static Block *block_translate(BlockCache *cache, CPU *cpu, uint32_t pc) {
+    // The first word must be a valid instruction address
+    if (!cpu_decode_at(cpu, pc)) {
+        return NULL;
+    }
+    
+    Block *block = malloc(sizeof(Block) + BLOCK_MAX_OPS * sizeof(MicroOp));
+    if (!block) {
+        printf("Failed to allocate block at 0x%08x\n", pc);
+        cpu_halt(cpu);
+        return NULL;
+    }
+    
+    block->pc = pc;
+    block->length = 0;
+    block->end = BLOCK_END_FALLTHROUGH;
+    block->exec_count = 0;
+    block->native = NULL;
+    block->jit_failed = 0;
+    block->next = NULL;
+    
+    uint32_t addr = pc;
+    while (block->length < BLOCK_MAX_OPS) {
+        // Stop quietly at the end of memory; the successor lookup reports it
+        if (addr + 3 >= cpu->inst_mem_size) {
+            break;
+        }
+        
+        Instruction *inst = cpu_decode_at(cpu, addr);
+        if (inst->op == OP_HALT) {
+            block->end = BLOCK_END_HALT;
+            break;
+        }
+        if (inst->op == OP_ILLEGAL || inst->op == OP_EBREAK) {
+            block->end = BLOCK_END_ILLEGAL;
+            break;
+        }
+        if (inst->op == OP_ECALL) {
+            block->end = BLOCK_END_ECALL;
+            break;
+        }
+        
+        MicroOp *uop = &block->ops[block->length++];
+        uop->op = (uint8_t)inst->op;
+        uop->rd = (uint8_t)inst->rd;
+        uop->rs1 = (uint8_t)inst->rs1;
+        uop->rs2 = (uint8_t)inst->rs2;
+        addr += 4;
+    }
+    block->end_pc = addr;
+    
+    // Trim to the translated length
+    Block *trimmed = realloc(block, sizeof(Block) + block->length * sizeof(MicroOp));
+    if (trimmed) {
+        block = trimmed;
+    }
+    
+    uint32_t h = block_hash(cache, pc);
+    block->hash_next = cache->buckets[h];
+    cache->buckets[h] = block;
+    
+    if (++cache->block_count > cache->bucket_count) {
+        block_cache_grow(cache);
+    }
+    return block;
+}
+
+Block *block_lookup(BlockCache *cache, CPU *cpu, uint32_t pc) {
+    for (Block *block = cache->buckets[block_hash(cache, pc)]; block; block = block->hash_next) {
+        if (block->pc == pc) {
+            return block;
+        }
+    }
+    return block_translate(cache, cpu, pc);
+}
+
+// Compile a hot block, recycling the arena when it fills up
+static void block_compile(BlockCache *cache, Block *block) {
+    if (!jit_arena_has_room(cache->jit, block)) {
+        for (uint32_t b = 0; b < cache->bucket_count; b++) {
+            for (Block *other = cache->buckets[b]; other; other = other->hash_next) {
+                other->native = NULL;
+            }
+        }
+        jit_arena_reset(cache->jit);
+    }
+    
+    block->native = (void *)jit_compile_block(cache->jit, block);
+    if (!block->native) {
+        block->jit_failed = 1;
+    }
+}
+
+// Execute the first count micro-ops of a block
+static void block_execute(uint32_t *regs, const MicroOp *ops, uint32_t count) {
+    for (uint32_t n = 0; n < count; n++) {
+        const MicroOp *uop = &ops[n];
+        uint32_t a = regs[uop->rs1];
+        uint32_t b = regs[uop->rs2];
+        uint32_t result;
+        
+        switch (uop->op) {
+            case OP_ADD:  result = a + b; break;
+            case OP_SUB:  result = a - b; break;
+            case OP_SLL:  result = a << (b & 0x1F); break;
+            case OP_SLT:  result = (int32_t)a < (int32_t)b; break;
+            case OP_SLTU: result = a < b; break;
+            case OP_XOR:  result = a ^ b; break;
+            case OP_SRL:  result = a >> (b & 0x1F); break;
+            case OP_SRA:  result = (uint32_t)((int32_t)a >> (b & 0x1F)); break;
+            case OP_OR:   result = a | b; break;
+            case OP_AND:  result = a & b; break;
+            default:      result = regs[uop->rd]; break;
+        }
+        
+        regs[uop->rd] = result;
+        regs[0] = 0;
+    }
+}
+
+uint64_t block_run(BlockCache *cache, CPU *cpu, uint64_t max_instructions) {
+    uint64_t executed = 0;
+    
+    if (cache->generation != cpu->code_generation) {
+        block_cache_flush(cache);
+        cache->generation = cpu->code_generation;
+    }
+    
+    if (cpu->halted || max_instructions == 0) {
+        return 0;
+    }
+    
+    Block *block = block_lookup(cache, cpu, cpu->pc);
+    
+    while (block) {
+        uint64_t remaining = max_instructions - executed;
+        block->exec_count++;
+        
+        if (cache->coverage) {
+            uint32_t here = ((block->pc >> 2) * 2654435761u) >> 16;
+            uint32_t edge = (here ^ cache->coverage_prev) & (BLOCK_COVERAGE_SIZE - 1);
+            // A counter that wraps can be listed again, hence the bound
+            if (!cache->coverage[edge] && cache->coverage_edges &&
+                cache->coverage_edge_count < BLOCK_COVERAGE_SIZE) {
+                cache->coverage_edges[cache->coverage_edge_count++] = edge;
+            }
+            cache->coverage[edge]++;
+            cache->coverage_prev = here >> 1;   // Keeps A->B and B->A apart
+        }
+        
+        if (block->length > remaining) {
+            // Budget ends inside this block
+            block_execute(cpu->regs, block->ops, (uint32_t)remaining);
+            executed += remaining;
+            cpu->pc = block->pc + (uint32_t)remaining * 4;
+            break;
+        }
+        
+        if (cache->jit && !block->native && !block->jit_failed &&
+            block->exec_count >= cache->jit_threshold) {
+            block_compile(cache, block);
+        }
+        
+        if (block->native) {
+            ((JitBlockFunc)block->native)(cpu->regs);
+        } else {
+            block_execute(cpu->regs, block->ops, block->length);
+        }
+        executed += block->length;
+        cpu->pc = block->end_pc;
+        
+        if (block->end == BLOCK_END_HALT) {
+            cpu->halted = 1;
+            break;
+        }
+        if (block->end == BLOCK_END_ILLEGAL) {
+            // Let the reference interpreter report and halt
+            execute_instruction(cpu, cpu_decode_at(cpu, cpu->pc));
+            break;
+        }
+        if (block->end == BLOCK_END_ECALL && executed < max_instructions) {
+            // The syscall may stop the CPU, so the next block is looked up afresh
+            execute_instruction(cpu, cpu_decode_at(cpu, cpu->pc));
+            if (cpu->halted) {
+                break;
+            }
+            executed++;
+            if (executed >= max_instructions) {
+                break;
+            }
+            block = block_lookup(cache, cpu, cpu->pc);
+            continue;
+        }
+        if (executed >= max_instructions) {
+            break;
+        }
+        
+        if (!block->next) {
+            block->next = block_lookup(cache, cpu, block->end_pc);
+        }
+        block = block->next;
+    }
+    
+    cpu->instruction_count += executed;
+    return executed;
+}
@@ -0,0 +1,78 @@
+// block.h
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "cpu.h"
+
+#define BLOCK_MAX_OPS 64    // Longest straight-line run translated at once
+#define BLOCK_JIT_DEFAULT_THRESHOLD 16  // Entries before a block is compiled
+#define BLOCK_COVERAGE_SIZE (1u << 16)  // Edge counters in a coverage map
+
+struct JitArena;
+
+// How a translated block ends
+typedef enum {
+    BLOCK_END_FALLTHROUGH,  // Length limit or end of memory; continue at end_pc
+    BLOCK_END_HALT,         // Next word is the 0x00000000 halt sentinel
+    BLOCK_END_ILLEGAL,      // Next word could not be translated
+    BLOCK_END_ECALL         // Next word is an ECALL, run by the reference interpreter
+} BlockEnd;
+
+// Pre-resolved micro-op, one per guest instruction
+typedef struct {
+    uint8_t op;             // Operation
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+} MicroOp;
+
+// Straight-line run of guest code starting at pc
+typedef struct Block {
+    uint32_t pc;            // Guest PC of the first instruction
+    uint32_t end_pc;        // Guest PC following the last micro-op
+    uint32_t length;        // Number of micro-ops
+    BlockEnd end;           // What happens at end_pc
+    uint64_t exec_count;    // Times this block has been entered
+    void *native;           // JIT-compiled code, if any
+    int jit_failed;         // Backend could not translate this block
+    struct Block *next;     // Chained successor, resolved on first exit
+    struct Block *hash_next;
+    MicroOp ops[];
+} Block;
+
+// Translated blocks keyed by guest PC
+typedef struct {
+    Block **buckets;
+    uint32_t bucket_count;  // Always a power of two
+    uint32_t block_count;
+    uint32_t generation;    // CPU code_generation the blocks were built from
+    struct JitArena *jit;   // Native code arena, NULL when the JIT is off
+    uint64_t jit_threshold; // Entries before a block is compiled
+    uint8_t *coverage;      // BLOCK_COVERAGE_SIZE edge hit counters, NULL when off
+    uint32_t coverage_prev; // Hashed predecessor of the next block entered
+    uint32_t *coverage_edges;       // Optional: BLOCK_COVERAGE_SIZE slots for edges first hit
+    uint32_t coverage_edge_count;   // Reset by the owner of coverage_edges
+} BlockCache;
+
+void block_cache_init(BlockCache *cache);
+void block_cache_destroy(BlockCache *cache);
+void block_cache_flush(BlockCache *cache);
+
+// Compile blocks to native code once they have been entered threshold
+// times. Returns -1 (leaving the cache interpreted) if the host has no JIT.
+int block_cache_enable_jit(BlockCache *cache, uint64_t threshold);
+
+// Find the block starting at pc, translating it on a miss.
+// Returns NULL (and halts the CPU) if pc is not a valid instruction address.
+Block *block_lookup(BlockCache *cache, CPU *cpu, uint32_t pc);
+
+// Run translated blocks until the CPU halts or max_instructions have
+// executed. Returns the number of instructions executed. With a coverage
+// map attached, every block entry bumps the counter for the edge from the
+// previous block, indexed by a hash of both PCs (AFL style); control only
+// changes between blocks, so these are all the edges of the run. Counters
+// taken from zero are also listed in coverage_edges, when set, so the map
+// need not be scanned.
+uint64_t block_run(BlockCache *cache, CPU *cpu, uint64_t max_instructions);
+
+#endif
@@ -0,0 +1,532 @@
+// cachesim.c
+#include "cachesim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int is_power_of_two(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint32_t log2_of(uint32_t value) {
+    uint32_t shift = 0;
+    while ((1u << shift) < value) {
+        shift++;
+    }
+    return shift;
+}
+
+static uint32_t hash_line(uint32_t line) {
+    return line * 0x9E3779B1u;
+}
+
+static int shadow_init(ShadowCache *shadow, uint32_t capacity) {
+    memset(shadow, 0, sizeof(*shadow));
+    shadow->capacity = capacity;
+    shadow->head = -1;
+    shadow->tail = -1;
+    
+    uint32_t buckets = 1;
+    while (buckets < capacity * 2) {
+        buckets <<= 1;
+    }
+    shadow->bucket_mask = buckets - 1;
+    
+    shadow->lines = malloc(capacity * sizeof(uint32_t));
+    shadow->prev = malloc(capacity * sizeof(int32_t));
+    shadow->next = malloc(capacity * sizeof(int32_t));
+    shadow->chain = malloc(capacity * sizeof(int32_t));
+    shadow->buckets = malloc(buckets * sizeof(int32_t));
+    if (!shadow->lines || !shadow->prev || !shadow->next || !shadow->chain || !shadow->buckets) {
+        return -1;
+    }
+    for (uint32_t b = 0; b < buckets; b++) {
+        shadow->buckets[b] = -1;
+    }
+    return 0;
+}
+
+static void shadow_destroy(ShadowCache *shadow) {
+    free(shadow->lines);
+    free(shadow->prev);
+    free(shadow->next);
+    free(shadow->chain);
+    free(shadow->buckets);
+    memset(shadow, 0, sizeof(*shadow));
+}
+
+static void shadow_unlink(ShadowCache *shadow, int32_t node) {
+    if (shadow->prev[node] >= 0) {
+        shadow->next[shadow->prev[node]] = shadow->next[node];
+    } else {
+        shadow->head = shadow->next[node];
+    }
+    if (shadow->next[node] >= 0) {
+        shadow->prev[shadow->next[node]] = shadow->prev[node];
+    } else {
+        shadow->tail = shadow->prev[node];
+    }
+}
+
+static void shadow_push_front(ShadowCache *shadow, int32_t node) {
+    shadow->prev[node] = -1;
+    shadow->next[node] = shadow->head;
+    if (shadow->head >= 0) {
+        shadow->prev[shadow->head] = node;
+    }
+    shadow->head = node;
+    if (shadow->tail < 0) {
+        shadow->tail = node;
+    }
+}
+
+// Touch a line; returns 1 if it was resident. Misses only insert the
+// line when allocate is set, mirroring the real cache's fill policy.
+static int shadow_access(ShadowCache *shadow, uint32_t line, int allocate) {
+    int32_t *bucket = &shadow->buckets[hash_line(line) & shadow->bucket_mask];
+    for (int32_t node = *bucket; node >= 0; node = shadow->chain[node]) {
+        if (shadow->lines[node] == line) {
+            shadow_unlink(shadow, node);
+            shadow_push_front(shadow, node);
+            return 1;
+        }
+    }
+    if (!allocate) {
+        return 0;
+    }
+    
+    int32_t node;
+    if (shadow->used < shadow->capacity) {
+        node = (int32_t)shadow->used++;
+    } else {
+        // Evict the least recently used line from its hash chain
+        node = shadow->tail;
+        shadow_unlink(shadow, node);
+        int32_t *link = &shadow->buckets[hash_line(shadow->lines[node]) & shadow->bucket_mask];
+        while (*link != node) {
+            link = &shadow->chain[*link];
+        }
+        *link = shadow->chain[node];
+    }
+    
+    shadow->lines[node] = line;
+    shadow->chain[node] = *bucket;
+    *bucket = node;
+    shadow_push_front(shadow, node);
+    return 0;
+}
+
+static int lineset_grow(LineSet *set) {
+    uint32_t capacity = set->capacity ? set->capacity * 2 : 1024;
+    uint32_t *keys = calloc(capacity, sizeof(uint32_t));
+    if (!keys) {
+        return -1;
+    }
+    for (uint32_t n = 0; n < set->capacity; n++) {
+        uint32_t key = set->keys[n];
+        if (key) {
+            uint32_t slot = hash_line(key) & (capacity - 1);
+            while (keys[slot]) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            keys[slot] = key;
+        }
+    }
+    free(set->keys);
+    set->keys = keys;
+    set->capacity = capacity;
+    return 0;
+}
+
+// Returns 1 if the line had not been seen before. The line is only
+// recorded when insert is set, so a miss that allocates nothing leaves
+// the next one compulsory too.
+static int lineset_insert(LineSet *set, uint32_t line, int insert) {
+    if (set->count * 2 >= set->capacity && lineset_grow(set) != 0) {
+        return 0;
+    }
+    uint32_t key = line + 1;
+    uint32_t slot = hash_line(key) & (set->capacity - 1);
+    while (set->keys[slot]) {
+        if (set->keys[slot] == key) {
+            return 0;
+        }
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    if (!insert) {
+        return 1;
+    }
+    set->keys[slot] = key;
+    set->count++;
+    return 1;
+}
+
+static void level_destroy(CacheLevel *level) {
+    free(level->tags);
+    free(level->valid);
+    free(level->dirty);
+    free(level->stamps);
+    free(level->plru);
+    shadow_destroy(&level->shadow);
+    free(level->seen.keys);
+    memset(level, 0, sizeof(*level));
+}
+
+static int level_init(CacheLevel *level, const char *name, const CacheConfig *config) {
+    memset(level, 0, sizeof(*level));
+    level->name = name;
+    level->config = *config;
+    
+    if (!is_power_of_two(config->size) || !is_power_of_two(config->line_size) ||
+        config->line_size < 4 || config->line_size > config->size) {
+        printf("%s: size and line size must be powers of two, line at least 4 bytes\n", name);
+        return -1;
+    }
+    
+    uint32_t lines = config->size / config->line_size;
+    level->ways = config->ways ? config->ways : lines;
+    if (level->ways > lines || lines % level->ways != 0 || !is_power_of_two(lines / level->ways)) {
+        printf("%s: %u ways do not divide %u lines into a power-of-two number of sets\n",
+               name, level->ways, lines);
+        return -1;
+    }
+    if (config->replacement == CACHE_PLRU && (!is_power_of_two(level->ways) || level->ways > 64)) {
+        printf("%s: pseudo-LRU needs a power-of-two associativity up to 64\n", name);
+        return -1;
+    }
+    
+    level->sets = lines / level->ways;
+    level->line_shift = log2_of(config->line_size);
+    level->rng = 0x2545F491u;
+    level->tags = calloc(lines, sizeof(uint32_t));
+    level->valid = calloc(lines, 1);
+    level->dirty = calloc(lines, 1);
+    level->stamps = calloc(lines, sizeof(uint64_t));
+    level->plru = calloc(level->sets, sizeof(uint64_t));
+    if (!level->tags || !level->valid || !level->dirty || !level->stamps || !level->plru ||
+        shadow_init(&level->shadow, lines) != 0 || lineset_grow(&level->seen) != 0) {
+        printf("%s: failed to allocate cache state\n", name);
+        level_destroy(level);
+        return -1;
+    }
+    return 0;
+}
+
+// Tree pseudo-LRU: each node bit points at the half to evict from next.
+// A use flips the bits on its path to point away from it.
+static void plru_touch(CacheLevel *level, uint32_t set, uint32_t way) {
+    uint64_t bits = level->plru[set];
+    uint32_t node = 1;
+    for (uint32_t half = level->ways >> 1; half; half >>= 1) {
+        uint32_t right = (way & half) != 0;
+        bits = right ? bits & ~(1ull << node) : bits | (1ull << node);
+        node = node * 2 + right;
+    }
+    level->plru[set] = bits;
+}
+
+static uint32_t plru_victim(const CacheLevel *level, uint32_t set) {
+    uint64_t bits = level->plru[set];
+    uint32_t node = 1;
+    uint32_t way = 0;
+    for (uint32_t half = level->ways >> 1; half; half >>= 1) {
+        uint32_t right = (bits >> node) & 1;
+        way |= right ? half : 0;
+        node = node * 2 + right;
+    }
+    return way;
+}
+
+static void touch(CacheLevel *level, uint32_t set, uint32_t way) {
+    level->stamps[set * level->ways + way] = level->clock;
+    if (level->config.replacement == CACHE_PLRU) {
+        plru_touch(level, set, way);
+    }
+}
+
+static uint32_t choose_victim(CacheLevel *level, uint32_t set) {
+    uint32_t base = set * level->ways;
+    for (uint32_t way = 0; way < level->ways; way++) {
+        if (!level->valid[base + way]) {
+            return way;
+        }
+    }
+    
+    switch (level->config.replacement) {
+        case CACHE_PLRU:
+            return plru_victim(level, set);
+        case CACHE_RANDOM:
+            // xorshift32
+            level->rng ^= level->rng << 13;
+            level->rng ^= level->rng >> 17;
+            level->rng ^= level->rng << 5;
+            return level->rng % level->ways;
+        default: {
+            uint32_t victim = 0;
+            for (uint32_t way = 1; way < level->ways; way++) {
+                if (level->stamps[base + way] < level->stamps[base + victim]) {
+                    victim = way;
+                }
+            }
+            return victim;
+        }
+    }
+}
+
+// Access one level; misses fill from (and writebacks go to) next, if any.
+// Returns 1 on a hit.
+static int level_access(CacheLevel *level, CacheLevel *next, uint32_t addr, int write) {
+    uint32_t line = addr >> level->line_shift;
+    uint32_t set = line & (level->sets - 1);
+    uint32_t base = set * level->ways;
+    int write_through = level->config.write_policy == CACHE_WRITE_THROUGH;
+    
+    level->clock++;
+    if (write) {
+        level->stats.writes++;
+    } else {
+        level->stats.reads++;
+    }
+    
+    for (uint32_t way = 0; way < level->ways; way++) {
+        if (level->valid[base + way] && level->tags[base + way] == line) {
+            shadow_access(&level->shadow, line, 1);
+            touch(level, set, way);
+            if (write && write_through) {
+                if (next) {
+                    level_access(next, NULL, addr, 1);
+                }
+            } else if (write) {
+                level->dirty[base + way] = 1;
+            }
+            return 1;
+        }
+    }
+    
+    // Miss: classify against the fully associative shadow
+    int allocate = !(write && write_through);
+    int shadow_hit = shadow_access(&level->shadow, line, allocate);
+    if (lineset_insert(&level->seen, line, allocate)) {
+        level->stats.misses[MISS_COMPULSORY]++;
+    } else if (shadow_hit) {
+        level->stats.misses[MISS_CONFLICT]++;
+    } else {
+        level->stats.misses[MISS_CAPACITY]++;
+    }
+    if (write) {
+        level->stats.write_misses++;
+    } else {
+        level->stats.read_misses++;
+    }
+    
+    if (!allocate) {
+        if (next) {
+            level_access(next, NULL, addr, 1);
+        }
+        return 0;
+    }
+    
+    if (next) {
+        level_access(next, NULL, addr, 0);
+    }
+    
+    uint32_t way = choose_victim(level, set);
+    if (level->valid[base + way] && level->dirty[base + way]) {
+        level->stats.writebacks++;
+        if (next) {
+            level_access(next, NULL, level->tags[base + way] << level->line_shift, 1);
+        }
+    }
+    level->tags[base + way] = line;
+    level->valid[base + way] = 1;
+    level->dirty[base + way] = write;
+    touch(level, set, way);
+    return 0;
+}
+
+void cachesim_config_default(CacheConfig *icache, CacheConfig *dcache) {
+    icache->size = 32 * 1024;
+    icache->ways = 4;
+    icache->line_size = 64;
+    icache->replacement = CACHE_LRU;
+    icache->write_policy = CACHE_WRITE_BACK;
+    
+    *dcache = *icache;
+    dcache->ways = 8;
+}
+
+static int parse_size(const char *text, char **end, uint32_t *value) {
+    unsigned long long size = strtoull(text, end, 0);
+    if (*end == text) {
+        return -1;
+    }
+    if (**end == 'k' || **end == 'K') {
+        size <<= 10;
+        (*end)++;
+    } else if (**end == 'm' || **end == 'M') {
+        size <<= 20;
+        (*end)++;
+    }
+    if (size > UINT32_MAX) {
+        return -1;
+    }
+    *value = (uint32_t)size;
+    return 0;
+}
+
+int cachesim_parse_config(const char *spec, CacheConfig *config) {
+    char *end;
+    
+    config->replacement = CACHE_LRU;
+    config->write_policy = CACHE_WRITE_BACK;
+    
+    if (parse_size(spec, &end, &config->size) != 0 || *end != ':' ||
+        parse_size(end + 1, &end, &config->ways) != 0 || *end != ':' ||
+        parse_size(end + 1, &end, &config->line_size) != 0) {
+        return -1;
+    }
+    
+    while (*end == ':') {
+        const char *field = end + 1;
+        size_t length = strcspn(field, ":,");
+        if (length == 3 && strncmp(field, "lru", 3) == 0) {
+            config->replacement = CACHE_LRU;
+        } else if (length == 4 && strncmp(field, "plru", 4) == 0) {
+            config->replacement = CACHE_PLRU;
+        } else if (length == 6 && strncmp(field, "random", 6) == 0) {
+            config->replacement = CACHE_RANDOM;
+        } else if (length == 2 && strncmp(field, "wb", 2) == 0) {
+            config->write_policy = CACHE_WRITE_BACK;
+        } else if (length == 2 && strncmp(field, "wt", 2) == 0) {
+            config->write_policy = CACHE_WRITE_THROUGH;
+        } else {
+            return -1;
+        }
+        end = (char *)field + length;
+    }
+    return *end == '\0' || *end == ',' ? 0 : -1;
+}
+
+int cachesim_init(CacheHierarchy *caches, const CacheConfig *icache, const CacheConfig *dcache,
+                  const CacheConfig *l2, unsigned int inst_mem_size) {
+    memset(caches, 0, sizeof(*caches));
+    
+    if (level_init(&caches->icache, "L1-I", icache) != 0 ||
+        level_init(&caches->dcache, "L1-D", dcache) != 0 ||
+        (l2 && level_init(&caches->l2, "L2", l2) != 0)) {
+        cachesim_destroy(caches);
+        return -1;
+    }
+    caches->has_l2 = l2 != NULL;
+    
+    caches->slots = inst_mem_size / 4 + 1;
+    caches->pc_misses = calloc(caches->slots, sizeof(*caches->pc_misses));
+    if (!caches->pc_misses) {
+        printf("Failed to allocate cache miss table\n");
+        cachesim_destroy(caches);
+        return -1;
+    }
+    return 0;
+}
+
+void cachesim_destroy(CacheHierarchy *caches) {
+    level_destroy(&caches->icache);
+    level_destroy(&caches->dcache);
+    level_destroy(&caches->l2);
+    free(caches->pc_misses);
+    caches->pc_misses = NULL;
+    caches->slots = 0;
+    caches->has_l2 = 0;
+}
+
+void cachesim_fetch(CacheHierarchy *caches, uint32_t pc) {
+    CacheLevel *next = caches->has_l2 ? &caches->l2 : NULL;
+    if (!level_access(&caches->icache, next, pc, 0) && (pc >> 2) < caches->slots) {
+        caches->pc_misses[pc >> 2][CACHE_SIDE_INST]++;
+    }
+}
+
+void cachesim_data(CacheHierarchy *caches, uint32_t pc, uint32_t addr, int write) {
+    CacheLevel *next = caches->has_l2 ? &caches->l2 : NULL;
+    if (!level_access(&caches->dcache, next, addr, write) && (pc >> 2) < caches->slots) {
+        caches->pc_misses[pc >> 2][CACHE_SIDE_DATA]++;
+    }
+}
+
+const CacheStats *cachesim_stats(const CacheLevel *level) {
+    return &level->stats;
+}
+
+uint64_t cachesim_pc_misses(const CacheHierarchy *caches, uint32_t pc, CacheSide side) {
+    if ((pc >> 2) >= caches->slots || side < 0 || side >= CACHE_SIDES) {
+        return 0;
+    }
+    return caches->pc_misses[pc >> 2][side];
+}
+
+static void report_level(const CacheLevel *level) {
+    static const char *replacement[] = { "lru", "plru", "random" };
+    static const char *write_policy[] = { "write-back", "write-through" };
+    const CacheStats *stats = &level->stats;
+    uint64_t accesses = stats->reads + stats->writes;
+    uint64_t misses = stats->read_misses + stats->write_misses;
+    
+    printf("%s: %u %s, %u-way, %u-byte lines, %s, %s\n", level->name,
+           level->config.size >= 1024 ? level->config.size / 1024 : level->config.size,
+           level->config.size >= 1024 ? "KiB" : "bytes", level->ways, level->config.line_size,
+           replacement[level->config.replacement], write_policy[level->config.write_policy]);
+    printf("  Accesses: %llu (%llu reads, %llu writes)\n", (unsigned long long)accesses,
+           (unsigned long long)stats->reads, (unsigned long long)stats->writes);
+    printf("  Misses:   %llu (%.2f%% miss, %.2f%% hit)\n", (unsigned long long)misses,
+           accesses ? 100.0 * misses / accesses : 0.0,
+           accesses ? 100.0 * (accesses - misses) / accesses : 0.0);
+    printf("            compulsory %llu, capacity %llu, conflict %llu\n",
+           (unsigned long long)stats->misses[MISS_COMPULSORY],
+           (unsigned long long)stats->misses[MISS_CAPACITY],
+           (unsigned long long)stats->misses[MISS_CONFLICT]);
+    printf("  Writebacks: %llu\n", (unsigned long long)stats->writebacks);
+}
+
+static uint64_t slot_misses(const CacheHierarchy *caches, uint32_t slot) {
+    return caches->pc_misses[slot][CACHE_SIDE_INST] + caches->pc_misses[slot][CACHE_SIDE_DATA];
+}
+
+void cachesim_report(const CacheHierarchy *caches, size_t top) {
+    uint32_t worst[top ? top : 1];
+    size_t used = 0;
+    
+    printf("\n=== Cache Simulation ===\n");
+    report_level(&caches->icache);
+    report_level(&caches->dcache);
+    if (caches->has_l2) {
+        report_level(&caches->l2);
+    }
+    
+    // Keep the top missing slots, worst first
+    for (uint32_t slot = 0; slot < caches->slots && top > 0; slot++) {
+        uint64_t misses = slot_misses(caches, slot);
+        if (misses == 0) {
+            continue;
+        }
+        size_t pos = used < top ? used : top;
+        while (pos > 0 && slot_misses(caches, worst[pos - 1]) < misses) {
+            if (pos < top) {
+                worst[pos] = worst[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < top) {
+            worst[pos] = slot;
+        }
+        used = used < top ? used + 1 : top;
+    }
+    
+    printf("\nL1 miss hotspots:\n");
+    for (size_t n = 0; n < used; n++) {
+        printf("  %08x %8llu  (inst %llu, data %llu)\n", worst[n] << 2,
+               (unsigned long long)slot_misses(caches, worst[n]),
+               (unsigned long long)caches->pc_misses[worst[n]][CACHE_SIDE_INST],
+               (unsigned long long)caches->pc_misses[worst[n]][CACHE_SIDE_DATA]);
+    }
+    printf("========================\n\n");
+}
@@ -0,0 +1,127 @@
+// cachesim.h
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Guest cache hierarchy: split L1 instruction and data caches with an
+// optional unified L2. Attached through cpu->caches, it sees every fetch
+// retired by the reference interpreter and every data access that passes
+// the bounds and alignment checks. Timing is not modelled, only hits,
+// misses and traffic.
+
+typedef enum {
+    CACHE_LRU,          // Least recently used
+    CACHE_PLRU,         // Tree pseudo-LRU (power-of-two ways)
+    CACHE_RANDOM        // Uniformly random way
+} CacheReplacement;
+
+typedef enum {
+    CACHE_WRITE_BACK,       // Write-allocate, dirty lines written back on eviction
+    CACHE_WRITE_THROUGH     // No-write-allocate, every write goes to the next level
+} CacheWritePolicy;
+
+typedef struct {
+    uint32_t size;          // Bytes, power of two
+    uint32_t ways;          // Associativity, 0 for fully associative
+    uint32_t line_size;     // Bytes, power of two, at least 4
+    CacheReplacement replacement;
+    CacheWritePolicy write_policy;
+} CacheConfig;
+
+// Why a miss happened (the "three Cs")
+typedef enum {
+    MISS_COMPULSORY,    // First reference to the line
+    MISS_CAPACITY,      // A fully associative LRU cache of the same size misses too
+    MISS_CONFLICT,      // Only the set mapping made it miss
+    MISS_KINDS
+} MissKind;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t read_misses;
+    uint64_t write_misses;
+    uint64_t misses[MISS_KINDS];
+    uint64_t writebacks;    // Dirty lines evicted
+} CacheStats;
+
+// Fully associative LRU cache of the same capacity, for miss classification
+typedef struct {
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t *lines;
+    int32_t *prev;
+    int32_t *next;
+    int32_t *chain;         // Next node in the same hash bucket
+    int32_t *buckets;
+    uint32_t bucket_mask;
+    int32_t head;           // Most recently used
+    int32_t tail;           // Least recently used
+} ShadowCache;
+
+// Lines referenced so far, for compulsory misses
+typedef struct {
+    uint32_t *keys;         // line + 1, 0 when empty
+    uint32_t capacity;
+    uint32_t count;
+} LineSet;
+
+typedef struct {
+    const char *name;
+    CacheConfig config;
+    uint32_t ways;
+    uint32_t sets;
+    uint32_t line_shift;
+    uint32_t *tags;         // Line number per way, sets * ways
+    uint8_t *valid;
+    uint8_t *dirty;
+    uint64_t *stamps;       // LRU: last use per way
+    uint64_t *plru;         // PLRU: tree bits per set
+    uint64_t clock;
+    uint32_t rng;
+    CacheStats stats;
+    ShadowCache shadow;
+    LineSet seen;
+} CacheLevel;
+
+typedef enum {
+    CACHE_SIDE_INST,
+    CACHE_SIDE_DATA,
+    CACHE_SIDES
+} CacheSide;
+
+typedef struct CacheHierarchy {
+    CacheLevel icache;
+    CacheLevel dcache;
+    CacheLevel l2;
+    int has_l2;
+    uint64_t (*pc_misses)[CACHE_SIDES]; // L1 misses per 4-byte instruction slot
+    uint32_t slots;
+} CacheHierarchy;
+
+// 32 KiB 4-way I-cache, 32 KiB 8-way write-back D-cache, 64-byte lines, LRU
+void cachesim_config_default(CacheConfig *icache, CacheConfig *dcache);
+
+// Parse "size:ways:line[:lru|plru|random[:wb|wt]]", sizes take k/m suffixes.
+// Returns 0, or -1 if the spec is malformed.
+int cachesim_parse_config(const char *spec, CacheConfig *config);
+
+// l2 may be NULL for no L2. Returns 0, or -1 on a bad geometry or allocation failure.
+int cachesim_init(CacheHierarchy *caches, const CacheConfig *icache, const CacheConfig *dcache,
+                  const CacheConfig *l2, unsigned int inst_mem_size);
+void cachesim_destroy(CacheHierarchy *caches);
+
+// Feed one access; pc attributes L1 misses
+void cachesim_fetch(CacheHierarchy *caches, uint32_t pc);
+void cachesim_data(CacheHierarchy *caches, uint32_t pc, uint32_t addr, int write);
+
+// Results
+const CacheStats *cachesim_stats(const CacheLevel *level);
+uint64_t cachesim_pc_misses(const CacheHierarchy *caches, uint32_t pc, CacheSide side);
+
+// Per-level hit/miss rates, miss causes and the top L1 miss PCs, on stdout
+void cachesim_report(const CacheHierarchy *caches, size_t top);
+
+#endif
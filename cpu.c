@@ -1,19 +1,44 @@
 // cpu.c
 #include "cpu.h"
+#include "trace.h"
+#include "guard.h"
+#include "profile.h"
+#include "cachesim.h"
+#include "mmio.h"
+#include "execute.h"
+#include "threaded.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#define FNV_PRIME 0x100000001b3ULL
 
-int i;
-uint32_t addr;
+// Instruction memory is an anonymous mapping: zero pages are only materialized
+// when touched, and loaders can map file pages over them in place.
+static uint8_t *memory_map(unsigned int size) {
+    void *memory = mmap(NULL, cpu_memory_mapped_size(size), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+static void memory_unmap(uint8_t *memory, unsigned int size) {
+    munmap(memory, cpu_memory_mapped_size(size));
+}
 
+// Bytes actually mapped for a guest memory of the given size
+size_t cpu_memory_mapped_size(unsigned int size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = ((size_t)size + page - 1) & ~(page - 1);
+    return mapped ? mapped : page;
+}
 
 // Initialize CPU with separate instruction and data memory
-void cpu_init(CPU *cpu, unsigned int inst_mem_size, unsigned int data_mem_size) {
+void cpu_init(CPU *cpu, unsigned int inst_mem_size, uint64_t data_mem_size) {
     // Zero out all registers
-    for (i = 0; i < 32; i++) {
+    for (int i = 0; i < 32; i++) {
         cpu->regs[i] = 0;
     }
     
@@ -22,165 +47,345 @@ void cpu_init(CPU *cpu, unsigned int inst_mem_size, unsigned int data_mem_size)
     cpu->data_mem_size = data_mem_size;
     
     // Allocate instruction memory
-    cpu->inst_memory = calloc(1, inst_mem_size);
+    cpu->inst_memory = memory_map(inst_mem_size);
     if (!cpu->inst_memory) {
         printf("Failed to allocate instruction memory\n");
         exit(1);
     }
     
-    // Allocate data memory
-    cpu->data_memory = calloc(1, data_mem_size);
-    if (!cpu->data_memory) {
-        printf("Failed to allocate data memory\n");
-        free(cpu->inst_memory);
+    // Data memory starts empty; pages are allocated on first write
+    paged_init(&cpu->data_memory);
+    cpu->guard_data = NULL;
+    cpu->guard_inst = 0;
+    
+    // Allocate predecode cache, filled lazily as instructions execute
+    cpu->decoded = calloc(inst_mem_size / 4 + 1, sizeof(Instruction));
+    cpu->decoded_valid = calloc(inst_mem_size / 4 + 1, 1);
+    if (!cpu->decoded || !cpu->decoded_valid) {
+        printf("Failed to allocate predecode cache\n");
+        free(cpu->decoded);
+        free(cpu->decoded_valid);
+        memory_unmap(cpu->inst_memory, inst_mem_size);
         exit(1);
     }
     
+    cpu->code_generation = 0;
+    cpu->trace = NULL;
+    cpu->profile = NULL;
+    cpu->caches = NULL;
+    cpu->recording = NULL;
+    cpu->bus = NULL;
+    cpu->syscalls = NULL;
+    cpu->breakpoints = NULL;
+    cpu->fusion = 0;
+    memset(cpu->fusion_hits, 0, sizeof(cpu->fusion_hits));
+    cpu->inst_dirty = NULL;
+    cpu->snapshot_epoch = 0;
+    cpu->state_hashing = 0;
+    cpu->state_hash = 0;
     cpu->halted = 0;
+    cpu->breakpoint = 0;
+    cpu->error = CPU_OK;
+    cpu->error_addr = 0;
     cpu->instruction_count = 0;
 }
 
 // Free allocated memory
 void cpu_destroy(CPU *cpu) {
+    cpu_release_guard_memory(cpu);
     if (cpu->inst_memory) {
-        free(cpu->inst_memory);
+        memory_unmap(cpu->inst_memory, cpu->inst_mem_size);
         cpu->inst_memory = NULL;
     }
-    if (cpu->data_memory) {
-        free(cpu->data_memory);
-        cpu->data_memory = NULL;
+    paged_destroy(&cpu->data_memory);
+    free(cpu->inst_dirty);
+    cpu->inst_dirty = NULL;
+    if (cpu->decoded) {
+        free(cpu->decoded);
+        cpu->decoded = NULL;
+    }
+    if (cpu->decoded_valid) {
+        free(cpu->decoded_valid);
+        cpu->decoded_valid = NULL;
     }
+    free(cpu->breakpoints);
+    cpu->breakpoints = NULL;
 }
 
 // Reset CPU state (but keep memory contents)
 void cpu_reset(CPU *cpu) {
-    for (i = 0; i < 32; i++) {
+    for (int i = 0; i < 32; i++) {
         cpu->regs[i] = 0;
     }
     cpu->pc = 0;
     cpu->halted = 0;
+    cpu->breakpoint = 0;
+    cpu->error = CPU_OK;
+    cpu->error_addr = 0;
     cpu->instruction_count = 0;
+    memset(cpu->fusion_hits, 0, sizeof(cpu->fusion_hits));
 }
 
-// Read 32-bit word from instruction memory
-uint32_t cpu_read_inst_word(CPU *cpu, uint32_t addr) {
-    if (addr + 3 >= cpu->inst_mem_size) {
-        printf("Instruction memory read out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+// Read 32-bit word from instruction memory, bounds checked
+static uint32_t read_inst_word_checked(CPU *cpu, uint32_t addr) {
+    if ((uint64_t)addr + 3 >= cpu->inst_mem_size) {
+        TRACE_ERROR("Instruction memory read out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_INST_OUT_OF_BOUNDS, addr);
         return 0;
     }
     
     if (addr % 4 != 0) {
-        printf("Misaligned instruction read at 0x%08x\n", addr);
-        cpu->halted = 1;
+        TRACE_ERROR("Misaligned instruction read at 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_INST_MISALIGNED, addr);
         return 0;
     }
     
     uint32_t value = cpu->inst_memory[addr] |
                      (cpu->inst_memory[addr + 1] << 8) |
                      (cpu->inst_memory[addr + 2] << 16) |
-                     (cpu->inst_memory[addr + 3] << 24);
+                     ((uint32_t)cpu->inst_memory[addr + 3] << 24);
     return value;
 }
 
+// Read 32-bit word from instruction memory
+uint32_t cpu_read_inst_word(CPU *cpu, uint32_t addr) {
+    if (cpu->guard_inst && addr % 4 == 0) {
+        // Guard pages catch anything past the end
+        uint32_t value;
+        memcpy(&value, cpu->inst_memory + addr, 4);
+        return value;
+    }
+    return read_inst_word_checked(cpu, addr);
+}
+
 // Read 32-bit word from data memory
 uint32_t cpu_read_data_word(CPU *cpu, uint32_t addr) {
-    if (addr + 3 >= cpu->data_mem_size) {
-        printf("Data memory read out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr + 3 >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory read out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_READ_OUT_OF_BOUNDS, addr);
         return 0;
     }
     
     if (addr % 4 != 0) {
-        printf("Misaligned data word read at 0x%08x\n", addr);
-        cpu->halted = 1;
+        TRACE_ERROR("Misaligned data word read at 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_MISALIGNED, addr);
         return 0;
     }
     
-    uint32_t value = cpu->data_memory[addr] |
-                     (cpu->data_memory[addr + 1] << 8) |
-                     (cpu->data_memory[addr + 2] << 16) |
-                     (cpu->data_memory[addr + 3] << 24);
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 0);
+    }
+    
+    if (cpu->guard_data) {
+        uint32_t value;
+        memcpy(&value, cpu->guard_data + addr, 4);
+        return value;
+    }
+    
+    // Aligned accesses never straddle a page
+    uint8_t *page = paged_page_for_read(&cpu->data_memory, addr);
+    if (!page) {
+        return cpu->bus ? mmio_read(cpu->bus, addr, 4) : 0;
+    }
+    
+    uint8_t *bytes = page + (addr & MEM_PAGE_MASK);
+    uint32_t value = bytes[0] |
+                     (bytes[1] << 8) |
+                     (bytes[2] << 16) |
+                     ((uint32_t)bytes[3] << 24);
     return value;
 }
 
+// Fold a data write into state_hash: mask covers the bytes written,
+// before shifting into place within the word
+static void hash_data_write(CPU *cpu, const uint8_t *page, uint32_t addr, uint32_t value, uint32_t mask) {
+    const uint8_t *word = page + (addr & MEM_PAGE_MASK & ~3u);
+    uint32_t old_value = word[0] | (word[1] << 8) | (word[2] << 16) | ((uint32_t)word[3] << 24);
+    uint32_t shift = (addr & 3) * 8;
+    uint32_t new_value = (old_value & ~(mask << shift)) | ((value & mask) << shift);
+    
+    cpu->state_hash ^= paged_word_hash(addr, old_value) ^ paged_word_hash(addr, new_value);
+}
+
 // Write 32-bit word to data memory
 void cpu_write_data_word(CPU *cpu, uint32_t addr, uint32_t value) {
-    if (addr + 3 >= cpu->data_mem_size) {
-        printf("Data memory write out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr + 3 >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory write out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
         return;
     }
     
     if (addr % 4 != 0) {
-        printf("Misaligned data word write at 0x%08x\n", addr);
-        cpu->halted = 1;
+        TRACE_ERROR("Misaligned data word write at 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_MISALIGNED, addr);
+        return;
+    }
+    
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 1);
+    }
+    
+    if (cpu->guard_data) {
+        memcpy(cpu->guard_data + addr, &value, 4);
+        return;
+    }
+    
+    uint8_t *page = paged_page_for_write(&cpu->data_memory, addr);
+    if (!page) {
+        // Device pages are reserved, so they never get a RAM page
+        if (cpu->bus && mmio_write(cpu->bus, addr, value, 4) == 0) {
+            return;
+        }
+        TRACE_ERROR("Failed to allocate data page for 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
         return;
     }
     
-    cpu->data_memory[addr] = value & 0xFF;
-    cpu->data_memory[addr + 1] = (value >> 8) & 0xFF;
-    cpu->data_memory[addr + 2] = (value >> 16) & 0xFF;
-    cpu->data_memory[addr + 3] = (value >> 24) & 0xFF;
+    if (cpu->state_hashing) {
+        hash_data_write(cpu, page, addr, value, 0xFFFFFFFFu);
+    }
+    
+    uint8_t *bytes = page + (addr & MEM_PAGE_MASK);
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
 }
 
 // Read 16-bit halfword from data memory
 uint16_t cpu_read_data_halfword(CPU *cpu, uint32_t addr) {
-    if (addr + 1 >= cpu->data_mem_size) {
-        printf("Data memory read out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr + 1 >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory read out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_READ_OUT_OF_BOUNDS, addr);
         return 0;
     }
     
     if (addr % 2 != 0) {
-        printf("Misaligned halfword read at 0x%08x\n", addr);
-        cpu->halted = 1;
+        TRACE_ERROR("Misaligned halfword read at 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_MISALIGNED, addr);
         return 0;
     }
     
-    uint16_t value = cpu->data_memory[addr] |
-                     (cpu->data_memory[addr + 1] << 8);
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 0);
+    }
+    
+    if (cpu->guard_data) {
+        uint16_t value;
+        memcpy(&value, cpu->guard_data + addr, 2);
+        return value;
+    }
+    
+    uint8_t *page = paged_page_for_read(&cpu->data_memory, addr);
+    if (!page) {
+        return cpu->bus ? (uint16_t)mmio_read(cpu->bus, addr, 2) : 0;
+    }
+    
+    uint8_t *bytes = page + (addr & MEM_PAGE_MASK);
+    uint16_t value = bytes[0] |
+                     (bytes[1] << 8);
     return value;
 }
 
 // Write 16-bit halfword to data memory
 void cpu_write_data_halfword(CPU *cpu, uint32_t addr, uint16_t value) {
-    if (addr + 1 >= cpu->data_mem_size) {
-        printf("Data memory write out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr + 1 >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory write out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
         return;
     }
     
     if (addr % 2 != 0) {
-        printf("Misaligned halfword write at 0x%08x\n", addr);
-        cpu->halted = 1;
+        TRACE_ERROR("Misaligned halfword write at 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_MISALIGNED, addr);
+        return;
+    }
+    
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 1);
+    }
+    
+    if (cpu->guard_data) {
+        memcpy(cpu->guard_data + addr, &value, 2);
         return;
     }
     
-    cpu->data_memory[addr] = value & 0xFF;
-    cpu->data_memory[addr + 1] = (value >> 8) & 0xFF;
+    uint8_t *page = paged_page_for_write(&cpu->data_memory, addr);
+    if (!page) {
+        // Device pages are reserved, so they never get a RAM page
+        if (cpu->bus && mmio_write(cpu->bus, addr, value, 2) == 0) {
+            return;
+        }
+        TRACE_ERROR("Failed to allocate data page for 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
+        return;
+    }
+    
+    if (cpu->state_hashing) {
+        hash_data_write(cpu, page, addr, value, 0xFFFFu);
+    }
+    
+    uint8_t *bytes = page + (addr & MEM_PAGE_MASK);
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
 }
 
 // Read 8-bit byte from data memory
 uint8_t cpu_read_data_byte(CPU *cpu, uint32_t addr) {
-    if (addr >= cpu->data_mem_size) {
-        printf("Data memory read out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory read out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_READ_OUT_OF_BOUNDS, addr);
         return 0;
     }
     
-    return cpu->data_memory[addr];
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 0);
+    }
+    
+    if (cpu->guard_data) {
+        return cpu->guard_data[addr];
+    }
+    
+    uint8_t *page = paged_page_for_read(&cpu->data_memory, addr);
+    if (!page) {
+        return cpu->bus ? (uint8_t)mmio_read(cpu->bus, addr, 1) : 0;
+    }
+    return page[addr & MEM_PAGE_MASK];
 }
 
 // Write 8-bit byte to data memory
 void cpu_write_data_byte(CPU *cpu, uint32_t addr, uint8_t value) {
-    if (addr >= cpu->data_mem_size) {
-        printf("Data memory write out of bounds: 0x%08x\n", addr);
-        cpu->halted = 1;
+    if (!cpu->guard_data && (uint64_t)addr >= cpu->data_mem_size) {
+        TRACE_ERROR("Data memory write out of bounds: 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
         return;
     }
     
-    cpu->data_memory[addr] = value;
+    if (cpu->caches) {
+        cachesim_data(cpu->caches, cpu->pc, addr, 1);
+    }
+    
+    if (cpu->guard_data) {
+        cpu->guard_data[addr] = value;
+        return;
+    }
+    
+    uint8_t *page = paged_page_for_write(&cpu->data_memory, addr);
+    if (!page) {
+        // Device pages are reserved, so they never get a RAM page
+        if (cpu->bus && mmio_write(cpu->bus, addr, value, 1) == 0) {
+            return;
+        }
+        TRACE_ERROR("Failed to allocate data page for 0x%08x\n", addr);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, addr);
+        return;
+    }
+    
+    if (cpu->state_hashing) {
+        hash_data_write(cpu, page, addr, value, 0xFFu);
+    }
+    
+    page[addr & MEM_PAGE_MASK] = value;
 }
 
 // Fetch instruction from instruction memory at PC
@@ -188,9 +393,143 @@ uint32_t cpu_fetch_instruction(CPU *cpu) {
     return cpu_read_inst_word(cpu, cpu->pc);
 }
 
+// Fetch the predecoded instruction at PC, decoding it on first use.
+// Returns NULL (and halts) if the PC is out of bounds or misaligned.
+Instruction *cpu_fetch_decoded(CPU *cpu) {
+    return cpu_decode_at(cpu, cpu->pc);
+}
+
+// Decode one in-bounds slot, without fusion
+static void decode_slot(CPU *cpu, uint32_t slot) {
+    // A planted breakpoint decodes as EBREAK; memory keeps the real word
+    uint32_t word = cpu->breakpoints && cpu->breakpoints[slot] ?
+                    INST_EBREAK : read_inst_word_checked(cpu, slot << 2);
+    decode_instruction(word, &cpu->decoded[slot]);
+    cpu->decoded_valid[slot] = DECODED_VALID;
+}
+
+// Predecoded instruction at an arbitrary instruction address
+Instruction *cpu_decode_at(CPU *cpu, uint32_t addr) {
+    if ((uint64_t)addr + 3 >= cpu->inst_mem_size || addr % 4 != 0) {
+        read_inst_word_checked(cpu, addr);  // Reports the error and halts
+        return NULL;
+    }
+    
+    uint32_t slot = addr >> 2;
+    uint8_t ready = cpu->fusion ? DECODED_FUSED : DECODED_VALID;
+    if (cpu->decoded_valid[slot] < ready) {
+        if (!cpu->decoded_valid[slot]) {
+            decode_slot(cpu, slot);
+        }
+        
+        // Fusion stage: the next slot is decoded too, and a fused pair's
+        // handler reads it as the following Instruction
+        if (cpu->fusion) {
+            if ((uint64_t)addr + 7 < cpu->inst_mem_size) {
+                if (!cpu->decoded_valid[slot + 1]) {
+                    decode_slot(cpu, slot + 1);
+                }
+                fuse_instructions(&cpu->decoded[slot], &cpu->decoded[slot + 1]);
+            }
+            cpu->decoded_valid[slot] = DECODED_FUSED;
+        }
+    }
+    return &cpu->decoded[slot];
+}
+
+// Drop predecoded entries overlapping [start, start + length)
+void cpu_invalidate_decoded(CPU *cpu, uint32_t start, uint32_t length) {
+    if (length == 0 || start >= cpu->inst_mem_size) {
+        return;
+    }
+    
+    uint64_t end = (uint64_t)start + length;
+    if (end > cpu->inst_mem_size) {
+        end = cpu->inst_mem_size;
+    }
+    
+    // The slot before may be fused with the first one dropped
+    uint32_t first = start >> 2;
+    uint32_t last = (uint32_t)((end + 3) >> 2);
+    if (first > 0) {
+        first--;
+    }
+    memset(cpu->decoded_valid + first, 0, last - first);
+    cpu->code_generation++;
+    
+    // Every host write to instruction memory comes through here, so this
+    // is where pages are marked for the next snapshot restore
+    if (cpu->inst_dirty) {
+        for (uint64_t page = start >> MEM_PAGE_SHIFT; page <= (end - 1) >> MEM_PAGE_SHIFT; page++) {
+            cpu->inst_dirty[page] = 1;
+        }
+    }
+}
+
+// Plant a breakpoint in the predecode cache: the slot decodes as EBREAK,
+// so execution pays nothing until it gets there. Returns -1 if addr is
+// not a word-aligned instruction address.
+int cpu_set_breakpoint(CPU *cpu, uint32_t addr) {
+    if ((uint64_t)addr + 3 >= cpu->inst_mem_size || addr % 4 != 0) {
+        return -1;
+    }
+    if (!cpu->breakpoints) {
+        cpu->breakpoints = calloc(cpu->inst_mem_size / 4 + 1, 1);
+        if (!cpu->breakpoints) {
+            return -1;
+        }
+    }
+    
+    uint32_t slot = addr >> 2;
+    cpu->breakpoints[slot] = 1;
+    
+    // Re-decode the slot, and the one before in case it was fused with it
+    cpu->decoded_valid[slot] = 0;
+    if (slot > 0) {
+        cpu->decoded_valid[slot - 1] = 0;
+    }
+    cpu->code_generation++;
+    return 0;
+}
+
+int cpu_clear_breakpoint(CPU *cpu, uint32_t addr) {
+    if (!cpu_has_breakpoint(cpu, addr)) {
+        return -1;
+    }
+    
+    uint32_t slot = addr >> 2;
+    cpu->breakpoints[slot] = 0;
+    cpu->decoded_valid[slot] = 0;
+    if (slot > 0) {
+        cpu->decoded_valid[slot - 1] = 0;
+    }
+    cpu->code_generation++;
+    return 0;
+}
+
+int cpu_has_breakpoint(CPU *cpu, uint32_t addr) {
+    return cpu->breakpoints && (uint64_t)addr + 3 < cpu->inst_mem_size && addr % 4 == 0 &&
+           cpu->breakpoints[addr >> 2];
+}
+
+// Turn pair fusion in the predecoder on or off, dropping every slot
+// decoded under the old setting
+void cpu_set_fusion(CPU *cpu, int enabled) {
+    cpu->fusion = enabled != 0;
+    memset(cpu->decoded_valid, 0, cpu->inst_mem_size / 4 + 1);
+    cpu->code_generation++;
+}
+
+uint64_t cpu_get_fusion_hits(CPU *cpu, Fusion fusion) {
+    if (fusion < 0 || fusion >= FUSE_COUNT) {
+        return 0;
+    }
+    return cpu->fusion_hits[fusion];
+}
+
 // Load program into instruction memory
 void cpu_load_inst_program(CPU *cpu, uint32_t *program, int count) {
-    for (i = 0; i < count; i++) {
+    for (int i = 0; i < count; i++) {
         uint32_t addr = i * 4;
         if (addr + 3 < cpu->inst_mem_size) {
             cpu->inst_memory[addr] = program[i] & 0xFF;
@@ -199,6 +538,7 @@ void cpu_load_inst_program(CPU *cpu, uint32_t *program, int count) {
             cpu->inst_memory[addr + 3] = (program[i] >> 24) & 0xFF;
         }
     }
+    cpu_invalidate_decoded(cpu, 0, (uint32_t)count * 4);
     cpu->pc = 0;
 }
 
@@ -222,6 +562,7 @@ int cpu_load_inst_binary(CPU *cpu, const char *filename) {
     
     size_t read = fread(cpu->inst_memory, 1, size, file);
     fclose(file);
+    cpu_invalidate_decoded(cpu, 0, (uint32_t)read);
     
     if (read != size) {
         printf("Failed to read entire file\n");
@@ -236,7 +577,7 @@ int cpu_load_inst_binary(CPU *cpu, const char *filename) {
 // Dump registers
 void cpu_dump_registers(CPU *cpu) {
     printf("\n=== Register Dump ===\n");
-    for (i = 0; i < 32; i += 4) {
+    for (int i = 0; i < 32; i += 4) {
         printf("x%-2d: %08x  x%-2d: %08x  x%-2d: %08x  x%-2d: %08x\n",
                i, cpu_get_reg(cpu, i),
                i+1, cpu_get_reg(cpu, i+1),
@@ -248,6 +589,19 @@ void cpu_dump_registers(CPU *cpu) {
     printf("===================\n\n");
 }
 
+// Profile report for the attached profile, top 10 entries per table
+void cpu_dump_profile(CPU *cpu, int json) {
+    if (!cpu->profile) {
+        printf("No profile attached\n");
+        return;
+    }
+    if (json) {
+        profile_report_json(cpu->profile, NULL, 10);
+    } else {
+        profile_report_text(cpu->profile, NULL, 10);
+    }
+}
+
 // Dump instruction memory
 void cpu_dump_inst_memory(CPU *cpu, uint32_t start, uint32_t length) {
     printf("\n=== Instruction Memory Dump [0x%08x - 0x%08x] ===\n", 
@@ -296,7 +650,8 @@ void cpu_dump_inst_memory(CPU *cpu, uint32_t start, uint32_t length) {
 // Register operations
 uint32_t cpu_get_reg(CPU *cpu, int reg) {
     if (reg < 0 || reg >= 32) {
-        printf("Invalid register: %d\n", reg);
+        TRACE_ERROR("Invalid register: %d\n", reg);
+        cpu_raise(cpu, CPU_ERR_INVALID_REGISTER, (uint32_t)reg);
         return 0;
     }
     if (reg == 0) {
@@ -307,7 +662,8 @@ uint32_t cpu_get_reg(CPU *cpu, int reg) {
 
 void cpu_set_reg(CPU *cpu, int reg, uint32_t value) {
     if (reg < 0 || reg >= 32) {
-        printf("Invalid register: %d\n", reg);
+        TRACE_ERROR("Invalid register: %d\n", reg);
+        cpu_raise(cpu, CPU_ERR_INVALID_REGISTER, (uint32_t)reg);
         return;
     }
     if (reg != 0) {
@@ -337,36 +693,144 @@ uint64_t cpu_get_instruction_count(CPU *cpu) {
     return cpu->instruction_count;
 }
 
+// Record an error and halt. The first error raised is kept.
+void cpu_raise(CPU *cpu, CpuError error, uint32_t addr) {
+    if (cpu->error == CPU_OK) {
+        cpu->error = error;
+        cpu->error_addr = addr;
+    }
+    cpu->halted = 1;
+}
+
+CpuError cpu_get_error(CPU *cpu) {
+    return cpu->error;
+}
+
+uint32_t cpu_get_error_addr(CPU *cpu) {
+    return cpu->error_addr;
+}
+
+const char *cpu_error_string(CpuError error) {
+    switch (error) {
+        case CPU_OK:                            return "no error";
+        case CPU_ERR_INST_OUT_OF_BOUNDS:        return "instruction memory read out of bounds";
+        case CPU_ERR_INST_MISALIGNED:           return "misaligned instruction read";
+        case CPU_ERR_DATA_READ_OUT_OF_BOUNDS:   return "data memory read out of bounds";
+        case CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS:  return "data memory write out of bounds";
+        case CPU_ERR_DATA_MISALIGNED:           return "misaligned data access";
+        case CPU_ERR_PC_OUT_OF_BOUNDS:          return "PC out of instruction memory bounds";
+        case CPU_ERR_ILLEGAL_INSTRUCTION:       return "illegal instruction";
+        case CPU_ERR_INVALID_REGISTER:          return "invalid register";
+    }
+    return "unknown error";
+}
+
 // Execute one instruction
 void cpu_step(CPU *cpu) {
+    cpu_run_budget(cpu, 1, NULL);
+}
+
+// Run until the CPU stops
+void cpu_run(CPU *cpu) {
+    cpu_run_budget(cpu, UINT64_MAX, NULL);
+}
+
+Instruction *cpu_step_reference(CPU *cpu) {
     if (cpu->halted) {
-        return;
+        return NULL;
+    }
+    Instruction *inst = cpu_fetch_decoded(cpu);
+    if (!inst) {
+        return NULL;
+    }
+    if (inst->op == OP_HALT) {
+        cpu->halted = 1;
+        return NULL;
     }
     
-    uint32_t inst = cpu_fetch_instruction(cpu);
+    execute_instruction(cpu, inst);
+    if (cpu->halted) {
+        return NULL;    // Faulted or exited; the instruction did not retire
+    }
+    cpu->instruction_count++;
+    return inst;
+}
+
+// Reference interpreter loop: the only checks besides the budget are the
+// ones that end the run
+uint64_t cpu_run_reference(CPU *cpu, uint64_t max_instructions) {
+    uint64_t executed = 0;
     
-    if (inst == 0x00000000) {
-        cpu->halted = 1;
-        return;
+    while (executed < max_instructions && cpu_step_reference(cpu)) {
+        executed++;
+    }
+    return executed;
+}
+
+CpuExitReason cpu_exit_reason(CPU *cpu) {
+    if (!cpu->halted) {
+        return CPU_EXIT_BUDGET;
+    }
+    if (cpu->breakpoint) {
+        return CPU_EXIT_BREAKPOINT;
+    }
+    if (cpu->error == CPU_OK) {
+        return CPU_EXIT_HALT;
     }
+    if (cpu->error == CPU_ERR_ILLEGAL_INSTRUCTION || cpu->error == CPU_ERR_INVALID_REGISTER) {
+        return CPU_EXIT_ILLEGAL;
+    }
+    return CPU_EXIT_MEMORY_FAULT;
+}
+
+CpuExitReason cpu_run_budget(CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info) {
+    uint64_t executed = 0;
     
+    if (cpu->breakpoint) {
+        cpu->breakpoint = 0;
+        cpu->halted = 0;
+    }
     
-    printf("PC: 0x%08x, Instruction: 0x%08x\n", cpu->pc, inst);
+    if (!cpu->halted) {
+        if (cpu->trace || cpu->caches || trace_get_verbosity() >= TRACE_LEVEL_INST) {
+            executed = cpu_run_reference(cpu, max_instructions);
+        } else {
+            executed = execute_threaded(cpu, max_instructions);
+        }
+    }
     
-    cpu->pc += 4;
-    cpu->instruction_count++;
+    CpuExitReason reason = cpu_exit_reason(cpu);
+    if (exit_info) {
+        exit_info->reason = reason;
+        exit_info->executed = executed;
+        exit_info->pc = cpu->pc;
+        exit_info->error = cpu->error;
+        exit_info->addr = cpu->error_addr;
+    }
+    return reason;
 }
 
-// Run until halt
-void cpu_run(CPU *cpu) {
-    while (!cpu->halted) {
-        cpu_step(cpu);
-        
-        if (cpu->pc >= cpu->inst_mem_size) {
-            printf("PC out of instruction memory bounds: 0x%08x\n", cpu->pc);
-            cpu->halted = 1;
-        }
+int cpu_enable_state_hash(CPU *cpu) {
+    if (cpu->guard_data) {
+        printf("State hashing needs paged data memory, not guard-page mode\n");
+        return -1;
     }
+    cpu->state_hash = paged_state_hash(&cpu->data_memory);
+    cpu->state_hashing = 1;
+    return 0;
+}
+
+// Memory comes from the incremental hash; the registers and run state are
+// small enough to hash in full each time
+uint64_t cpu_state_hash(CPU *cpu) {
+    uint64_t hash = cpu->state_hash;
     
-    printf("\nCPU halted after %llu instructions\n", cpu->instruction_count);
+    for (int r = 1; r < 32; r++) {
+        hash = (hash ^ cpu->regs[r]) * FNV_PRIME;
+    }
+    hash = (hash ^ cpu->pc) * FNV_PRIME;
+    hash = (hash ^ (uint64_t)cpu->halted) * FNV_PRIME;
+    hash = (hash ^ (uint64_t)cpu->error) * FNV_PRIME;
+    hash = (hash ^ cpu->instruction_count) * FNV_PRIME;
+    return hash;
 }
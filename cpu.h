@@ -2,23 +2,92 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "decode.h"
+#include "memory.h"
+
+struct TraceBuffer;
+struct Profile;
+struct CacheHierarchy;
+struct Recording;
+struct MmioBus;
+struct Syscalls;
+
+// Predecode slot states
+#define DECODED_VALID 1             // Decoded
+#define DECODED_FUSED 2             // Decoded and checked for fusion with the next slot
+
+// Data memory size that spans the whole 32-bit address space
+#define CPU_DATA_MEM_FULL ((uint64_t)1 << 32)
+
+// Why the CPU stopped, if it stopped on an error
+typedef enum {
+    CPU_OK,
+    CPU_ERR_INST_OUT_OF_BOUNDS,         // Instruction fetch outside memory
+    CPU_ERR_INST_MISALIGNED,            // Instruction fetch not word aligned
+    CPU_ERR_DATA_READ_OUT_OF_BOUNDS,    // Data read outside memory
+    CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS,   // Data write outside memory
+    CPU_ERR_DATA_MISALIGNED,            // Data access not naturally aligned
+    CPU_ERR_PC_OUT_OF_BOUNDS,           // PC ran off the end of memory
+    CPU_ERR_ILLEGAL_INSTRUCTION,        // Unknown opcode or function code
+    CPU_ERR_INVALID_REGISTER            // Register index outside x0-x31
+} CpuError;
+
+// Why cpu_run_budget() returned
+typedef enum {
+    CPU_EXIT_HALT,              // Reached the halt sentinel
+    CPU_EXIT_BUDGET,            // Ran the whole instruction budget
+    CPU_EXIT_ILLEGAL,           // Illegal instruction or register
+    CPU_EXIT_MEMORY_FAULT,      // Fetch, PC or data access fault
+    CPU_EXIT_BREAKPOINT         // EBREAK, with the PC left on it
+} CpuExitReason;
+
+typedef struct {
+    CpuExitReason reason;
+    uint64_t executed;              // Instructions retired by this call
+    uint32_t pc;                    // PC when the call returned
+    CpuError error;                 // Error behind ILLEGAL and MEMORY_FAULT, else CPU_OK
+    uint32_t addr;                  // Address (or register) the error refers to
+} CpuExitInfo;
 
 typedef struct {
     uint32_t regs[32];              // x0-x31 registers
     uint32_t pc;                    // Program counter
     uint8_t *inst_memory;           // Instruction memory
-    uint8_t *data_memory;           // Data memory
+    PagedMemory data_memory;        // Data memory, sparse 4 KiB pages
+    uint8_t *guard_data;            // Flat data memory in guard-page mode, NULL otherwise
+    int guard_inst;                 // Instruction memory sits in a guard-page reservation
+    Instruction *decoded;           // Predecoded instruction per 4-byte slot
+    uint8_t *decoded_valid;         // Slot state since last load: 0, DECODED_VALID or DECODED_FUSED
+    uint8_t *breakpoints;           // Slots that decode as EBREAK, NULL if none were set
+    uint32_t code_generation;       // Bumped whenever instruction memory changes
     unsigned int inst_mem_size;     // Instruction memory size
-    unsigned int data_mem_size;     // Data memory size
+    uint64_t data_mem_size;         // Data memory size (up to CPU_DATA_MEM_FULL)
     int halted;                     // CPU halt flag
+    int breakpoint;                 // Halted on EBREAK; cleared when execution resumes
+    CpuError error;                 // First error raised, CPU_OK if none
+    uint32_t error_addr;            // Address (or register) the error refers to
     uint64_t instruction_count;     // Instructions executed
+    struct TraceBuffer *trace;      // Binary execution trace, NULL when off
+    struct Profile *profile;        // Execution profile, NULL when off
+    struct CacheHierarchy *caches;  // Cache simulator, NULL when off
+    struct Recording *recording;    // Record/replay session, NULL when off
+    struct MmioBus *bus;            // Devices on data pages without RAM, NULL if none
+    struct Syscalls *syscalls;      // Linux syscall emulation for ECALL, NULL when off
+    int fusion;                     // Predecoder fuses instruction pairs (threaded core)
+    uint64_t fusion_hits[FUSE_COUNT];   // Fused pairs executed, per idiom
+    uint8_t *inst_dirty;            // Instruction pages written since the snapshot, NULL if none
+    uint32_t snapshot_epoch;        // Identifies the CPU's current snapshot
+    int state_hashing;              // Data writes keep state_hash up to date
+    uint64_t state_hash;            // paged_state_hash() of data memory while state_hashing
 } CPU;
 
 // Core CPU functions
-void cpu_init(CPU *cpu, unsigned int inst_mem_size, unsigned int data_mem_size);
+void cpu_init(CPU *cpu, unsigned int inst_mem_size, uint64_t data_mem_size);
 void cpu_destroy(CPU *cpu);
 void cpu_reset(CPU *cpu);
+size_t cpu_memory_mapped_size(unsigned int size);
 
 // Register operations
 uint32_t cpu_get_reg(CPU *cpu, int reg);
@@ -35,15 +104,50 @@ void cpu_write_data_byte(CPU *cpu, uint32_t addr, uint8_t value);
 
 // Execution functions
 uint32_t cpu_fetch_instruction(CPU *cpu);
+Instruction *cpu_fetch_decoded(CPU *cpu);
+Instruction *cpu_decode_at(CPU *cpu, uint32_t addr);
+void cpu_invalidate_decoded(CPU *cpu, uint32_t start, uint32_t length);
+void cpu_set_fusion(CPU *cpu, int enabled);
+int cpu_set_breakpoint(CPU *cpu, uint32_t addr);
+int cpu_clear_breakpoint(CPU *cpu, uint32_t addr);
+int cpu_has_breakpoint(CPU *cpu, uint32_t addr);
+uint64_t cpu_get_fusion_hits(CPU *cpu, Fusion fusion);
 void cpu_step(CPU *cpu);
 void cpu_run(CPU *cpu);
 
+// Run up to max_instructions and say why execution stopped. exit_info may
+// be NULL. The threaded core is used unless a binary trace, cache
+// simulator or per-instruction tracing needs the reference interpreter.
+// A CPU stopped on a breakpoint resumes at the EBREAK, so hosts move the
+// PC past it (or remove it) first. In guard mode, call under guard_arm().
+CpuExitReason cpu_run_budget(CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info);
+
+// The reference interpreter, which the other engines and the checkers
+// are measured against. cpu_step_reference() fetches, decodes and executes
+// the instruction at the PC and returns it if it retired, or NULL if the
+// CPU stopped instead. cpu_run_reference() steps until the CPU stops or
+// max_instructions retire, and returns how many did.
+Instruction *cpu_step_reference(CPU *cpu);
+uint64_t cpu_run_reference(CPU *cpu, uint64_t max_instructions);
+
+// Why a run that has just returned stopped, from the halt and error state
+CpuExitReason cpu_exit_reason(CPU *cpu);
+
+// Incremental state hashing for differential checks. Once enabled, every
+// data write through the cpu_write_data_* accessors updates state_hash
+// from the old and new word, so cpu_state_hash() costs a pass over the
+// register file rather than a walk of memory. Host-side writes (loaders,
+// paged_write) are not tracked: enable again after them. Needs paged memory.
+int cpu_enable_state_hash(CPU *cpu);
+uint64_t cpu_state_hash(CPU *cpu);
+
 // Program loading
 void cpu_load_inst_program(CPU *cpu, uint32_t *program, int count);
 int cpu_load_inst_binary(CPU *cpu, const char *filename);
 
 // Debugging functions
 void cpu_dump_registers(CPU *cpu);
+void cpu_dump_profile(CPU *cpu, int json);
 void cpu_dump_inst_memory(CPU *cpu, uint32_t start, uint32_t length);
 void cpu_dump_data_memory(CPU *cpu, uint32_t start, uint32_t length);
 
@@ -56,4 +160,10 @@ int cpu_should_halt(CPU *cpu);
 void cpu_halt(CPU *cpu);
 uint64_t cpu_get_instruction_count(CPU *cpu);
 
+// Error reporting
+void cpu_raise(CPU *cpu, CpuError error, uint32_t addr);
+CpuError cpu_get_error(CPU *cpu);
+uint32_t cpu_get_error_addr(CPU *cpu);
+const char *cpu_error_string(CpuError error);
+
 #endif
\ No newline at end of file
@@ -1,6 +1,6 @@
 // decode.c
 #include "decode.h"
-#include <stdio.h>
+#include "trace.h"
 
 // Extract opcode (bits [6:0])
 uint32_t extract_opcode(uint32_t inst) {
@@ -42,13 +42,73 @@ InstructionType get_instruction_type(uint32_t opcode) {
     }
 }
 
+// Resolve decoded fields to a concrete operation
+Operation get_operation(const Instruction *inst) {
+    if (inst->raw == 0x00000000) {
+        return OP_HALT;
+    }
+    if (inst->raw == INST_EBREAK) {
+        return OP_EBREAK;
+    }
+    if (inst->raw == INST_ECALL) {
+        return OP_ECALL;
+    }
+    if (inst->type != R_TYPE) {
+        return OP_ILLEGAL;
+    }
+    
+    switch (inst->funct3) {
+        case 0x0:
+            if (inst->funct7 == 0x00) return OP_ADD;
+            if (inst->funct7 == 0x20) return OP_SUB;
+            return OP_ILLEGAL;
+        case 0x1: return OP_SLL;
+        case 0x2: return OP_SLT;
+        case 0x3: return OP_SLTU;
+        case 0x4: return OP_XOR;
+        case 0x5:
+            if (inst->funct7 == 0x00) return OP_SRL;
+            if (inst->funct7 == 0x20) return OP_SRA;
+            return OP_ILLEGAL;
+        case 0x6: return OP_OR;
+        case 0x7: return OP_AND;
+        default:  return OP_ILLEGAL;
+    }
+}
+
+// Mnemonic for an operation
+const char *get_operation_name(Operation op) {
+    static const char *names[OP_COUNT] = {
+        [OP_ILLEGAL] = "illegal",
+        [OP_HALT]    = "halt",
+        [OP_EBREAK]  = "ebreak",
+        [OP_ECALL]   = "ecall",
+        [OP_ADD]     = "add",
+        [OP_SUB]     = "sub",
+        [OP_SLL]     = "sll",
+        [OP_SLT]     = "slt",
+        [OP_SLTU]    = "sltu",
+        [OP_XOR]     = "xor",
+        [OP_SRL]     = "srl",
+        [OP_SRA]     = "sra",
+        [OP_OR]      = "or",
+        [OP_AND]     = "and",
+    };
+    
+    if (op < 0 || op >= OP_COUNT) {
+        return "illegal";
+    }
+    return names[op];
+}
+
 // Main decode function - R-type only
 void decode_instruction(uint32_t raw_inst, Instruction *inst) {
     // Extract opcode first
     inst->opcode = extract_opcode(raw_inst);
+    inst->raw = raw_inst;
     
     // Debug print to verify extraction
-    printf("Decoding instruction: 0x%08x\n", raw_inst);
+    TRACE_INST("Decoding instruction: 0x%08x\n", raw_inst);
     
     // Determine instruction type
     inst->type = get_instruction_type(inst->opcode);
@@ -63,10 +123,11 @@ void decode_instruction(uint32_t raw_inst, Instruction *inst) {
         inst->imm = 0;  // R-type has no immediate
         
         // Debug print to verify all fields
-        printf("  Opcode: 0x%02x (R-type)\n", inst->opcode);
-        printf("  rd: x%d, rs1: x%d, rs2: x%d\n", inst->rd, inst->rs1, inst->rs2);
-        printf("  funct3: 0x%x, funct7: 0x%02x\n", inst->funct3, inst->funct7);
+        TRACE_INST("  Opcode: 0x%02x (R-type)\n", inst->opcode);
+        TRACE_INST("  rd: x%d, rs1: x%d, rs2: x%d\n", inst->rd, inst->rs1, inst->rs2);
+        TRACE_INST("  funct3: 0x%x, funct7: 0x%02x\n", inst->funct3, inst->funct7);
         
+#if TRACE_LEVEL >= TRACE_LEVEL_INST
         // Verify the instruction encoding
         uint32_t reconstructed = (inst->funct7 << 25) | 
                                 (inst->rs2 << 20) | 
@@ -76,9 +137,10 @@ void decode_instruction(uint32_t raw_inst, Instruction *inst) {
                                 inst->opcode;
         
         if (reconstructed != raw_inst) {
-            printf("  ERROR: Instruction reconstruction failed!\n");
-            printf("  Original: 0x%08x, Reconstructed: 0x%08x\n", raw_inst, reconstructed);
+            TRACE_INST("  ERROR: Instruction reconstruction failed!\n");
+            TRACE_INST("  Original: 0x%08x, Reconstructed: 0x%08x\n", raw_inst, reconstructed);
         }
+#endif
     } else {
         // Zero out all fields for non-R-type instruction
         inst->rd = 0;
@@ -88,6 +150,49 @@ void decode_instruction(uint32_t raw_inst, Instruction *inst) {
         inst->funct7 = 0;
         inst->imm = 0;
         
-        printf("  ERROR: Not an R-type instruction (opcode: 0x%02x)\n", inst->opcode);
+        TRACE_INST("  ERROR: Not an R-type instruction (opcode: 0x%02x)\n", inst->opcode);
+    }
+    
+    inst->op = get_operation(inst);
+    inst->negate = inst->op == OP_SUB ? 0xFFFFFFFFu : 0;
+    inst->fusion = FUSE_NONE;
+    inst->dispatch = inst->op;
+}
+
+// Second instruction reads the first one's result
+static int depends_on(const Instruction *first, const Instruction *second) {
+    return first->rd != 0 && (second->rs1 == first->rd || second->rs2 == first->rd);
+}
+
+// Fusion stage, run on adjacent predecoded instructions
+void fuse_instructions(Instruction *first, const Instruction *second) {
+    Fusion fusion = FUSE_NONE;
+    
+    if ((first->op == OP_ADD || first->op == OP_SUB) &&
+        (second->op == OP_ADD || second->op == OP_SUB) && depends_on(first, second)) {
+        fusion = FUSE_ADDSUB;
+    } else if (first->op == OP_SLL && second->op == OP_SRL &&
+               first->rd != 0 && second->rs1 == first->rd) {
+        fusion = FUSE_SHIFT;
+    } else if (first->op == OP_SLTU && second->op == OP_ADD && depends_on(first, second)) {
+        fusion = FUSE_CARRY;
+    }
+    
+    first->fusion = fusion;
+    first->dispatch = fusion == FUSE_NONE ? (uint32_t)first->op : (uint32_t)(OP_COUNT + fusion);
+}
+
+// Name of a fused idiom
+const char *get_fusion_name(Fusion fusion) {
+    static const char *names[FUSE_COUNT] = {
+        [FUSE_NONE]   = "none",
+        [FUSE_ADDSUB] = "add/sub chain",
+        [FUSE_SHIFT]  = "sll+srl extract",
+        [FUSE_CARRY]  = "sltu+add carry",
+    };
+    
+    if (fusion < 0 || fusion >= FUSE_COUNT) {
+        return "none";
     }
+    return names[fusion];
 }
\ No newline at end of file
@@ -10,6 +10,39 @@ typedef enum {
     UNKNOWN_TYPE
 } InstructionType;
 
+// EBREAK encoding, also planted by debuggers
+#define INST_EBREAK 0x00100073
+#define INST_ECALL  0x00000073
+
+// Concrete operations, resolved once at decode time
+typedef enum {
+    OP_ILLEGAL,
+    OP_HALT,        // 0x00000000 sentinel word
+    OP_EBREAK,      // Breakpoint: stops the CPU with the PC left on it
+    OP_ECALL,       // Environment call: a Linux syscall when emulation is attached
+    OP_ADD,
+    OP_SUB,
+    OP_SLL,
+    OP_SLT,
+    OP_SLTU,
+    OP_XOR,
+    OP_SRL,
+    OP_SRA,
+    OP_OR,
+    OP_AND,
+    OP_COUNT
+} Operation;
+
+// Idioms the predecoder fuses with the instruction that follows, so the
+// threaded core runs both in one dispatch
+typedef enum {
+    FUSE_NONE,
+    FUSE_ADDSUB,    // add/sub feeding a dependent add/sub (arithmetic chains)
+    FUSE_SHIFT,     // sll then srl of the result (zero-extension, field extract)
+    FUSE_CARRY,     // sltu then add of the flag (multiword carry propagation)
+    FUSE_COUNT
+} Fusion;
+
 // Decoded instruction structure
 typedef struct {
     uint32_t opcode;        // Operation code
@@ -20,6 +53,11 @@ typedef struct {
     uint32_t funct7;        // Function code extension
     int32_t imm;            // Immediate value (not used for R-type)
     InstructionType type;   // Instruction format type
+    uint32_t raw;           // Original instruction word
+    Operation op;           // Concrete operation for fast dispatch
+    uint32_t negate;        // All ones for SUB: ADD/SUB is rs1 + (rs2 ^ negate) - negate
+    Fusion fusion;          // Idiom this instruction starts with the next one
+    uint32_t dispatch;      // Threaded-core handler: op, or OP_COUNT + fusion
 } Instruction;
 
 // Main decoding function
@@ -35,5 +73,11 @@ uint32_t extract_funct7(uint32_t inst);
 
 // Helper functions
 InstructionType get_instruction_type(uint32_t opcode);
+Operation get_operation(const Instruction *inst);
+const char *get_operation_name(Operation op);
+
+// Fusion stage: mark first as starting an idiom with second, if they form one
+void fuse_instructions(Instruction *first, const Instruction *second);
+const char *get_fusion_name(Fusion fusion);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,200 @@
+// diffcheck.c
+#include "diffcheck.h"
+#include "block.h"
+#include "snapshot.h"
+#include "threaded.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *engine_names[DIFF_ENGINE_COUNT] = {
+    "reference", "threaded", "block", "jit"
+};
+
+// One CPU and the engine running it
+typedef struct {
+    CPU *cpu;
+    DiffEngine engine;
+    BlockCache blocks;
+    CpuSnapshot snapshot;       // State at the last agreeing check
+} DiffSide;
+
+DiffEngine diffcheck_engine_from_name(const char *name) {
+    for (int engine = 0; engine < DIFF_ENGINE_COUNT; engine++) {
+        if (strcmp(name, engine_names[engine]) == 0) {
+            return (DiffEngine)engine;
+        }
+    }
+    return DIFF_ENGINE_COUNT;
+}
+
+const char *diffcheck_engine_name(DiffEngine engine) {
+    return engine < DIFF_ENGINE_COUNT ? engine_names[engine] : "unknown";
+}
+
+static uint64_t run_side(DiffSide *side, uint64_t max_instructions) {
+    switch (side->engine) {
+        case DIFF_ENGINE_REFERENCE:
+            return cpu_run_reference(side->cpu, max_instructions);
+        case DIFF_ENGINE_THREADED:
+            return execute_threaded(side->cpu, max_instructions);
+        default:
+            return block_run(&side->blocks, side->cpu, max_instructions);
+    }
+}
+
+// Make the current state of both sides the one bisection restores to
+static int take_snapshots(DiffSide sides[2]) {
+    for (int s = 0; s < 2; s++) {
+        cpu_snapshot_free(sides[s].cpu, &sides[s].snapshot);
+        if (cpu_snapshot(sides[s].cpu, &sides[s].snapshot) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Restore both sides to the last snapshot and run them count instructions.
+// Returns non-zero if their states then agree.
+static int replay_agrees(DiffSide sides[2], uint64_t count) {
+    for (int s = 0; s < 2; s++) {
+        cpu_restore(sides[s].cpu, &sides[s].snapshot);
+        run_side(&sides[s], count);
+    }
+    return cpu_state_hash(sides[0].cpu) == cpu_state_hash(sides[1].cpu);
+}
+
+static void print_instruction(const DiffSide *side) {
+    CPU *cpu = side->cpu;
+    Instruction inst;
+    
+    if ((uint64_t)cpu->pc + 3 >= cpu->inst_mem_size || cpu->pc % 4 != 0) {
+        printf("  %-9s pc 0x%08x  (outside instruction memory)\n",
+               engine_names[side->engine], cpu->pc);
+        return;
+    }
+    
+    uint32_t raw;
+    memcpy(&raw, cpu->inst_memory + cpu->pc, 4);
+    decode_instruction(raw, &inst);
+    printf("  %-9s pc 0x%08x  %08x  %s x%u, x%u, x%u\n", engine_names[side->engine],
+           cpu->pc, raw, get_operation_name(get_operation(&inst)), inst.rd, inst.rs1, inst.rs2);
+}
+
+// Print every part of the two states, marking the parts that differ
+static void print_states(DiffSide sides[2]) {
+    CPU *a = sides[0].cpu;
+    CPU *b = sides[1].cpu;
+    
+    printf("  %-9s %-10s %-10s\n", "", engine_names[sides[0].engine], engine_names[sides[1].engine]);
+    for (int r = 1; r < 32; r++) {
+        printf("  x%-8d %08x   %08x   %s\n", r, a->regs[r], b->regs[r],
+               a->regs[r] != b->regs[r] ? "*" : "");
+    }
+    printf("  %-9s %08x   %08x   %s\n", "pc", a->pc, b->pc, a->pc != b->pc ? "*" : "");
+    printf("  %-9s %-10d %-10d %s\n", "halted", a->halted, b->halted,
+           a->halted != b->halted ? "*" : "");
+    printf("  %-9s %-10d %-10d %s\n", "error", (int)a->error, (int)b->error,
+           a->error != b->error ? "*" : "");
+    printf("  %-9s %-10llu %-10llu %s\n", "retired", (unsigned long long)a->instruction_count,
+           (unsigned long long)b->instruction_count,
+           a->instruction_count != b->instruction_count ? "*" : "");
+    printf("  %-9s %016llx %016llx %s\n", "memory", (unsigned long long)a->state_hash,
+           (unsigned long long)b->state_hash, a->state_hash != b->state_hash ? "*" : "");
+}
+
+// The sides agree at the snapshot and differ after length instructions:
+// narrow that down to the first instruction whose results differ
+static void bisect(DiffSide sides[2], uint64_t base, uint64_t length, DiffReport *report) {
+    uint64_t agree = 0;
+    uint64_t differ = length;
+    
+    while (differ - agree > 1) {
+        uint64_t mid = agree + (differ - agree) / 2;
+        if (replay_agrees(sides, mid)) {
+            agree = mid;
+        } else {
+            differ = mid;
+        }
+    }
+    
+    replay_agrees(sides, agree);
+    report->diverged = 1;
+    report->executed = base + agree;
+    report->divergence = sides[0].cpu->instruction_count + 1;
+    report->divergence_pc = sides[0].cpu->pc;
+    
+    printf("Engines diverge at instruction %llu:\n", (unsigned long long)report->divergence);
+    print_instruction(&sides[0]);
+    if (sides[1].cpu->pc != sides[0].cpu->pc) {
+        print_instruction(&sides[1]);
+    }
+    
+    // The state both engines leave after that instruction
+    for (int s = 0; s < 2; s++) {
+        run_side(&sides[s], 1);
+    }
+    print_states(sides);
+}
+
+int diffcheck_run(CPU *a, DiffEngine engine_a, CPU *b, DiffEngine engine_b,
+                  uint64_t interval, uint64_t max_instructions, DiffReport *report) {
+    DiffSide sides[2];
+    int status = 0;
+    
+    memset(report, 0, sizeof(*report));
+    memset(sides, 0, sizeof(sides));
+    sides[0].cpu = a;
+    sides[0].engine = engine_a;
+    sides[1].cpu = b;
+    sides[1].engine = engine_b;
+    if (interval == 0) {
+        interval = DIFFCHECK_DEFAULT_INTERVAL;
+    }
+    
+    for (int s = 0; s < 2; s++) {
+        block_cache_init(&sides[s].blocks);
+        if (sides[s].engine == DIFF_ENGINE_JIT &&
+            block_cache_enable_jit(&sides[s].blocks, BLOCK_JIT_DEFAULT_THRESHOLD) != 0) {
+            printf("No JIT on this host; the jit engine runs interpreted blocks\n");
+        }
+    }
+    
+    if (cpu_enable_state_hash(a) != 0 || cpu_enable_state_hash(b) != 0 ||
+        take_snapshots(sides) != 0) {
+        status = -1;
+    }
+    
+    while (status == 0 && report->executed < max_instructions) {
+        uint64_t length = max_instructions - report->executed;
+        if (length > interval) {
+            length = interval;
+        }
+        
+        run_side(&sides[0], length);
+        run_side(&sides[1], length);
+        report->checks++;
+        
+        if (cpu_state_hash(a) != cpu_state_hash(b)) {
+            bisect(sides, report->executed, length, report);
+            status = 1;
+            break;
+        }
+        
+        // Equal hashes include equal instruction counts, so a's count serves for both
+        uint64_t ran = a->instruction_count - sides[0].snapshot.instruction_count;
+        report->executed += ran;
+        if (a->halted || ran == 0) {
+            break;
+        }
+        if (take_snapshots(sides) != 0) {
+            status = -1;
+        }
+    }
+    
+    for (int s = 0; s < 2; s++) {
+        cpu_snapshot_free(sides[s].cpu, &sides[s].snapshot);
+        block_cache_destroy(&sides[s].blocks);
+        sides[s].cpu->state_hashing = 0;
+    }
+    return status;
+}
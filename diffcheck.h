@@ -0,0 +1,43 @@
+// diffcheck.h
+#ifndef DIFFCHECK_H
+#define DIFFCHECK_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define DIFFCHECK_DEFAULT_INTERVAL 100000   // Instructions between hash comparisons
+
+// Engines a differential check can run
+typedef enum {
+    DIFF_ENGINE_REFERENCE,      // execute_instruction loop
+    DIFF_ENGINE_THREADED,       // execute_threaded, fused if cpu->fusion is set
+    DIFF_ENGINE_BLOCK,          // Block cache, interpreted
+    DIFF_ENGINE_JIT,            // Block cache with native code
+    DIFF_ENGINE_COUNT
+} DiffEngine;
+
+typedef struct {
+    uint64_t executed;          // Instructions on which the engines agreed
+    uint64_t checks;            // Hash comparisons made
+    int diverged;
+    uint64_t divergence;        // First instruction whose results differ, numbered by
+                                // the instruction_count it brings the CPU to
+    uint32_t divergence_pc;     // Its PC on the first engine
+} DiffReport;
+
+// DIFF_ENGINE_COUNT if the name is unknown
+DiffEngine diffcheck_engine_from_name(const char *name);
+const char *diffcheck_engine_name(DiffEngine engine);
+
+// Run a on engine_a and b on engine_b side by side for up to
+// max_instructions, or until both halt. a and b must hold the same
+// program and state, and use paged memory without a snapshot of their own
+// (the checker takes one per interval). Each CPU keeps an incremental
+// state hash, and the two are compared every interval instructions. On a
+// mismatch, the interval is bisected with snapshot restores down to the
+// first instruction whose results differ, and both states are printed.
+// Returns 0 if the engines agreed, 1 if they diverged, -1 on setup failure.
+int diffcheck_run(CPU *a, DiffEngine engine_a, CPU *b, DiffEngine engine_b,
+                  uint64_t interval, uint64_t max_instructions, DiffReport *report);
+
+#endif
@@ -0,0 +1,415 @@
+// elf.c
+#include "elf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EM_RISCV        243
+#define ET_EXEC         2
+#define PT_LOAD         1
+#define PF_X            1
+#define SHT_SYMTAB      2
+#define STT_OBJECT      1
+#define STT_FUNC        2
+
+#define EHDR_SIZE       52
+#define PHDR_SIZE       32
+#define SHDR_SIZE       40
+#define SYM_SIZE        16
+
+// ELF files are little-endian for RV32; fields are read byte by byte so
+// the loader does not depend on host struct layout.
+static uint16_t rd16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// End of the last page range written in a flat guest memory, so a segment
+// sharing a page with the previous one is copied rather than mapped over it
+typedef struct {
+    uint8_t *memory;
+    uint64_t size;
+    uint64_t touched_end;
+} LoadTarget;
+
+static int load_segment(LoadTarget *target, int fd, const uint8_t *file, size_t file_size,
+                        uint32_t vaddr, uint32_t offset, uint32_t filesz, uint32_t memsz) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t file_end = (uint64_t)vaddr + filesz;
+    uint64_t mem_end = (uint64_t)vaddr + memsz;
+    
+    if (memsz == 0) {
+        return 0;
+    }
+    if (filesz > memsz || mem_end > target->size || (uint64_t)offset + filesz > file_size) {
+        printf("ELF segment at 0x%08x (%u bytes) does not fit guest memory\n", vaddr, memsz);
+        return -1;
+    }
+    
+    uint64_t pos = vaddr;
+    
+    // A page shared with the previous segment is filled by copying
+    if (pos < target->touched_end) {
+        uint64_t boundary = (pos + page) & ~(page - 1);
+        uint64_t copy_end = boundary < file_end ? boundary : file_end;
+        if (copy_end > pos) {
+            memcpy(target->memory + pos, file + offset + (pos - vaddr), copy_end - pos);
+        }
+        pos = boundary;
+    }
+    
+    if (pos < file_end) {
+        uint64_t start = pos & ~(page - 1);
+        uint64_t file_offset = offset + (pos - vaddr) - (pos - start);
+        
+        if ((vaddr % page) == (offset % page)) {
+            // Copy-on-write file pages, faulted in when the guest touches them
+            void *mapped = mmap(target->memory + start, file_end - start,
+                                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, (off_t)file_offset);
+            if (mapped == MAP_FAILED) {
+                printf("Failed to map ELF segment at 0x%08x\n", vaddr);
+                return -1;
+            }
+            
+            // File bytes outside the segment on its first and last page
+            memset(target->memory + start, 0, pos - start);
+            uint64_t tail_end = (file_end + page - 1) & ~(page - 1);
+            if (tail_end > target->size) {
+                tail_end = target->size;
+            }
+            memset(target->memory + file_end, 0, tail_end - file_end);
+        } else {
+            // Offsets not page-congruent with addresses: fall back to a copy
+            memcpy(target->memory + pos, file + offset + (pos - vaddr), file_end - pos);
+        }
+    }
+    
+    // .bss: whole pages become fresh anonymous zero pages, so nothing is
+    // touched until the guest uses them
+    uint64_t bss_page = (file_end + page - 1) & ~(page - 1);
+    if (bss_page < mem_end) {
+        uint64_t bss_end = (mem_end + page - 1) & ~(page - 1);
+        void *mapped = mmap(target->memory + bss_page, bss_end - bss_page, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (mapped == MAP_FAILED) {
+            printf("Failed to map .bss at 0x%08x\n", (uint32_t)bss_page);
+            return -1;
+        }
+    }
+    
+    uint64_t end = (mem_end + page - 1) & ~(page - 1);
+    if (end > target->touched_end) {
+        target->touched_end = end;
+    }
+    return 0;
+}
+
+// Data segments go into sparse paged memory. Whole file-backed pages are
+// mapped copy-on-write and installed as guest pages directly; partial pages
+// at either end are copied, and .bss needs nothing since untouched pages
+// already read as zero.
+static int load_paged_segment(PagedMemory *memory, uint64_t size, uint64_t *touched_end, int fd,
+                              const uint8_t *file, size_t file_size,
+                              uint32_t vaddr, uint32_t offset, uint32_t filesz, uint32_t memsz) {
+    uint64_t file_end = (uint64_t)vaddr + filesz;
+    uint64_t mem_end = (uint64_t)vaddr + memsz;
+    
+    if (memsz == 0) {
+        return 0;
+    }
+    if (filesz > memsz || mem_end > size || (uint64_t)offset + filesz > file_size) {
+        printf("ELF segment at 0x%08x (%u bytes) does not fit guest memory\n", vaddr, memsz);
+        return -1;
+    }
+    
+    // First and last whole guest pages covered by file bytes
+    uint64_t first = ((uint64_t)vaddr + MEM_PAGE_MASK) & ~(uint64_t)MEM_PAGE_MASK;
+    uint64_t last = file_end & ~(uint64_t)MEM_PAGE_MASK;
+    if (first < *touched_end) {
+        first = *touched_end;
+    }
+    
+    int congruent = (vaddr % MEM_PAGE_SIZE) == (offset % MEM_PAGE_SIZE) &&
+                    (uint64_t)sysconf(_SC_PAGESIZE) == MEM_PAGE_SIZE;
+    
+    if (congruent && first < last) {
+        uint64_t file_offset = offset + (first - vaddr);
+        uint8_t *mapped = mmap(NULL, last - first, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                               (off_t)file_offset);
+        if (mapped == MAP_FAILED) {
+            printf("Failed to map ELF segment at 0x%08x\n", vaddr);
+            return -1;
+        }
+        if (paged_add_mapping(memory, mapped, last - first) != 0) {
+            munmap(mapped, last - first);
+            return -1;
+        }
+        for (uint64_t pos = first; pos < last; pos += MEM_PAGE_SIZE) {
+            if (paged_map_external(memory, (uint32_t)pos, mapped + (pos - first)) != 0) {
+                return -1;
+            }
+        }
+        
+        // Partial pages on either side are copied
+        if (paged_write(memory, vaddr, file + offset, first - vaddr) != 0 ||
+            paged_write(memory, (uint32_t)last, file + offset + (last - vaddr), file_end - last) != 0) {
+            return -1;
+        }
+    } else if (filesz > 0) {
+        // Offsets not page-congruent with addresses: fall back to a copy
+        if (paged_write(memory, vaddr, file + offset, filesz) != 0) {
+            return -1;
+        }
+    }
+    
+    uint64_t end = (mem_end + MEM_PAGE_MASK) & ~(uint64_t)MEM_PAGE_MASK;
+    if (end > *touched_end) {
+        *touched_end = end;
+    }
+    return 0;
+}
+
+int elf_is_elf_file(const char *filename) {
+    unsigned char magic[4];
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t read = fread(magic, 1, 4, file);
+    fclose(file);
+    return read == 4 && memcmp(magic, "\x7f" "ELF", 4) == 0;
+}
+
+int elf_load(CPU *cpu, const char *filename, ElfImage *image) {
+    memset(image, 0, sizeof(*image));
+    
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open file: %s\n", filename);
+        return -1;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < EHDR_SIZE) {
+        printf("Not an ELF file: %s\n", filename);
+        close(fd);
+        return -1;
+    }
+    
+    // Headers and symbols are read through a read-only view of the file
+    const uint8_t *file = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED) {
+        printf("Failed to map file: %s\n", filename);
+        close(fd);
+        return -1;
+    }
+    image->file = file;
+    image->file_size = (size_t)st.st_size;
+    
+    if (memcmp(file, "\x7f" "ELF", 4) != 0 || file[4] != 1 || file[5] != 1) {
+        printf("Not a little-endian ELF32 file: %s\n", filename);
+        goto fail;
+    }
+    if (rd16(file + 16) != ET_EXEC || rd16(file + 18) != EM_RISCV) {
+        printf("Not a RISC-V executable: %s\n", filename);
+        goto fail;
+    }
+    
+    uint32_t phoff = rd32(file + 28);
+    uint16_t phentsize = rd16(file + 42);
+    uint16_t phnum = rd16(file + 44);
+    if (phentsize < PHDR_SIZE || (uint64_t)phoff + (uint64_t)phnum * phentsize > image->file_size) {
+        printf("Corrupt program headers: %s\n", filename);
+        goto fail;
+    }
+    
+    LoadTarget inst = { cpu->inst_memory, cpu->inst_mem_size, 0 };
+    LoadTarget data = { cpu->guard_data, cpu->data_mem_size, 0 };
+    uint64_t data_touched_end = 0;
+    
+    for (uint16_t n = 0; n < phnum; n++) {
+        const uint8_t *ph = file + phoff + (size_t)n * phentsize;
+        if (rd32(ph) != PT_LOAD) {
+            continue;
+        }
+        
+        uint32_t offset = rd32(ph + 4);
+        uint32_t vaddr = rd32(ph + 8);
+        uint32_t filesz = rd32(ph + 16);
+        uint32_t memsz = rd32(ph + 20);
+        int executable = rd32(ph + 24) & PF_X;
+        
+        if (!executable && (uint64_t)vaddr + memsz > image->data_end) {
+            image->data_end = vaddr + memsz;
+        }
+        
+        if (executable) {
+            if (load_segment(&inst, fd, file, image->file_size, vaddr, offset, filesz, memsz) != 0) {
+                goto fail;
+            }
+            cpu_invalidate_decoded(cpu, vaddr, memsz);
+        } else if (cpu->guard_data) {
+            // Guard-page data memory is flat, like instruction memory
+            if (load_segment(&data, fd, file, image->file_size, vaddr, offset, filesz, memsz) != 0) {
+                goto fail;
+            }
+        } else if (load_paged_segment(&cpu->data_memory, cpu->data_mem_size, &data_touched_end, fd,
+                                      file, image->file_size, vaddr, offset, filesz, memsz) != 0) {
+            goto fail;
+        }
+    }
+    
+    close(fd);
+    image->entry = rd32(file + 24);
+    cpu->pc = image->entry;
+    
+    printf("Loaded ELF %s, entry 0x%08x\n", filename, image->entry);
+    return 0;
+
+fail:
+    close(fd);
+    elf_image_destroy(image);
+    return -1;
+}
+
+void elf_image_destroy(ElfImage *image) {
+    if (image->file) {
+        munmap((void *)image->file, image->file_size);
+        image->file = NULL;
+    }
+    free(image->symbols);
+    image->symbols = NULL;
+    image->symbol_count = 0;
+    image->symbols_loaded = 0;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const ElfSymbol *x = a;
+    const ElfSymbol *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+// Build the sorted symbol list from .symtab
+static void load_symbols(ElfImage *image) {
+    const uint8_t *file = image->file;
+    image->symbols_loaded = 1;
+    
+    if (!file) {
+        return;
+    }
+    
+    uint32_t shoff = rd32(file + 32);
+    uint16_t shentsize = rd16(file + 46);
+    uint16_t shnum = rd16(file + 48);
+    if (shentsize < SHDR_SIZE || (uint64_t)shoff + (uint64_t)shnum * shentsize > image->file_size) {
+        return;
+    }
+    
+    for (uint16_t n = 0; n < shnum; n++) {
+        const uint8_t *sh = file + shoff + (size_t)n * shentsize;
+        if (rd32(sh + 4) != SHT_SYMTAB) {
+            continue;
+        }
+        
+        uint32_t sym_offset = rd32(sh + 16);
+        uint32_t sym_size = rd32(sh + 20);
+        uint32_t link = rd32(sh + 24);
+        if (link >= shnum || (uint64_t)sym_offset + sym_size > image->file_size) {
+            return;
+        }
+        
+        const uint8_t *strtab = file + shoff + (size_t)link * shentsize;
+        uint32_t str_offset = rd32(strtab + 16);
+        uint32_t str_size = rd32(strtab + 20);
+        if ((uint64_t)str_offset + str_size > image->file_size || str_size == 0) {
+            return;
+        }
+        
+        size_t count = sym_size / SYM_SIZE;
+        image->symbols = calloc(count ? count : 1, sizeof(ElfSymbol));
+        if (!image->symbols) {
+            return;
+        }
+        
+        for (size_t s = 0; s < count; s++) {
+            const uint8_t *sym = file + sym_offset + s * SYM_SIZE;
+            uint32_t name = rd32(sym);
+            uint8_t type = sym[12] & 0xF;
+            
+            // Named functions and objects defined in some section
+            if (name == 0 || name >= str_size || rd16(sym + 14) == 0 ||
+                (type != STT_FUNC && type != STT_OBJECT && type != 0)) {
+                continue;
+            }
+            if (memchr(file + str_offset + name, 0, str_size - name) == NULL) {
+                continue;
+            }
+            
+            ElfSymbol *out = &image->symbols[image->symbol_count++];
+            out->name = (const char *)file + str_offset + name;
+            out->addr = rd32(sym + 4);
+            out->size = rd32(sym + 8);
+            out->is_function = type == STT_FUNC;
+        }
+        
+        qsort(image->symbols, image->symbol_count, sizeof(ElfSymbol), compare_symbols);
+        return;
+    }
+}
+
+const ElfSymbol *elf_symbols(ElfImage *image, size_t *count) {
+    if (!image->symbols_loaded) {
+        load_symbols(image);
+    }
+    *count = image->symbol_count;
+    return image->symbols;
+}
+
+const ElfSymbol *elf_symbol_for_addr(ElfImage *image, uint32_t addr) {
+    size_t count;
+    const ElfSymbol *symbols = elf_symbols(image, &count);
+    
+    // Last symbol starting at or before addr
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (symbols[mid].addr <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    if (low == 0) {
+        return NULL;
+    }
+    
+    // Check every alias starting at that address
+    uint32_t start = symbols[low - 1].addr;
+    for (size_t n = low; n > 0 && symbols[n - 1].addr == start; n--) {
+        const ElfSymbol *sym = &symbols[n - 1];
+        if (addr - sym->addr < sym->size || addr == sym->addr) {
+            return sym;
+        }
+    }
+    return NULL;
+}
+
+const ElfSymbol *elf_symbol_by_name(ElfImage *image, const char *name) {
+    size_t count;
+    const ElfSymbol *symbols = elf_symbols(image, &count);
+    
+    for (size_t n = 0; n < count; n++) {
+        if (strcmp(symbols[n].name, name) == 0) {
+            return &symbols[n];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,45 @@
+// elf.h
+#ifndef ELF_H
+#define ELF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Symbol from the image's .symtab. Names point into the mapped file.
+typedef struct {
+    const char *name;
+    uint32_t addr;
+    uint32_t size;
+    int is_function;
+} ElfSymbol;
+
+// A loaded RV32 ELF image. The file stays mapped while the image is alive
+// because loaded segments and symbol names refer to it.
+typedef struct {
+    const uint8_t *file;        // Whole file, mapped read-only
+    size_t file_size;
+    uint32_t entry;             // e_entry
+    uint32_t data_end;          // End of the highest data segment: the initial program break
+    ElfSymbol *symbols;         // Sorted by address, built on first use
+    size_t symbol_count;
+    int symbols_loaded;
+} ElfImage;
+
+// Map an ELF32 RISC-V executable into the CPU's memories and set the PC
+// to its entry point. Executable PT_LOAD segments go to instruction
+// memory, the rest to data memory, at their virtual addresses. File pages
+// are mapped copy-on-write and faulted in on first touch; .bss is
+// zero-filled lazily. Returns 0 on success, -1 on error.
+int elf_load(CPU *cpu, const char *filename, ElfImage *image);
+void elf_image_destroy(ElfImage *image);
+
+// Non-zero if the file starts with the ELF magic
+int elf_is_elf_file(const char *filename);
+
+// Symbol table access for profilers
+const ElfSymbol *elf_symbols(ElfImage *image, size_t *count);
+const ElfSymbol *elf_symbol_for_addr(ElfImage *image, uint32_t addr);
+const ElfSymbol *elf_symbol_by_name(ElfImage *image, const char *name);
+
+#endif
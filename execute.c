@@ -1,6 +1,10 @@
 // execute.c
 #include "execute.h"
-#include <stdio.h>
+#include "trace.h"
+#include "tracebuf.h"
+#include "profile.h"
+#include "cachesim.h"
+#include "syscalls.h"
 
 // Execute R-type instructions
 void execute_r_type(CPU *cpu, Instruction *inst) {
@@ -20,8 +24,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
                 result = rs1_val + rs2_val;
                 
-                printf("ADD x%d, x%d, x%d (0x%08x + 0x%08x = 0x%08x)\n", 
-                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
+                TRACE_INST("ADD x%d, x%d, x%d (0x%08x + 0x%08x = 0x%08x)\n", 
+                           inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
 
             } else if (inst->funct7 == 0x20) {
 
@@ -29,15 +33,15 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
                 result = rs1_val - rs2_val;
 
-                printf("SUB x%d, x%d, x%d (0x%08x - 0x%08x = 0x%08x)\n", 
-                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
+                TRACE_INST("SUB x%d, x%d, x%d (0x%08x - 0x%08x = 0x%08x)\n", 
+                           inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
                 
             } else {
 
-                printf("Unknown R-type instruction: funct3=0x%x, funct7=0x%02x\n", 
-                       inst->funct3, inst->funct7);
+                TRACE_ERROR("Unknown R-type instruction: funct3=0x%x, funct7=0x%02x\n", 
+                            inst->funct3, inst->funct7);
 
-                cpu_halt(cpu);
+                cpu_raise(cpu, CPU_ERR_ILLEGAL_INSTRUCTION, cpu->pc);
 
                 return;
             }
@@ -48,8 +52,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
             result = rs1_val << (rs2_val & 0x1F);
 
-            printf("SLL x%d, x%d, x%d (0x%08x << %d = 0x%08x)\n", 
-                   inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
+            TRACE_INST("SLL x%d, x%d, x%d (0x%08x << %d = 0x%08x)\n", 
+                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
             break;
             
         case 0x2: // SLT (Set Less Than - signed)
@@ -57,8 +61,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
             result = ((int32_t)rs1_val < (int32_t)rs2_val) ? 1 : 0;
 
-            printf("SLT x%d, x%d, x%d (%d < %d = %d)\n", 
-                   inst->rd, inst->rs1, inst->rs2, (int32_t)rs1_val, (int32_t)rs2_val, result);
+            TRACE_INST("SLT x%d, x%d, x%d (%d < %d = %d)\n", 
+                       inst->rd, inst->rs1, inst->rs2, (int32_t)rs1_val, (int32_t)rs2_val, result);
             break;
             
         case 0x3: // SLTU (Set Less Than Unsigned)
@@ -75,8 +79,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
             result = rs1_val ^ rs2_val;
 
-            printf("XOR x%d, x%d, x%d (0x%08x ^ 0x%08x = 0x%08x)\n", 
-                   inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
+            TRACE_INST("XOR x%d, x%d, x%d (0x%08x ^ 0x%08x = 0x%08x)\n", 
+                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
             break;
             
         case 0x5: // SRL/SRA (Shift Right Logical/Arithmetic)
@@ -85,8 +89,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
                 result = rs1_val >> (rs2_val & 0x1F);
 
-                printf("SRL x%d, x%d, x%d (0x%08x >> %d = 0x%08x)\n", 
-                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
+                TRACE_INST("SRL x%d, x%d, x%d (0x%08x >> %d = 0x%08x)\n", 
+                           inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
 
             } else if (inst->funct7 == 0x20) {
 
@@ -94,14 +98,14 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
                 result = (int32_t)rs1_val >> (rs2_val & 0x1F);
 
-                printf("SRA x%d, x%d, x%d (0x%08x >> %d = 0x%08x) [arithmetic]\n", 
-                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
+                TRACE_INST("SRA x%d, x%d, x%d (0x%08x >> %d = 0x%08x) [arithmetic]\n", 
+                           inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val & 0x1F, result);
 
             } else {
 
-                printf("Unknown R-type shift instruction: funct7=0x%02x\n", inst->funct7);
+                TRACE_ERROR("Unknown R-type shift instruction: funct7=0x%02x\n", inst->funct7);
 
-                cpu_halt(cpu);
+                cpu_raise(cpu, CPU_ERR_ILLEGAL_INSTRUCTION, cpu->pc);
 
                 return;
             }
@@ -112,8 +116,8 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
             result = rs1_val | rs2_val;
 
-            printf("OR x%d, x%d, x%d (0x%08x | 0x%08x = 0x%08x)\n", 
-                   inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
+            TRACE_INST("OR x%d, x%d, x%d (0x%08x | 0x%08x = 0x%08x)\n", 
+                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
             break;
             
         case 0x7: // AND
@@ -121,14 +125,14 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
             result = rs1_val & rs2_val;
 
-            printf("AND x%d, x%d, x%d (0x%08x & 0x%08x = 0x%08x)\n", 
-                   inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
+            TRACE_INST("AND x%d, x%d, x%d (0x%08x & 0x%08x = 0x%08x)\n", 
+                       inst->rd, inst->rs1, inst->rs2, rs1_val, rs2_val, result);
             break;
             
         default:
-            printf("Unknown R-type instruction: funct3=0x%x, funct7=0x%02x\n", 
-                   inst->funct3, inst->funct7);
-            cpu_halt(cpu);
+            TRACE_ERROR("Unknown R-type instruction: funct3=0x%x, funct7=0x%02x\n", 
+                        inst->funct3, inst->funct7);
+            cpu_raise(cpu, CPU_ERR_ILLEGAL_INSTRUCTION, cpu->pc);
             return;
     }
     
@@ -141,6 +145,12 @@ void execute_r_type(CPU *cpu, Instruction *inst) {
 
 // Main execute function
 void execute_instruction(CPU *cpu, Instruction *inst) {
+    uint32_t pc = cpu->pc;
+
+    // The fetch goes through the I-cache before any data access
+    if (cpu->caches) {
+        cachesim_fetch(cpu->caches, pc);
+    }
 
     switch (inst->opcode) {
 
@@ -149,12 +159,40 @@ void execute_instruction(CPU *cpu, Instruction *inst) {
             execute_r_type(cpu, inst);
 
             break;
+
+        case 0x73: // SYSTEM
+
+            if (inst->op == OP_EBREAK) {
+                // Stop without retiring; the PC stays on the EBREAK
+                TRACE_INST("EBREAK at PC=0x%08x\n", cpu->pc);
+                cpu->breakpoint = 1;
+                cpu->halted = 1;
+                break;
+            }
+            if (inst->op == OP_ECALL && cpu->syscalls) {
+                syscall_handle(cpu);
+                if (!cpu->halted) {
+                    cpu->pc += 4;
+                }
+                break;
+            }
+            TRACE_ERROR("Unknown SYSTEM instruction: 0x%08x at PC=0x%08x\n", inst->raw, cpu->pc);
+            cpu_raise(cpu, CPU_ERR_ILLEGAL_INSTRUCTION, cpu->pc);
+            break;
             
         
         
         default:
-            printf("Unknown opcode: 0x%02x at PC=0x%08x\n", inst->opcode, cpu->pc);
-            cpu_halt(cpu);
+            TRACE_ERROR("Unknown opcode: 0x%02x at PC=0x%08x\n", inst->opcode, cpu->pc);
+            cpu_raise(cpu, CPU_ERR_ILLEGAL_INSTRUCTION, cpu->pc);
             break;
     }
+
+    // Record the retired instruction in the binary trace and profile
+    if (cpu->trace && !cpu->halted) {
+        tracebuf_push(cpu->trace, pc, inst->raw, inst->rd, cpu->regs[inst->rd]);
+    }
+    if (cpu->profile && !cpu->halted) {
+        profile_record(cpu->profile, pc, inst->op);
+    }
 }
@@ -0,0 +1,87 @@
+// fuzz.c
+#include "fuzz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int fuzz_init(FuzzTarget *target, CPU *cpu, uint8_t *coverage, uint64_t budget) {
+    target->cpu = cpu;
+    target->budget = budget;
+    target->executions = 0;
+    
+    if (cpu->data_mem_size <= FUZZ_INPUT_ADDR) {
+        printf("Data memory ends below the fuzz input at 0x%08x\n", FUZZ_INPUT_ADDR);
+        return -1;
+    }
+    target->max_input = cpu->data_mem_size - FUZZ_INPUT_ADDR < FUZZ_MAX_INPUT ?
+                        (uint32_t)(cpu->data_mem_size - FUZZ_INPUT_ADDR) : FUZZ_MAX_INPUT;
+    
+    if (cpu_snapshot(cpu, &target->snapshot) != 0) {
+        return -1;
+    }
+    if (cpu->syscalls) {
+        target->syscalls = *cpu->syscalls;
+    }
+    
+    block_cache_init(&target->blocks);
+    block_cache_enable_jit(&target->blocks, BLOCK_JIT_DEFAULT_THRESHOLD);
+    target->blocks.coverage = coverage;
+    target->blocks.coverage_edges = malloc(BLOCK_COVERAGE_SIZE * sizeof(uint32_t));
+    if (!target->blocks.coverage_edges) {
+        printf("Failed to allocate the edge list\n");
+        fuzz_destroy(target);
+        return -1;
+    }
+    return 0;
+}
+
+void fuzz_destroy(FuzzTarget *target) {
+    free(target->blocks.coverage_edges);
+    target->blocks.coverage_edges = NULL;
+    block_cache_destroy(&target->blocks);
+    cpu_snapshot_free(target->cpu, &target->snapshot);
+}
+
+// Files the last input opened are closed; the rest of the syscall state
+// is a plain copy
+static void reset_syscalls(FuzzTarget *target) {
+    Syscalls *sys = target->cpu->syscalls;
+    
+    for (int fd = 0; fd < SYSCALL_MAX_FDS; fd++) {
+        if (sys->owned[fd] && !(target->syscalls.owned[fd] && target->syscalls.fds[fd] == sys->fds[fd])) {
+            close(sys->fds[fd]);
+        }
+    }
+    *sys = target->syscalls;
+}
+
+CpuExitReason fuzz_run(FuzzTarget *target, const uint8_t *data, size_t size) {
+    CPU *cpu = target->cpu;
+    
+    cpu_restore(cpu, &target->snapshot);
+    if (cpu->syscalls) {
+        reset_syscalls(target);
+    }
+    
+    if (size > target->max_input) {
+        size = target->max_input;
+    }
+    if (paged_write(&cpu->data_memory, FUZZ_INPUT_ADDR, data, size) != 0) {
+        printf("Cannot place the fuzz input at 0x%08x\n", FUZZ_INPUT_ADDR);
+        cpu_raise(cpu, CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS, FUZZ_INPUT_ADDR);
+        return cpu_exit_reason(cpu);
+    }
+    cpu->regs[10] = FUZZ_INPUT_ADDR;
+    cpu->regs[11] = (uint32_t)size;
+    
+    target->blocks.coverage_prev = 0;
+    target->blocks.coverage_edge_count = 0;
+    block_run(&target->blocks, cpu, target->budget);
+    target->executions++;
+    return cpu_exit_reason(cpu);
+}
+
+const uint32_t *fuzz_edges(const FuzzTarget *target, size_t *count) {
+    *count = target->blocks.coverage_edge_count;
+    return target->blocks.coverage_edges;
+}
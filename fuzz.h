@@ -0,0 +1,54 @@
+// fuzz.h
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block.h"
+#include "cpu.h"
+#include "snapshot.h"
+#include "syscalls.h"
+
+#define FUZZ_MAP_SIZE       BLOCK_COVERAGE_SIZE
+#define FUZZ_INPUT_ADDR     0x20000000u     // Where each input is placed in data memory
+#define FUZZ_MAX_INPUT      (1u << 20)      // Longer inputs are truncated
+#define FUZZ_DEFAULT_BUDGET 1000000         // Instructions per input before giving up
+
+// In-process fuzzing of one loaded guest. The CPU is set up once and
+// snapshotted; each input restores the snapshot, which rewrites only the
+// pages the previous input dirtied and reuses their memory, so nothing is
+// allocated or cleared per run. Translated blocks (and JIT code, where
+// available) stay cached across inputs.
+//
+// The input is copied to FUZZ_INPUT_ADDR and the guest starts with a0
+// pointing at it and a1 holding its length. Edge coverage goes to the
+// caller's FUZZ_MAP_SIZE counter map, which the caller clears between
+// inputs (libFuzzer does this for its extra counters). fuzz_edges() lists
+// the counters an input took from zero, so a caller can visit and clear
+// just those instead of the whole map.
+typedef struct {
+    CPU *cpu;
+    BlockCache blocks;
+    CpuSnapshot snapshot;           // State every input starts from
+    Syscalls syscalls;              // Syscall state at the snapshot, if emulation is attached
+    uint64_t budget;                // Instructions per input
+    uint32_t max_input;             // Bytes of each input passed to the guest
+    uint64_t executions;
+} FuzzTarget;
+
+// Snapshot cpu, with its program loaded, as the start state for every
+// input. Returns 0, or -1 if the CPU cannot be snapshotted (guard-page
+// mode cannot) or has no room for inputs.
+int fuzz_init(FuzzTarget *target, CPU *cpu, uint8_t *coverage, uint64_t budget);
+void fuzz_destroy(FuzzTarget *target);
+
+// Run one input from the start state. The CPU is left where the input
+// stopped; CPU_EXIT_ILLEGAL and CPU_EXIT_MEMORY_FAULT are crashes and
+// CPU_EXIT_BUDGET a hang.
+CpuExitReason fuzz_run(FuzzTarget *target, const uint8_t *data, size_t size);
+
+// Map indices of the edges the last input hit that were zero before it.
+// An index can appear twice if its counter wrapped.
+const uint32_t *fuzz_edges(const FuzzTarget *target, size_t *count);
+
+#endif
@@ -0,0 +1,337 @@
+// fuzzmain.c
+// Standalone persistent fuzzing loop: mutates a corpus in process and keeps
+// inputs that reach new edges
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "elf.h"
+#include "fuzz.h"
+#include "trace.h"
+
+#define CORPUS_MAX      4096
+#define MUTATE_GROWTH   64          // Bytes a mutation may add beyond the input
+#define CRASHES_SAVED   64
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} Input;
+
+static uint8_t coverage[FUZZ_MAP_SIZE];
+static uint8_t seen[FUZZ_MAP_SIZE];     // Hit-count buckets reached so far, per edge
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-m bytes] [-b instructions] [-n runs] [-t seconds] [-s seed] [-o dir] [-L] program [input...]\n", prog);
+    printf("  -m bytes   Size of instruction memory (default 64 KiB)\n");
+    printf("  -b count   Instructions per input (default %d)\n", FUZZ_DEFAULT_BUDGET);
+    printf("  -n runs    Stop after this many inputs\n");
+    printf("  -t secs    Stop after this many seconds (default 10)\n");
+    printf("  -s seed    Random seed\n");
+    printf("  -o dir     Save crashing inputs here\n");
+    printf("  -L         Emulate Linux syscalls on ECALL\n");
+    printf("  input      Seed inputs (default: one empty input)\n");
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Hit counts as AFL buckets them: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static uint8_t bucket(uint8_t count) {
+    if (count < 4) {
+        return count == 3 ? 4 : count;
+    }
+    return count < 8 ? 8 : count < 16 ? 16 : count < 32 ? 32 : count < 128 ? 64 : 128;
+}
+
+// Fold this run's coverage into seen and clear it for the next input.
+// Returns the number of edges first reached. Only the edges the run took
+// from zero are visited; scanning the whole map every run would cost far
+// more than running a short input.
+static int merge_coverage(const FuzzTarget *target, int *new_buckets) {
+    size_t count;
+    const uint32_t *edges = fuzz_edges(target, &count);
+    int new_edges = 0;
+    *new_buckets = 0;
+    
+    for (size_t n = 0; n < count; n++) {
+        uint32_t e = edges[n];
+        if (!coverage[e]) {
+            continue;       // Listed twice, or wrapped back to zero
+        }
+        uint8_t b = bucket(coverage[e]);
+        if (!(seen[e] & b)) {
+            new_edges += seen[e] == 0;
+            (*new_buckets)++;
+            seen[e] |= b;
+        }
+        coverage[e] = 0;
+    }
+    return new_edges;
+}
+
+static size_t mutate(uint8_t *buffer, size_t size, size_t capacity, uint64_t *rng) {
+    static const uint8_t interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+    int rounds = 1 + (int)(next_random(rng) % 4);
+    
+    for (int r = 0; r < rounds; r++) {
+        size_t at = size ? next_random(rng) % size : 0;
+        switch (next_random(rng) % 6) {
+            case 0:     // Flip a bit
+                if (size) {
+                    buffer[at] ^= 1u << (next_random(rng) % 8);
+                }
+                break;
+            case 1:     // Random byte
+                if (size) {
+                    buffer[at] = (uint8_t)next_random(rng);
+                }
+                break;
+            case 2:     // Boundary value
+                if (size) {
+                    buffer[at] = interesting[next_random(rng) % sizeof(interesting)];
+                }
+                break;
+            case 3:     // Insert a byte
+                if (size < capacity) {
+                    memmove(buffer + at + 1, buffer + at, size - at);
+                    buffer[at] = (uint8_t)next_random(rng);
+                    size++;
+                }
+                break;
+            case 4:     // Delete a byte
+                if (size) {
+                    memmove(buffer + at, buffer + at + 1, size - at - 1);
+                    size--;
+                }
+                break;
+            default: {  // Copy a chunk over another part of the input
+                if (size > 1) {
+                    size_t from = next_random(rng) % size;
+                    size_t length = 1 + next_random(rng) % (size - (from > at ? from : at));
+                    memmove(buffer + at, buffer + from, length);
+                }
+                break;
+            }
+        }
+    }
+    return size;
+}
+
+static int add_input(Input *corpus, size_t *count, const uint8_t *data, size_t size) {
+    if (*count == CORPUS_MAX) {
+        return -1;
+    }
+    uint8_t *copy = malloc(size ? size : 1);
+    if (!copy) {
+        return -1;
+    }
+    if (size) {
+        memcpy(copy, data, size);
+    }
+    corpus[*count].data = copy;
+    corpus[*count].size = size;
+    (*count)++;
+    return 0;
+}
+
+static int load_input(Input *corpus, size_t *count, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Failed to open input: %s\n", path);
+        return -1;
+    }
+    uint8_t *data = malloc(FUZZ_MAX_INPUT);
+    size_t size = data ? fread(data, 1, FUZZ_MAX_INPUT, file) : 0;
+    fclose(file);
+    
+    int result = data ? add_input(corpus, count, data, size) : -1;
+    free(data);
+    return result;
+}
+
+static void save_crash(const char *dir, uint64_t run, const uint8_t *data, size_t size) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/crash-%llu", dir, (unsigned long long)run);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("Failed to save crash to %s\n", path);
+        return;
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+    printf("Saved %s\n", path);
+}
+
+int main(int argc, char *argv[]) {
+    CPU cpu;
+    ElfImage image;
+    int have_image = 0;
+    const char *program_path = NULL;
+    const char *crash_dir = NULL;
+    unsigned int mem_size = 64 * 1024;
+    uint64_t budget = FUZZ_DEFAULT_BUDGET;
+    uint64_t max_runs = UINT64_MAX;
+    double max_seconds = 10;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    int use_syscalls = 0;
+    Syscalls syscalls;
+    static Input corpus[CORPUS_MAX];
+    size_t corpus_count = 0;
+    int first_input = 0;
+    
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            mem_size = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            budget = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+            max_runs = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            max_seconds = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+            rng = strtoull(argv[++arg], NULL, 0) | 1;
+        } else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+            crash_dir = argv[++arg];
+        } else if (strcmp(argv[arg], "-L") == 0) {
+            use_syscalls = 1;
+        } else if (argv[arg][0] != '-') {
+            program_path = argv[arg];
+            first_input = arg + 1;
+            break;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!program_path) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // The one-time setup every input would otherwise pay for
+    trace_set_verbosity(TRACE_LEVEL_OFF);
+    cpu_init(&cpu, mem_size, CPU_DATA_MEM_FULL);
+    if (elf_is_elf_file(program_path)) {
+        if (elf_load(&cpu, program_path, &image) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        have_image = 1;
+    } else if (cpu_load_inst_binary(&cpu, program_path) != 0) {
+        cpu_destroy(&cpu);
+        return 1;
+    }
+    if (use_syscalls) {
+        uint32_t brk_base = have_image && image.data_end ? image.data_end : SYSCALL_DEFAULT_BRK;
+        syscall_init(&syscalls, &cpu, brk_base);
+    }
+    
+    FuzzTarget target;
+    if (fuzz_init(&target, &cpu, coverage, budget) != 0) {
+        cpu_destroy(&cpu);
+        return 1;
+    }
+    
+    for (int arg = first_input; arg < argc; arg++) {
+        if (load_input(corpus, &corpus_count, argv[arg]) != 0) {
+            return 1;
+        }
+    }
+    if (corpus_count == 0) {
+        add_input(corpus, &corpus_count, NULL, 0);
+    }
+    
+    uint8_t *buffer = malloc(FUZZ_MAX_INPUT);
+    if (!buffer) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    
+    uint64_t runs = 0, crashes = 0, hangs = 0;
+    int edges = 0;
+    double start = now(), last_report = start;
+    
+    // Seeds run unmutated first, then inputs are picked at random
+    while (runs < max_runs) {
+        size_t size;
+        if (runs < corpus_count) {
+            size = corpus[runs].size;
+            memcpy(buffer, corpus[runs].data, size);
+        } else {
+            const Input *parent = &corpus[next_random(&rng) % corpus_count];
+            size_t capacity = parent->size + MUTATE_GROWTH < FUZZ_MAX_INPUT ?
+                              parent->size + MUTATE_GROWTH : FUZZ_MAX_INPUT;
+            memcpy(buffer, parent->data, parent->size);
+            size = mutate(buffer, parent->size, capacity, &rng);
+        }
+        
+        CpuExitReason reason = fuzz_run(&target, buffer, size);
+        runs++;
+        
+        int new_buckets;
+        int new_edges = merge_coverage(&target, &new_buckets);
+        edges += new_edges;
+        if (new_buckets && runs > corpus_count) {
+            add_input(corpus, &corpus_count, buffer, size);
+        }
+        
+        if (reason == CPU_EXIT_ILLEGAL || reason == CPU_EXIT_MEMORY_FAULT) {
+            if (crashes < CRASHES_SAVED && crash_dir) {
+                save_crash(crash_dir, runs, buffer, size);
+            }
+            if (crashes == 0) {
+                printf("Crash on run %llu: %s at PC=0x%08x (0x%08x)\n",
+                       (unsigned long long)runs, cpu_error_string(cpu.error), cpu.pc, cpu.error_addr);
+            }
+            crashes++;
+        } else if (reason == CPU_EXIT_BUDGET) {
+            hangs++;
+        }
+        
+        // Checking the clock every run would show up in the rate
+        if ((runs & 1023) == 0) {
+            double t = now();
+            if (t - last_report >= 1) {
+                printf("#%llu  %.0f execs/s  corpus %zu  edges %d  crashes %llu  hangs %llu\n",
+                       (unsigned long long)runs, runs / (t - start), corpus_count, edges,
+                       (unsigned long long)crashes, (unsigned long long)hangs);
+                last_report = t;
+            }
+            if (t - start >= max_seconds) {
+                break;
+            }
+        }
+    }
+    
+    double elapsed = now() - start;
+    printf("Done: %llu runs in %.2f s (%.0f execs/s), corpus %zu, edges %d, crashes %llu, hangs %llu\n",
+           (unsigned long long)runs, elapsed, elapsed > 0 ? runs / elapsed : 0.0, corpus_count, edges,
+           (unsigned long long)crashes, (unsigned long long)hangs);
+    
+    free(buffer);
+    for (size_t n = 0; n < corpus_count; n++) {
+        free(corpus[n].data);
+    }
+    fuzz_destroy(&target);
+    if (use_syscalls) {
+        syscall_destroy(&syscalls, &cpu);
+    }
+    if (have_image) {
+        elf_image_destroy(&image);
+    }
+    cpu_destroy(&cpu);
+    return crashes ? 1 : 0;
+}
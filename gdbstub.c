@@ -0,0 +1,764 @@
+// gdbstub.c
+#include "gdbstub.h"
+#include "guard.h"
+#include "mmio.h"
+#include "replay.h"
+#include "trace.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define GDB_PACKET_SIZE 4096
+#define GDB_REG_COUNT   33      // x0-x31, pc
+
+typedef enum {
+    SPACE_AUTO,
+    SPACE_INST,
+    SPACE_DATA
+} MemorySpace;
+
+typedef struct {
+    CPU *cpu;
+    int fd;
+    uint8_t in[GDB_PACKET_SIZE];
+    char reply[GDB_PACKET_SIZE * 2 + 1];    // Response to the packet being handled
+    size_t in_len;
+    size_t in_pos;
+    int no_ack;
+    MemorySpace space;
+    CpuExitReason last_stop;    // Reported again for '?'
+    Recording recording;        // History for reverse execution
+    int reversible;             // recording is running, so bs and bc work
+} GdbStub;
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <architecture>riscv:rv32</architecture>\n"
+    "  <feature name=\"org.gnu.gdb.riscv.cpu\">\n"
+    "    <reg name=\"zero\" bitsize=\"32\" type=\"int\" regnum=\"0\"/>\n"
+    "    <reg name=\"ra\" bitsize=\"32\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"gp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"tp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"t0\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t1\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t2\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"fp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"s1\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a0\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a1\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a2\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a3\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a4\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a5\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a6\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"a7\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s2\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s3\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s4\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s5\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s6\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s7\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s8\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s9\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s10\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"s11\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t3\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t4\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t5\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"t6\" bitsize=\"32\" type=\"int\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse hex digits up to a non-hex character; *end points past them
+static uint32_t parse_hex(const char *text, const char **end) {
+    uint32_t value = 0;
+    while (hex_value(*text) >= 0) {
+        value = (value << 4) | (uint32_t)hex_value(*text);
+        text++;
+    }
+    *end = text;
+    return value;
+}
+
+// Registers go over the wire as target-endian (little-endian) bytes
+static void put_reg(char *out, uint32_t value) {
+    for (int byte = 0; byte < 4; byte++) {
+        uint8_t bits = (value >> (byte * 8)) & 0xFF;
+        out[byte * 2] = hex_digits[bits >> 4];
+        out[byte * 2 + 1] = hex_digits[bits & 0xF];
+    }
+}
+
+static int get_reg(const char *in, uint32_t *value) {
+    *value = 0;
+    for (int byte = 0; byte < 4; byte++) {
+        int high = hex_value(in[byte * 2]);
+        int low = hex_value(in[byte * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return -1;
+        }
+        *value |= (uint32_t)(high << 4 | low) << (byte * 8);
+    }
+    return 0;
+}
+
+
+static int read_byte(GdbStub *stub) {
+    if (stub->in_pos == stub->in_len) {
+        ssize_t got = recv(stub->fd, stub->in, sizeof(stub->in), 0);
+        if (got <= 0) {
+            return -1;
+        }
+        stub->in_len = (size_t)got;
+        stub->in_pos = 0;
+    }
+    return stub->in[stub->in_pos++];
+}
+
+static int send_all(GdbStub *stub, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(stub->fd, data, length, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int send_packet(GdbStub *stub, const char *payload, size_t length) {
+    char frame[GDB_PACKET_SIZE * 2 + 4];
+    uint8_t checksum = 0;
+    size_t pos = 0;
+    
+    frame[pos++] = '$';
+    for (size_t n = 0; n < length && pos < sizeof(frame) - 4; n++) {
+        frame[pos++] = payload[n];
+        checksum += (uint8_t)payload[n];
+    }
+    frame[pos++] = '#';
+    frame[pos++] = hex_digits[checksum >> 4];
+    frame[pos++] = hex_digits[checksum & 0xF];
+    return send_all(stub, frame, pos);
+}
+
+static int send_string(GdbStub *stub, const char *payload) {
+    return send_packet(stub, payload, strlen(payload));
+}
+
+// Read one packet into payload (NUL-terminated). Returns its length, or
+// -1 when the connection closes. Acks and stray Ctrl-C bytes are skipped.
+static int read_packet(GdbStub *stub, char *payload, size_t capacity) {
+    for (;;) {
+        int c;
+        do {
+            c = read_byte(stub);
+            if (c < 0) {
+                return -1;
+            }
+        } while (c != '$');
+    
+        size_t length = 0;
+        uint8_t checksum = 0;
+        while ((c = read_byte(stub)) >= 0 && c != '#') {
+            if (length + 1 < capacity) {
+                payload[length++] = (char)c;
+            }
+            checksum += (uint8_t)c;
+        }
+        int high = read_byte(stub);
+        int low = read_byte(stub);
+        if (c < 0 || high < 0 || low < 0) {
+            return -1;
+        }
+        payload[length] = '\0';
+    
+        if (hex_value((char)high) * 16 + hex_value((char)low) != checksum) {
+            if (!stub->no_ack && send_all(stub, "-", 1) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (!stub->no_ack && send_all(stub, "+", 1) != 0) {
+            return -1;
+        }
+        return (int)length;
+    }
+}
+
+// Non-zero if the debugger sent Ctrl-C (0x03) while the target runs
+static int interrupt_pending(GdbStub *stub) {
+    struct pollfd fd = { .fd = stub->fd, .events = POLLIN };
+    
+    while (stub->in_pos < stub->in_len || poll(&fd, 1, 0) > 0) {
+        int c = read_byte(stub);
+        if (c < 0 || c == 0x03) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int use_inst_memory(GdbStub *stub, uint32_t addr) {
+    if (stub->space != SPACE_AUTO) {
+        return stub->space == SPACE_INST;
+    }
+    return addr < stub->cpu->inst_mem_size;
+}
+
+static int read_memory(GdbStub *stub, uint32_t addr, uint8_t *dst, uint32_t length) {
+    CPU *cpu = stub->cpu;
+    
+    if (use_inst_memory(stub, addr)) {
+        if ((uint64_t)addr + length > cpu->inst_mem_size) {
+            return -1;
+        }
+        memcpy(dst, cpu->inst_memory + addr, length);
+        return 0;
+    }
+    
+    if ((uint64_t)addr + length > cpu->data_mem_size) {
+        return -1;
+    }
+    if (cpu->guard_data) {
+        memcpy(dst, cpu->guard_data + addr, length);
+    } else {
+        paged_read(&cpu->data_memory, addr, dst, length);
+    }
+    return 0;
+}
+
+static int write_memory(GdbStub *stub, uint32_t addr, const uint8_t *src, uint32_t length) {
+    CPU *cpu = stub->cpu;
+    
+    if (use_inst_memory(stub, addr)) {
+        if ((uint64_t)addr + length > cpu->inst_mem_size) {
+            return -1;
+        }
+        memcpy(cpu->inst_memory + addr, src, length);
+        cpu_invalidate_decoded(cpu, addr, length);
+        return 0;
+    }
+    
+    if ((uint64_t)addr + length > cpu->data_mem_size) {
+        return -1;
+    }
+    if (cpu->guard_data) {
+        memcpy(cpu->guard_data + addr, src, length);
+        return 0;
+    }
+    return paged_write(&cpu->data_memory, addr, src, length);
+}
+
+// Stop reply for why the CPU stopped
+static int send_stop(GdbStub *stub, CpuExitReason reason) {
+    CPU *cpu = stub->cpu;
+    
+    switch (reason) {
+        case CPU_EXIT_HALT:
+            return send_string(stub, "W00");
+        case CPU_EXIT_BREAKPOINT:
+            // Planted breakpoints are reported as such; a guest EBREAK is a plain trap
+            return send_string(stub, cpu->breakpoint && cpu_has_breakpoint(cpu, cpu->pc) ? "T05swbreak:;" : "S05");
+        case CPU_EXIT_ILLEGAL:
+            return send_string(stub, "S04");
+        case CPU_EXIT_MEMORY_FAULT:
+            return send_string(stub, "S0b");
+        default:
+            return send_string(stub, "S02");
+    }
+}
+
+// Run under the recording, or in guard_run_budget() so guard-mode faults
+// stop the CPU (guard mode cannot be recorded), then pass buffered device
+// output on so the console keeps up with the debugger
+static void run_slice(GdbStub *stub, uint64_t max_instructions, CpuExitInfo *info) {
+    CPU *cpu = stub->cpu;
+    
+    if (stub->reversible) {
+        replay_run(&stub->recording, cpu, max_instructions, info);
+    } else {
+        guard_run_budget(cpu, max_instructions, info);
+    }
+    if (cpu->bus) {
+        mmio_flush(cpu->bus);
+    }
+}
+
+// The debugger changed the guest, so the recorded history no longer leads
+// to its state. Record afresh from here.
+static void restart_recording(GdbStub *stub) {
+    if (stub->reversible) {
+        replay_stop(&stub->recording, stub->cpu);
+        stub->reversible = replay_start(&stub->recording, stub->cpu, GDB_REPLAY_INTERVAL) == 0;
+    }
+}
+
+// Run one instruction, stepping over a breakpoint planted at the PC
+static CpuExitReason step(GdbStub *stub) {
+    CPU *cpu = stub->cpu;
+    uint32_t pc = cpu->pc;
+    int planted = cpu_has_breakpoint(cpu, pc);
+    CpuExitInfo info;
+    
+    if (planted) {
+        cpu_clear_breakpoint(cpu, pc);
+    }
+    run_slice(stub, 1, &info);
+    if (planted) {
+        cpu_set_breakpoint(cpu, pc);
+    }
+    return info.reason == CPU_EXIT_BUDGET ? CPU_EXIT_BREAKPOINT : info.reason;
+}
+
+// Run until something stops the CPU or the debugger interrupts
+static CpuExitReason resume(GdbStub *stub) {
+    CPU *cpu = stub->cpu;
+    CpuExitInfo info;
+    
+    if (cpu_has_breakpoint(cpu, cpu->pc)) {
+        CpuExitReason reason = step(stub);
+        if (reason != CPU_EXIT_BREAKPOINT || cpu->breakpoint) {
+            return reason;
+        }
+    }
+    
+    for (;;) {
+        run_slice(stub, GDB_RUN_SLICE, &info);
+        if (info.reason != CPU_EXIT_BUDGET) {
+            return info.reason;
+        }
+        if (interrupt_pending(stub)) {
+            return CPU_EXIT_BUDGET;
+        }
+    }
+}
+
+// Step back one instruction; returns the stop reply
+static const char *reverse_step(GdbStub *stub) {
+    Recording *rec = &stub->recording;
+    
+    if (stub->cpu->instruction_count <= rec->checkpoints[0].instruction_count) {
+        return "T05replaylog:begin;";
+    }
+    return replay_reverse_step(rec, stub->cpu) == 0 ? "S05" : "E01";
+}
+
+// Run backwards to the last planted breakpoint passed before the current
+// position, or to the start of the recording; returns the stop reply.
+// Each interval is replayed forwards from its checkpoint to find the
+// last breakpoint in it, newest interval first.
+static const char *reverse_continue(GdbStub *stub) {
+    CPU *cpu = stub->cpu;
+    Recording *rec = &stub->recording;
+    uint64_t start = rec->checkpoints[0].instruction_count;
+    uint64_t end = cpu->instruction_count;
+    
+    while (end > start) {
+        uint64_t index = (end - 1 - start) / rec->interval;
+        if (index >= rec->checkpoint_count) {
+            index = rec->checkpoint_count - 1;
+        }
+        uint64_t from = rec->checkpoints[index].instruction_count;
+        uint64_t hit = UINT64_MAX;
+        CpuExitInfo info;
+    
+        if (replay_seek(rec, cpu, from) != 0) {
+            return "E01";
+        }
+        while (cpu->instruction_count < end) {
+            uint32_t pc = cpu->pc;
+            if (cpu_has_breakpoint(cpu, pc)) {
+                hit = cpu->instruction_count;
+                cpu_clear_breakpoint(cpu, pc);
+                run_slice(stub, 1, &info);
+                cpu_set_breakpoint(cpu, pc);
+            } else {
+                run_slice(stub, end - cpu->instruction_count, &info);
+                if (info.reason == CPU_EXIT_BREAKPOINT && cpu_has_breakpoint(cpu, cpu->pc)) {
+                    continue;
+                }
+            }
+            if (info.reason != CPU_EXIT_BUDGET) {
+                break;
+            }
+        }
+    
+        if (hit != UINT64_MAX) {
+            return replay_seek(rec, cpu, hit) == 0 ? "T05swbreak:;" : "E01";
+        }
+        if (interrupt_pending(stub)) {
+            return replay_seek(rec, cpu, from) == 0 ? "S02" : "E01";
+        }
+        end = from;
+    }
+    return replay_seek(rec, cpu, start) == 0 ? "T05replaylog:begin;" : "E01";
+}
+
+static void handle_query(GdbStub *stub, const char *packet, char *reply) {
+    if (strncmp(packet, "qSupported", 10) == 0) {
+        snprintf(reply, GDB_PACKET_SIZE, "PacketSize=%x;qXfer:features:read+;swbreak+;QStartNoAckMode+%s",
+                 GDB_PACKET_SIZE, stub->reversible ? ";ReverseStep+;ReverseContinue+" : "");
+    } else if (strncmp(packet, "qXfer:features:read:target.xml:", 31) == 0) {
+        const char *cursor = packet + 31;
+        uint32_t offset = parse_hex(cursor, &cursor);
+        uint32_t length = *cursor == ',' ? parse_hex(cursor + 1, &cursor) : 0;
+        size_t total = sizeof(target_xml) - 1;
+    
+        if (offset >= total) {
+            strcpy(reply, "l");
+            return;
+        }
+        if (length > GDB_PACKET_SIZE - 2) {
+            length = GDB_PACKET_SIZE - 2;
+        }
+        if (length > total - offset) {
+            length = (uint32_t)(total - offset);
+        }
+        // The XML has no characters that need binary escaping
+        reply[0] = offset + length < total ? 'm' : 'l';
+        memcpy(reply + 1, target_xml + offset, length);
+        reply[length + 1] = '\0';
+    } else if (strcmp(packet, "qAttached") == 0) {
+        strcpy(reply, "1");
+    } else if (strcmp(packet, "qC") == 0) {
+        strcpy(reply, "QC1");
+    } else if (strcmp(packet, "qfThreadInfo") == 0) {
+        strcpy(reply, "m1");
+    } else if (strcmp(packet, "qsThreadInfo") == 0) {
+        strcpy(reply, "l");
+    } else if (strncmp(packet, "qRcmd,", 6) == 0) {
+        // monitor commands arrive hex encoded
+        char command[64];
+        size_t length = 0;
+        for (const char *hex = packet + 6; hex[0] && hex[1] && length + 1 < sizeof(command); hex += 2) {
+            command[length++] = (char)(hex_value(hex[0]) << 4 | hex_value(hex[1]));
+        }
+        command[length] = '\0';
+    
+        const char *output;
+        if (strcmp(command, "mem inst") == 0) {
+            stub->space = SPACE_INST;
+            output = "Memory packets use instruction memory\n";
+        } else if (strcmp(command, "mem data") == 0) {
+            stub->space = SPACE_DATA;
+            output = "Memory packets use data memory\n";
+        } else if (strcmp(command, "mem auto") == 0) {
+            stub->space = SPACE_AUTO;
+            output = "Memory packets use instruction memory below its size, data memory above\n";
+        } else {
+            output = "Commands: mem inst, mem data, mem auto\n";
+        }
+        for (length = 0; output[length]; length++) {
+            reply[length * 2] = hex_digits[(uint8_t)output[length] >> 4];
+            reply[length * 2 + 1] = hex_digits[output[length] & 0xF];
+        }
+        reply[length * 2] = '\0';
+    } else {
+        reply[0] = '\0';
+    }
+}
+
+// Handle one packet. Returns 1 to keep serving, 0 when the session ends.
+static int handle_packet(GdbStub *stub, char *packet) {
+    CPU *cpu = stub->cpu;
+    char *reply = stub->reply;
+    const char *cursor;
+    
+    reply[0] = '\0';
+    switch (packet[0]) {
+        case '?':
+            return send_stop(stub, stub->last_stop) == 0;
+    
+        case 'g':
+            for (int reg = 0; reg < 32; reg++) {
+                put_reg(reply + reg * 8, cpu->regs[reg]);
+            }
+            put_reg(reply + 32 * 8, cpu->pc);
+            reply[GDB_REG_COUNT * 8] = '\0';
+            break;
+    
+        case 'G': {
+            // Parse every register before changing any
+            uint32_t values[GDB_REG_COUNT];
+            int valid = strlen(packet + 1) >= GDB_REG_COUNT * 8;
+            for (int reg = 0; valid && reg < GDB_REG_COUNT; reg++) {
+                valid = get_reg(packet + 1 + reg * 8, &values[reg]) == 0;
+            }
+            if (!valid) {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (int reg = 1; reg < 32; reg++) {
+                cpu->regs[reg] = values[reg];
+            }
+            cpu_set_pc(cpu, values[32]);
+            restart_recording(stub);
+            strcpy(reply, "OK");
+            break;
+        }
+    
+        case 'p': {
+            uint32_t reg = parse_hex(packet + 1, &cursor);
+            if (reg >= GDB_REG_COUNT) {
+                strcpy(reply, "E01");
+                break;
+            }
+            put_reg(reply, reg == 32 ? cpu->pc : cpu->regs[reg]);
+            reply[8] = '\0';
+            break;
+        }
+    
+        case 'P': {
+            uint32_t reg = parse_hex(packet + 1, &cursor);
+            uint32_t value;
+            if (reg >= GDB_REG_COUNT || *cursor != '=' || get_reg(cursor + 1, &value) != 0) {
+                strcpy(reply, "E01");
+                break;
+            }
+            if (reg == 32) {
+                cpu_set_pc(cpu, value);
+            } else if (reg > 0) {
+                cpu->regs[reg] = value;
+            }
+            restart_recording(stub);
+            strcpy(reply, "OK");
+            break;
+        }
+    
+        case 'm': {
+            uint32_t addr = parse_hex(packet + 1, &cursor);
+            uint32_t length = *cursor == ',' ? parse_hex(cursor + 1, &cursor) : 0;
+            uint8_t bytes[GDB_PACKET_SIZE / 2];
+            if (length > sizeof(bytes)) {
+                length = sizeof(bytes);
+            }
+            if (read_memory(stub, addr, bytes, length) != 0) {
+                strcpy(reply, "E14");
+                break;
+            }
+            for (uint32_t n = 0; n < length; n++) {
+                reply[n * 2] = hex_digits[bytes[n] >> 4];
+                reply[n * 2 + 1] = hex_digits[bytes[n] & 0xF];
+            }
+            reply[length * 2] = '\0';
+            break;
+        }
+    
+        case 'M': {
+            uint32_t addr = parse_hex(packet + 1, &cursor);
+            uint32_t length = *cursor == ',' ? parse_hex(cursor + 1, &cursor) : 0;
+            uint8_t bytes[GDB_PACKET_SIZE / 2];
+            if (*cursor != ':' || length > sizeof(bytes) || strlen(cursor + 1) < length * 2) {
+                strcpy(reply, "E01");
+                break;
+            }
+            // Decode every byte before writing any
+            int valid = 1;
+            for (uint32_t n = 0; valid && n < length; n++) {
+                int high = hex_value(cursor[1 + n * 2]);
+                int low = hex_value(cursor[2 + n * 2]);
+                valid = high >= 0 && low >= 0;
+                bytes[n] = (uint8_t)(high << 4 | low);
+            }
+            if (!valid) {
+                strcpy(reply, "E01");
+                break;
+            }
+            if (write_memory(stub, addr, bytes, length) != 0) {
+                strcpy(reply, "E14");
+                break;
+            }
+            restart_recording(stub);
+            strcpy(reply, "OK");
+            break;
+        }
+    
+        case 'c':
+        case 's':
+            if (packet[1]) {
+                cpu_set_pc(cpu, parse_hex(packet + 1, &cursor));
+                restart_recording(stub);
+            }
+            stub->last_stop = packet[0] == 'c' ? resume(stub) : step(stub);
+            return send_stop(stub, stub->last_stop) == 0;
+    
+        case 'b':
+            // Reverse step and continue, over the recorded history
+            if (stub->reversible && (packet[1] == 's' || packet[1] == 'c') && !packet[2]) {
+                stub->last_stop = CPU_EXIT_BREAKPOINT;
+                return send_string(stub, packet[1] == 's' ? reverse_step(stub) :
+                                                            reverse_continue(stub)) == 0;
+            }
+            break;
+    
+        case 'Z':
+        case 'z':
+            // Software breakpoints only; GDB falls back for the other kinds
+            if (packet[1] == '0' && packet[2] == ',') {
+                uint32_t addr = parse_hex(packet + 3, &cursor);
+                int status = packet[0] == 'Z' ? cpu_set_breakpoint(cpu, addr) :
+                             (cpu_clear_breakpoint(cpu, addr), 0);
+                strcpy(reply, status == 0 ? "OK" : "E01");
+            }
+            break;
+    
+        case 'H':
+        case 'T':
+            strcpy(reply, "OK");
+            break;
+    
+        case 'q':
+            handle_query(stub, packet, reply);
+            break;
+    
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0) {
+                send_string(stub, "OK");
+                stub->no_ack = 1;
+                return 1;
+            }
+            break;
+    
+        case 'D':
+            send_string(stub, "OK");
+            return 0;
+    
+        case 'k':
+            return 0;
+    
+        default:
+            break;      // Empty reply: not supported
+    }
+    
+    return send_string(stub, reply) == 0;
+}
+
+
+static int open_listener(const char *address) {
+    int fd;
+    
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(addr.sun_path)) {
+            printf("GDB socket path too long: %s\n", address + 5);
+            return -1;
+        }
+        strcpy(addr.sun_path, address + 5);
+        unlink(addr.sun_path);
+    
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("GDB socket");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+    } else {
+        const char *port = strncmp(address, "tcp:", 4) == 0 ? address + 4 : address;
+        struct sockaddr_in addr;
+        int reuse = 1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)atoi(port));
+    
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("GDB socket");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+    }
+    
+    if (listen(fd, 1) != 0) {
+        perror("GDB listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int gdb_serve(CPU *cpu, const char *address) {
+    GdbStub stub;
+    char packet[GDB_PACKET_SIZE];
+    
+    int listener = open_listener(address);
+    if (listener < 0) {
+        return -1;
+    }
+    printf("Waiting for GDB on %s\n", address);
+    fflush(stdout);
+    
+    memset(&stub, 0, sizeof(stub));
+    stub.cpu = cpu;
+    stub.last_stop = CPU_EXIT_BREAKPOINT;   // Attached before the first instruction
+
+    stub.fd = accept(listener, NULL, NULL);
+    close(listener);
+    if (strncmp(address, "unix:", 5) == 0) {
+        unlink(address + 5);
+    }
+    if (stub.fd < 0) {
+        perror("GDB accept");
+        return -1;
+    }
+    
+    int nodelay = 1;
+    setsockopt(stub.fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    printf("GDB connected\n");
+    
+    // Record from here so the debugger can step and continue backwards
+    stub.reversible = replay_start(&stub.recording, cpu, GDB_REPLAY_INTERVAL) == 0;
+    if (!stub.reversible) {
+        printf("Reverse execution is off\n");
+    }
+    
+    while (read_packet(&stub, packet, sizeof(packet)) >= 0) {
+        TRACE_INST("gdb: %s\n", packet);
+        if (!handle_packet(&stub, packet)) {
+            break;
+        }
+    }
+    
+    close(stub.fd);
+    if (stub.reversible) {
+        replay_stop(&stub.recording, cpu);
+    }
+    printf("GDB disconnected\n");
+    return 0;
+}
@@ -0,0 +1,30 @@
+// gdbstub.h
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "cpu.h"
+
+// GDB remote serial protocol server for one CPU. Supports register and
+// memory access, single-step, continue, software breakpoints (Z0/z0,
+// planted in the predecode cache with cpu_set_breakpoint) and Ctrl-C,
+// and describes the registers with RV32 target XML.
+//
+// The session is recorded (replay.h) from the moment GDB connects, so
+// reverse-step and reverse-continue (bs/bc) work back to that point, or
+// to the last time the debugger changed registers, memory or the PC,
+// which starts the recording again. History is kept for the whole
+// session. Guard-page mode cannot be recorded and runs forwards only.
+//
+// Instruction and data memory are separate address spaces that both start
+// at 0. Memory packets go to instruction memory below inst_mem_size and
+// to data memory above it; "monitor mem inst|data|auto" picks one.
+//
+// address is "PORT" or "tcp:PORT" (listening on 127.0.0.1 only), or
+// "unix:PATH". Serves a single connection and returns 0 when the debugger
+// detaches or kills the target, or -1 if the socket cannot be set up.
+#define GDB_RUN_SLICE       65536   // Instructions between checks for Ctrl-C
+#define GDB_REPLAY_INTERVAL 65536   // Instructions between checkpoints
+
+int gdb_serve(CPU *cpu, const char *address);
+
+#endif
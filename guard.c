@@ -0,0 +1,188 @@
+// guard.c
+#define _GNU_SOURCE
+#include "guard.h"
+#include "trace.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#if UINTPTR_MAX > 0xFFFFFFFFu && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && (defined(__linux__) || defined(__APPLE__))
+#define GUARD_SUPPORTED 1
+#else
+#define GUARD_SUPPORTED 0
+#endif
+
+// The CPU whose faults this thread handles, and where to resume
+static __thread CPU *guard_cpu;
+static __thread sigjmp_buf *guard_env;
+
+#if GUARD_SUPPORTED
+
+static struct sigaction previous_action;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static int handler_installed;
+
+// Whether the faulting access was a store, when the host says so
+static int fault_is_write(void *context) {
+#if defined(__linux__) && defined(__x86_64__)
+    const ucontext_t *uc = context;
+    return (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#else
+    (void)context;
+    return 0;
+#endif
+}
+
+static void guard_handler(int sig, siginfo_t *info, void *context) {
+    CPU *cpu = guard_cpu;
+    uint8_t *fault = info->si_addr;
+    
+    if (cpu && guard_env) {
+        if (cpu->guard_data && fault >= cpu->guard_data &&
+            fault < cpu->guard_data + GUARD_RESERVATION_SIZE) {
+            uint32_t addr = (uint32_t)(fault - cpu->guard_data);
+            cpu_raise(cpu, fault_is_write(context) ? CPU_ERR_DATA_WRITE_OUT_OF_BOUNDS :
+                                                     CPU_ERR_DATA_READ_OUT_OF_BOUNDS, addr);
+            siglongjmp(*guard_env, 1);
+        }
+        if (cpu->guard_inst && fault >= cpu->inst_memory &&
+            fault < cpu->inst_memory + GUARD_RESERVATION_SIZE) {
+            cpu_raise(cpu, CPU_ERR_INST_OUT_OF_BOUNDS, (uint32_t)(fault - cpu->inst_memory));
+            siglongjmp(*guard_env, 1);
+        }
+    }
+    
+    // Not a guest access: let the previous disposition handle the fault
+    // when the instruction re-executes
+    (void)sig;
+    sigaction(SIGSEGV, &previous_action, NULL);
+}
+
+static void install_handler(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = guard_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    handler_installed = sigaction(SIGSEGV, &action, &previous_action) == 0;
+#ifdef __APPLE__
+    // Some macOS hosts report PROT_NONE faults as SIGBUS
+    sigaction(SIGBUS, &action, NULL);
+#endif
+}
+
+// Reserve 4 GiB with no access and open up the first size bytes
+static uint8_t *reserve(uint64_t size) {
+    void *base = mmap(NULL, GUARD_RESERVATION_SIZE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t open = (size_t)((size + page - 1) & ~(uint64_t)(page - 1));
+    if (open > 0 && mprotect(base, open, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, GUARD_RESERVATION_SIZE);
+        return NULL;
+    }
+    return base;
+}
+
+int cpu_enable_guard_memory(CPU *cpu) {
+    if (cpu->guard_data) {
+        return 0;
+    }
+    
+    pthread_once(&handler_once, install_handler);
+    if (!handler_installed) {
+        printf("Failed to install guard-page fault handler\n");
+        return -1;
+    }
+    
+    uint8_t *inst = reserve(cpu->inst_mem_size);
+    uint8_t *data = reserve(cpu->data_mem_size);
+    if (!inst || !data) {
+        printf("Failed to reserve guard-page memory\n");
+        if (inst) {
+            munmap(inst, GUARD_RESERVATION_SIZE);
+        }
+        if (data) {
+            munmap(data, GUARD_RESERVATION_SIZE);
+        }
+        return -1;
+    }
+    
+    // Move whatever instruction memory already holds
+    memcpy(inst, cpu->inst_memory, cpu->inst_mem_size);
+    munmap(cpu->inst_memory, cpu_memory_mapped_size(cpu->inst_mem_size));
+    cpu->inst_memory = inst;
+    cpu->guard_inst = 1;
+    
+    paged_clear(&cpu->data_memory);
+    cpu->guard_data = data;
+    return 0;
+}
+
+#else
+
+int cpu_enable_guard_memory(CPU *cpu) {
+    (void)cpu;
+    printf("Guard-page memory is not supported on this host\n");
+    return -1;
+}
+
+#endif
+
+void cpu_release_guard_memory(CPU *cpu) {
+    if (cpu->guard_inst) {
+        munmap(cpu->inst_memory, GUARD_RESERVATION_SIZE);
+        cpu->inst_memory = NULL;
+        cpu->guard_inst = 0;
+    }
+    if (cpu->guard_data) {
+        munmap(cpu->guard_data, GUARD_RESERVATION_SIZE);
+        cpu->guard_data = NULL;
+    }
+}
+
+void guard_arm(CPU *cpu, sigjmp_buf *env) {
+    guard_cpu = cpu;
+    guard_env = env;
+}
+
+void guard_disarm(void) {
+    guard_cpu = NULL;
+    guard_env = NULL;
+}
+
+CpuExitReason guard_run_budget(CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info) {
+    CPU *outer_cpu = guard_cpu;
+    sigjmp_buf *outer_env = guard_env;
+    uint64_t start = cpu->instruction_count;
+    sigjmp_buf env;
+    CpuExitInfo info;
+    
+    if (sigsetjmp(env, 0) == 0) {
+        guard_arm(cpu, &env);
+        cpu_run_budget(cpu, max_instructions, &info);
+    } else {
+        // The faulting access did not retire; the handler raised the error
+        info.reason = cpu_exit_reason(cpu);
+        info.executed = cpu->instruction_count - start;
+        info.pc = cpu->pc;
+        info.error = cpu->error;
+        info.addr = cpu->error_addr;
+    }
+    guard_cpu = outer_cpu;
+    guard_env = outer_env;
+    
+    if (exit_info) {
+        *exit_info = info;
+    }
+    return info.reason;
+}
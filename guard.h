@@ -0,0 +1,47 @@
+// guard.h
+#ifndef GUARD_H
+#define GUARD_H
+
+#include <setjmp.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Guard-page memory mode. Instruction and data memory each live at the
+// start of a 4 GiB PROT_NONE reservation, so every 32-bit guest address
+// lands inside it. Accessors skip their bounds checks and use native
+// little-endian loads and stores; an access past the end of memory faults,
+// and the SIGSEGV handler turns the fault into the same CpuError the
+// checked path raises.
+//
+// Alignment is still checked. Memory sizes are rounded up to whole host
+// pages. Snapshots need paged data memory and are unavailable in this mode.
+#define GUARD_RESERVATION_SIZE ((size_t)1 << 32)
+
+// Switch a freshly initialized CPU (nothing loaded yet) to guard-page
+// memory. Returns -1, leaving the checked path in place, on hosts that
+// cannot support it.
+int cpu_enable_guard_memory(CPU *cpu);
+void cpu_release_guard_memory(CPU *cpu);
+
+// Code that may touch guest memory in guard mode runs between
+// guard_arm() and guard_disarm() on the same thread, after a sigsetjmp on
+// env. A fault jumps back to env with the error raised on cpu:
+//
+//     sigjmp_buf env;
+//     if (sigsetjmp(env, 0) == 0) {
+//         guard_arm(cpu, &env);
+//         ... accesses ...
+//     }
+//     guard_disarm();
+void guard_arm(CPU *cpu, sigjmp_buf *env);
+void guard_disarm(void);
+
+// cpu_run_budget() armed for the length of the run: in guard mode a guest
+// fault stops it with the error raised and reported in exit_info, as on
+// the checked path. The engines store the retired count and PC before
+// anything that can touch guest memory, so instruction_count and
+// exit_info->executed agree with the checked path after a fault too. Any
+// guard already armed on this thread is put back.
+CpuExitReason guard_run_budget(CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info);
+
+#endif
@@ -0,0 +1,282 @@
+// jit.c
+#include "jit.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define JIT_X86_64 0
+#endif
+
+// Upper bounds on emitted bytes, used to check arena space up front
+#define JIT_MAX_OP_BYTES    24
+#define JIT_MAX_EDGE_BYTES  (JIT_NUM_HOST_REGS * 4)
+#define JIT_NUM_HOST_REGS   6
+
+#if JIT_X86_64
+
+// x86-64 register numbers
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+// Host registers guest registers may live in for the length of a block.
+// All are caller-saved in the System V ABI, so no prologue saves are
+// needed. RDI holds the guest register file; RCX and R11 are scratch.
+static const uint8_t host_regs[JIT_NUM_HOST_REGS] = { RAX, RDX, RSI, R8, R9, R10 };
+
+// Location of a guest register: a host register, or [rdi + 4*reg]
+typedef struct {
+    int in_reg;
+    uint8_t reg;        // Host register if in_reg
+    uint8_t disp;       // Offset into the register file otherwise
+} Operand;
+
+typedef struct {
+    uint8_t *code;
+    size_t pos;
+} Emitter;
+
+static void emit8(Emitter *e, uint8_t byte) {
+    e->code[e->pos++] = byte;
+}
+
+// Emit [REX] opcode ModRM [disp8] for a 32-bit "reg, r/m" form
+static void emit_rm(Emitter *e, const uint8_t *opcode, int opcode_len,
+                    uint8_t reg, Operand rm, int force_rex) {
+    uint8_t rex = 0x40;
+    if (reg & 8) rex |= 0x04;                       // REX.R
+    if (rm.in_reg && (rm.reg & 8)) rex |= 0x01;     // REX.B
+    if (rex != 0x40 || force_rex) {
+        emit8(e, rex);
+    }
+    
+    for (int n = 0; n < opcode_len; n++) {
+        emit8(e, opcode[n]);
+    }
+    
+    if (rm.in_reg) {
+        emit8(e, 0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+    } else {
+        emit8(e, 0x40 | ((reg & 7) << 3) | RDI);    // [rdi + disp8]
+        emit8(e, rm.disp);
+    }
+}
+
+static Operand host_operand(uint8_t reg) {
+    Operand op = { 1, reg, 0 };
+    return op;
+}
+
+static Operand memory_operand(uint32_t guest_reg) {
+    Operand op = { 0, 0, (uint8_t)(guest_reg * 4) };
+    return op;
+}
+
+// reg <- r/m
+static void emit_load(Emitter *e, uint8_t reg, Operand src) {
+    static const uint8_t mov[] = { 0x8B };
+    emit_rm(e, mov, 1, reg, src, 0);
+}
+
+// r/m <- reg
+static void emit_store(Emitter *e, Operand dst, uint8_t reg) {
+    static const uint8_t mov[] = { 0x89 };
+    emit_rm(e, mov, 1, reg, dst, 0);
+}
+
+// reg <- reg op r/m
+static void emit_alu(Emitter *e, uint8_t opcode, uint8_t reg, Operand src) {
+    emit_rm(e, &opcode, 1, reg, src, 0);
+}
+
+// r11d <- r11d shift cl
+static void emit_shift(Emitter *e, uint8_t ext) {
+    static const uint8_t shift[] = { 0xD3 };
+    emit_rm(e, shift, 1, ext, host_operand(R11), 0);
+}
+
+// r11b <- condition flag
+static void emit_setcc(Emitter *e, uint8_t cc) {
+    const uint8_t setcc[] = { 0x0F, cc };
+    emit_rm(e, setcc, 2, 0, host_operand(R11), 1);
+}
+
+int jit_available(void) {
+    return 1;
+}
+
+int jit_arena_init(JitArena *arena, size_t size) {
+    void *base = mmap(NULL, size, PROT_READ | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        printf("Failed to map JIT code arena\n");
+        arena->base = NULL;
+        arena->size = 0;
+        arena->used = 0;
+        return -1;
+    }
+    
+    arena->base = base;
+    arena->size = size;
+    arena->used = 0;
+    return 0;
+}
+
+void jit_arena_destroy(JitArena *arena) {
+    if (arena->base) {
+        munmap(arena->base, arena->size);
+        arena->base = NULL;
+    }
+}
+
+JitBlockFunc jit_compile_block(JitArena *arena, const Block *block) {
+    if (!arena->base || !jit_arena_has_room(arena, block)) {
+        return NULL;
+    }
+    
+    // Count uses of each guest register so the busiest ones get host registers
+    uint32_t uses[32] = { 0 };
+    uint32_t written = 0;
+    for (uint32_t n = 0; n < block->length; n++) {
+        const MicroOp *uop = &block->ops[n];
+        if (uop->op < OP_ADD || uop->op > OP_AND) {
+            return NULL;
+        }
+        if (uop->rd == 0) {
+            continue;   // No effect; skipped below
+        }
+        uses[uop->rd]++;
+        uses[uop->rs1]++;
+        uses[uop->rs2]++;
+        written |= 1u << uop->rd;
+    }
+    uses[0] = 0;        // x0 is read from the (always zero) register file
+    
+    Operand location[32];
+    int allocated[JIT_NUM_HOST_REGS];
+    int num_allocated = 0;
+    for (uint32_t r = 0; r < 32; r++) {
+        location[r] = memory_operand(r);
+    }
+    while (num_allocated < JIT_NUM_HOST_REGS) {
+        int best = 0;
+        for (int r = 1; r < 32; r++) {
+            if (uses[r] > uses[best]) best = r;
+        }
+        if (uses[best] == 0) {
+            break;
+        }
+        location[best] = host_operand(host_regs[num_allocated]);
+        allocated[num_allocated++] = best;
+        uses[best] = 0;
+    }
+    
+    if (mprotect(arena->base, arena->size, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+    
+    Emitter e = { arena->base + arena->used, 0 };
+    
+    // Block entry: load guest registers into their host registers
+    for (int n = 0; n < num_allocated; n++) {
+        emit_load(&e, location[allocated[n]].reg, memory_operand(allocated[n]));
+    }
+    
+    for (uint32_t n = 0; n < block->length; n++) {
+        const MicroOp *uop = &block->ops[n];
+        if (uop->rd == 0) {
+            continue;
+        }
+        
+        Operand a = location[uop->rs1];
+        Operand b = location[uop->rs2];
+        Operand d = location[uop->rd];
+        
+        switch (uop->op) {
+            case OP_ADD:
+            case OP_SUB:
+            case OP_XOR:
+            case OP_OR:
+            case OP_AND: {
+                uint8_t opcode = uop->op == OP_ADD ? 0x03 :
+                                 uop->op == OP_SUB ? 0x2B :
+                                 uop->op == OP_XOR ? 0x33 :
+                                 uop->op == OP_OR  ? 0x0B : 0x23;
+                emit_load(&e, R11, a);
+                emit_alu(&e, opcode, R11, b);
+                break;
+            }
+            
+            case OP_SLL:
+            case OP_SRL:
+            case OP_SRA:
+                // x86 masks 32-bit shift counts to 5 bits, as RV32I does
+                emit_load(&e, R11, a);
+                emit_load(&e, RCX, b);
+                emit_shift(&e, uop->op == OP_SLL ? 4 : uop->op == OP_SRL ? 5 : 7);
+                break;
+            
+            case OP_SLT:
+            case OP_SLTU:
+                emit_load(&e, RCX, a);
+                emit_alu(&e, 0x33, R11, host_operand(R11));     // xor r11d, r11d
+                emit_alu(&e, 0x3B, RCX, b);                     // cmp ecx, b
+                emit_setcc(&e, uop->op == OP_SLT ? 0x9C : 0x92); // setl / setb
+                break;
+        }
+        emit_store(&e, d, R11);
+    }
+    
+    // Block exit: write back guest registers the block modified
+    for (int n = 0; n < num_allocated; n++) {
+        if (written & (1u << allocated[n])) {
+            emit_store(&e, memory_operand(allocated[n]), location[allocated[n]].reg);
+        }
+    }
+    emit8(&e, 0xC3);    // ret
+    
+    JitBlockFunc func = (JitBlockFunc)(void *)(arena->base + arena->used);
+    arena->used += (e.pos + 15) & ~(size_t)15;
+    
+    mprotect(arena->base, arena->size, PROT_READ | PROT_EXEC);
+    return func;
+}
+
+#else
+
+int jit_available(void) {
+    return 0;
+}
+
+int jit_arena_init(JitArena *arena, size_t size) {
+    (void)size;
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    return -1;
+}
+
+void jit_arena_destroy(JitArena *arena) {
+    arena->base = NULL;
+}
+
+JitBlockFunc jit_compile_block(JitArena *arena, const Block *block) {
+    (void)arena;
+    (void)block;
+    return NULL;
+}
+
+#endif
+
+void jit_arena_reset(JitArena *arena) {
+    arena->used = 0;
+}
+
+int jit_arena_has_room(const JitArena *arena, const Block *block) {
+    size_t needed = 2 * JIT_MAX_EDGE_BYTES + block->length * JIT_MAX_OP_BYTES + 16;
+    return arena->used + needed <= arena->size;
+}
@@ -0,0 +1,36 @@
+// jit.h
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block.h"
+
+#define JIT_ARENA_SIZE (4u << 20)   // Default code arena size
+
+// Native code for one block; reads and writes the guest register file
+typedef void (*JitBlockFunc)(uint32_t *regs);
+
+// Executable code arena. Pages are writable only while code is being
+// emitted and executable otherwise (W^X).
+typedef struct JitArena {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} JitArena;
+
+// Non-zero if this host can run the x86-64 backend
+int jit_available(void);
+
+int jit_arena_init(JitArena *arena, size_t size);
+void jit_arena_destroy(JitArena *arena);
+void jit_arena_reset(JitArena *arena);
+
+// Non-zero if the arena can hold the translation of block
+int jit_arena_has_room(const JitArena *arena, const Block *block);
+
+// Translate a block to native code. Returns NULL if the block contains an
+// operation the backend cannot translate or the arena is full.
+JitBlockFunc jit_compile_block(JitArena *arena, const Block *block);
+
+#endif
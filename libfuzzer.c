@@ -0,0 +1,54 @@
+// libfuzzer.c
+// libFuzzer entry points. Guest edge coverage is exported as libFuzzer
+// extra counters; crashes abort so libFuzzer keeps the input. Run with
+// RISCV_FUZZ_PROGRAM=program [RISCV_FUZZ_BUDGET=n] ./riscv-libfuzzer corpus/
+#include <stdio.h>
+#include <stdlib.h>
+#include "elf.h"
+#include "fuzz.h"
+#include "trace.h"
+
+__attribute__((section("__libfuzzer_extra_counters")))
+static uint8_t coverage[FUZZ_MAP_SIZE];
+
+static CPU cpu;
+static ElfImage image;
+static FuzzTarget target;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    const char *program_path = getenv("RISCV_FUZZ_PROGRAM");
+    const char *budget = getenv("RISCV_FUZZ_BUDGET");
+    (void)argc;
+    (void)argv;
+    
+    if (!program_path) {
+        printf("Set RISCV_FUZZ_PROGRAM to the guest program to fuzz\n");
+        exit(1);
+    }
+    
+    trace_set_verbosity(TRACE_LEVEL_OFF);
+    cpu_init(&cpu, 64 * 1024, CPU_DATA_MEM_FULL);
+    if (elf_is_elf_file(program_path)) {
+        if (elf_load(&cpu, program_path, &image) != 0) {
+            exit(1);
+        }
+    } else if (cpu_load_inst_binary(&cpu, program_path) != 0) {
+        exit(1);
+    }
+    
+    if (fuzz_init(&target, &cpu, coverage, budget ? strtoull(budget, NULL, 0) : FUZZ_DEFAULT_BUDGET) != 0) {
+        exit(1);
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    CpuExitReason reason = fuzz_run(&target, data, size);
+    
+    if (reason == CPU_EXIT_ILLEGAL || reason == CPU_EXIT_MEMORY_FAULT) {
+        fprintf(stderr, "Guest crashed: %s at PC=0x%08x (0x%08x)\n",
+                cpu_error_string(cpu.error), cpu.pc, cpu.error_addr);
+        abort();
+    }
+    return 0;
+}
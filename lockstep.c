@@ -0,0 +1,256 @@
+// lockstep.c
+#include "lockstep.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LOCKSTEP_X86 1
+#include <immintrin.h>
+#else
+#define LOCKSTEP_X86 0
+#endif
+
+typedef uint32_t Lanes[LOCKSTEP_LANES];
+
+// Apply one operation to every lane: d = a op b
+typedef void (*LaneKernel)(Operation op, uint32_t *d, const uint32_t *a, const uint32_t *b);
+
+static void lanes_scalar(Operation op, uint32_t *d, const uint32_t *a, const uint32_t *b) {
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        uint32_t x = a[lane];
+        uint32_t y = b[lane];
+        uint32_t result;
+        
+        switch (op) {
+            case OP_ADD:  result = x + y; break;
+            case OP_SUB:  result = x - y; break;
+            case OP_SLL:  result = x << (y & 0x1F); break;
+            case OP_SLT:  result = (int32_t)x < (int32_t)y; break;
+            case OP_SLTU: result = x < y; break;
+            case OP_XOR:  result = x ^ y; break;
+            case OP_SRL:  result = x >> (y & 0x1F); break;
+            case OP_SRA:  result = (uint32_t)((int32_t)x >> (y & 0x1F)); break;
+            case OP_OR:   result = x | y; break;
+            case OP_AND:  result = x & y; break;
+            default:      result = d[lane]; break;
+        }
+        d[lane] = result;
+    }
+}
+
+#if LOCKSTEP_X86
+
+__attribute__((target("avx2")))
+static void lanes_avx2(Operation op, uint32_t *d, const uint32_t *a, const uint32_t *b) {
+    const __m256i shift_mask = _mm256_set1_epi32(0x1F);
+    const __m256i sign = _mm256_set1_epi32((int)0x80000000);
+    const __m256i one = _mm256_set1_epi32(1);
+    
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + lane));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + lane));
+        __m256i result;
+        
+        switch (op) {
+            case OP_ADD:  result = _mm256_add_epi32(x, y); break;
+            case OP_SUB:  result = _mm256_sub_epi32(x, y); break;
+            case OP_SLL:  result = _mm256_sllv_epi32(x, _mm256_and_si256(y, shift_mask)); break;
+            case OP_SRL:  result = _mm256_srlv_epi32(x, _mm256_and_si256(y, shift_mask)); break;
+            case OP_SRA:  result = _mm256_srav_epi32(x, _mm256_and_si256(y, shift_mask)); break;
+            case OP_XOR:  result = _mm256_xor_si256(x, y); break;
+            case OP_OR:   result = _mm256_or_si256(x, y); break;
+            case OP_AND:  result = _mm256_and_si256(x, y); break;
+            case OP_SLT:
+                result = _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one);
+                break;
+            case OP_SLTU:
+                // Unsigned compare via signed compare with the sign bits flipped
+                result = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_xor_si256(y, sign),
+                                                             _mm256_xor_si256(x, sign)), one);
+                break;
+            default:
+                result = _mm256_loadu_si256((const __m256i *)(d + lane));
+                break;
+        }
+        _mm256_storeu_si256((__m256i *)(d + lane), result);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void lanes_avx512(Operation op, uint32_t *d, const uint32_t *a, const uint32_t *b) {
+    __m512i x = _mm512_loadu_si512(a);
+    __m512i y = _mm512_loadu_si512(b);
+    __m512i shift = _mm512_and_si512(y, _mm512_set1_epi32(0x1F));
+    __m512i result;
+    
+    switch (op) {
+        case OP_ADD:  result = _mm512_add_epi32(x, y); break;
+        case OP_SUB:  result = _mm512_sub_epi32(x, y); break;
+        case OP_SLL:  result = _mm512_sllv_epi32(x, shift); break;
+        case OP_SRL:  result = _mm512_srlv_epi32(x, shift); break;
+        case OP_SRA:  result = _mm512_srav_epi32(x, shift); break;
+        case OP_XOR:  result = _mm512_xor_si512(x, y); break;
+        case OP_OR:   result = _mm512_or_si512(x, y); break;
+        case OP_AND:  result = _mm512_and_si512(x, y); break;
+        case OP_SLT:
+            result = _mm512_maskz_mov_epi32(_mm512_cmplt_epi32_mask(x, y), _mm512_set1_epi32(1));
+            break;
+        case OP_SLTU:
+            result = _mm512_maskz_mov_epi32(_mm512_cmplt_epu32_mask(x, y), _mm512_set1_epi32(1));
+            break;
+        default:
+            result = _mm512_loadu_si512(d);
+            break;
+    }
+    _mm512_storeu_si512(d, result);
+}
+
+#endif
+
+// Detected once; each group keeps its own selection, so concurrent
+// groups share nothing mutable
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+static LockstepIsa detected_isa = LOCKSTEP_ISA_SCALAR;
+
+static void detect(void) {
+#if LOCKSTEP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        detected_isa = LOCKSTEP_ISA_AVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        detected_isa = LOCKSTEP_ISA_AVX2;
+    }
+#endif
+}
+
+LockstepIsa lockstep_detect_isa(void) {
+    pthread_once(&detect_once, detect);
+    return detected_isa;
+}
+
+LockstepIsa lockstep_set_isa(LockstepHarts *harts, LockstepIsa isa) {
+    LockstepIsa best = lockstep_detect_isa();
+    
+    // AVX-512 hosts also support AVX2
+    if (isa > best) {
+        isa = best;
+    }
+    harts->isa = isa;
+    return isa;
+}
+
+static LaneKernel kernel_for(LockstepIsa isa) {
+    switch (isa) {
+#if LOCKSTEP_X86
+        case LOCKSTEP_ISA_AVX512: return lanes_avx512;
+        case LOCKSTEP_ISA_AVX2:   return lanes_avx2;
+#endif
+        default:                  return lanes_scalar;
+    }
+}
+
+const char *lockstep_isa_name(LockstepIsa isa) {
+    switch (isa) {
+        case LOCKSTEP_ISA_AVX2:   return "avx2";
+        case LOCKSTEP_ISA_AVX512: return "avx512";
+        default:                  return "scalar";
+    }
+}
+
+void lockstep_init(LockstepHarts *harts) {
+    memset(harts, 0, sizeof(*harts));
+    harts->error = CPU_OK;
+    harts->isa = lockstep_detect_isa();
+}
+
+void lockstep_set_reg(LockstepHarts *harts, int lane, int reg, uint32_t value) {
+    if (reg > 0 && reg < 32 && lane >= 0 && lane < LOCKSTEP_LANES) {
+        harts->regs[reg][lane] = value;
+    }
+}
+
+uint32_t lockstep_get_reg(const LockstepHarts *harts, int lane, int reg) {
+    if (reg <= 0 || reg >= 32 || lane < 0 || lane >= LOCKSTEP_LANES) {
+        return 0;
+    }
+    return harts->regs[reg][lane];
+}
+
+uint64_t lockstep_run(LockstepHarts *harts, CPU *cpu, uint64_t max_instructions) {
+    uint64_t executed = 0;
+    uint32_t pc = harts->pc;
+    LaneKernel kernel = kernel_for(harts->isa);
+    
+    // Every lane runs the same word, so lanes can only stop together;
+    // there is no per-lane control flow in the supported instructions.
+    while (!harts->halted && executed < max_instructions) {
+        // Checked here so a bad PC faults the harts, not the CPU
+        if (pc + 3 >= cpu->inst_mem_size || pc % 4 != 0) {
+            harts->error = pc + 3 >= cpu->inst_mem_size ? CPU_ERR_INST_OUT_OF_BOUNDS : CPU_ERR_INST_MISALIGNED;
+            harts->halted = 1;
+            break;
+        }
+        
+        Instruction *inst = cpu_decode_at(cpu, pc);
+        if (inst->op == OP_HALT) {
+            harts->halted = 1;
+            break;
+        }
+        // Harts have no breakpoint exit or syscalls, so EBREAK and ECALL stop them as illegal
+        if (inst->op == OP_ILLEGAL || inst->op == OP_EBREAK || inst->op == OP_ECALL) {
+            harts->error = CPU_ERR_ILLEGAL_INSTRUCTION;
+            harts->halted = 1;
+            break;
+        }
+        
+        if (inst->rd != 0) {
+            kernel(inst->op, harts->regs[inst->rd], harts->regs[inst->rs1], harts->regs[inst->rs2]);
+        }
+        pc += 4;
+        executed++;
+    }
+    
+    harts->pc = pc;
+    harts->instruction_count += executed;
+    return executed;
+}
+
+// Reference run of one lane on its own CPU
+static void run_scalar_lane(CPU *scalar, const LockstepHarts *initial, int lane,
+                            uint64_t max_instructions) {
+    cpu_reset(scalar);
+    scalar->pc = initial->pc;
+    for (int r = 1; r < 32; r++) {
+        scalar->regs[r] = initial->regs[r][lane];
+    }
+    
+    cpu_run_reference(scalar, max_instructions);
+}
+
+int lockstep_check_scalar(const LockstepHarts *initial, CPU *cpu, uint64_t max_instructions) {
+    LockstepHarts harts = *initial;
+    CPU scalar;
+    int mismatches = 0;
+    
+    lockstep_run(&harts, cpu, max_instructions);
+    
+    cpu_init(&scalar, cpu->inst_mem_size, 4);
+    memcpy(scalar.inst_memory, cpu->inst_memory, cpu->inst_mem_size);
+    
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        run_scalar_lane(&scalar, initial, lane, max_instructions);
+        
+        int differs = scalar.pc != harts.pc ||
+                      scalar.instruction_count != harts.instruction_count - initial->instruction_count ||
+                      scalar.error != harts.error;
+        for (int r = 0; r < 32; r++) {
+            if (scalar.regs[r] != harts.regs[r][lane]) {
+                differs = 1;
+            }
+        }
+        mismatches += differs;
+    }
+    
+    cpu_destroy(&scalar);
+    return mismatches;
+}
@@ -0,0 +1,51 @@
+// lockstep.h
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define LOCKSTEP_LANES 16   // Harts executed together
+
+// Vector instruction set used for lockstep execution
+typedef enum {
+    LOCKSTEP_ISA_SCALAR,
+    LOCKSTEP_ISA_AVX2,      // Two 8-lane vectors per operation
+    LOCKSTEP_ISA_AVX512     // One 16-lane vector per operation
+} LockstepIsa;
+
+// Register files of LOCKSTEP_LANES harts running the same instruction
+// stream, stored structure-of-arrays so one register across all lanes is
+// contiguous. Instructions come from a CPU's instruction memory.
+typedef struct {
+    uint32_t regs[32][LOCKSTEP_LANES];
+    uint32_t pc;                    // Shared by all lanes
+    int halted;
+    CpuError error;
+    uint64_t instruction_count;     // Per lane
+    LockstepIsa isa;                // Vector kernel this group runs with
+} LockstepHarts;
+
+void lockstep_init(LockstepHarts *harts);
+void lockstep_set_reg(LockstepHarts *harts, int lane, int reg, uint32_t value);
+uint32_t lockstep_get_reg(const LockstepHarts *harts, int lane, int reg);
+
+// Best instruction set this host supports; lockstep_init selects it
+LockstepIsa lockstep_detect_isa(void);
+const char *lockstep_isa_name(LockstepIsa isa);
+
+// Force an instruction set for one group (e.g. scalar, for comparison).
+// Falls back to the best supported one if the host lacks it. Returns the
+// one selected.
+LockstepIsa lockstep_set_isa(LockstepHarts *harts, LockstepIsa isa);
+
+// Run all lanes from harts->pc over cpu's instructions until halt or
+// max_instructions per lane. Returns the instructions executed per lane.
+uint64_t lockstep_run(LockstepHarts *harts, CPU *cpu, uint64_t max_instructions);
+
+// Differential check: run each lane of initial separately through
+// execute_instruction and compare with a lockstep run of all lanes.
+// Returns the number of lanes whose final state differs.
+int lockstep_check_scalar(const LockstepHarts *initial, CPU *cpu, uint64_t max_instructions);
+
+#endif
@@ -1,17 +1,79 @@
 // main.c
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "cpu.h"
 #include "decode.h"
 #include "execute.h"
+#include "threaded.h"
+#include "block.h"
+#include "trace.h"
+#include "tracebuf.h"
+#include "elf.h"
+#include "guard.h"
+#include "profile.h"
+#include "pipeline.h"
+#include "cachesim.h"
+#include "gdbstub.h"
+#include "mmio.h"
+#include "uart.h"
+#include "syscalls.h"
+#include <unistd.h>
 
-int main() {
-    CPU cpu;
-    
-    // Initialize CPU
-    printf("Initializing CPU...\n");
-    cpu_init(&cpu, 64 * 1024, 64 * 1024);
+static void usage(const char *prog) {
+    printf("Usage: %s [-v level] [-t trace-file] [-b instructions] [-m bytes] [-d bytes] [-g] [-p text|json] [-T none|mem|full] [-C caches] [-G address] [-U] [-L] [program]\n", prog);
+    printf("  -v level   Trace verbosity: 0 off, 1 errors, 2 per-instruction\n");
+    printf("  -t file    Write a binary execution trace (decode with tracedump)\n");
+    printf("  -b count   Instruction budget (default: run until the program stops)\n");
+    printf("  -m bytes   Size of instruction memory (default 64 KiB)\n");
+    printf("  -d bytes   Size of data memory (default: the full 4 GiB, allocated sparsely)\n");
+    printf("  -g         Guard-page memory: no per-access bounds checks\n");
+    printf("  -p format  Profile execution and print a text or JSON report\n");
+    printf("  -T forward Time execution on a 5-stage pipeline with the given forwarding\n");
+    printf("  -C caches  Simulate caches: default, or i=,d=,l2= size:ways:line[:lru|plru|random[:wb|wt]]\n");
+    printf("  -G address Serve GDB on PORT, tcp:PORT (localhost) or unix:PATH instead of running\n");
+    printf("  -U         Map a 16550 UART at 0x%08x with output to stdout\n", UART_DEFAULT_BASE);
+    printf("  -L         Emulate Linux syscalls on ECALL (files, brk, mmap, clocks, exit)\n");
+    printf("  program    RV32 ELF executable or flat binary (default: built-in demo)\n");
+}
+
+// Parse -C: "default", or a comma-separated list of i=, d= and l2= levels
+static int parse_cache_spec(const char *spec, CacheConfig *icache, CacheConfig *dcache,
+                            CacheConfig *l2, int *has_l2) {
+    cachesim_config_default(icache, dcache);
+    *has_l2 = 0;
+    if (strcmp(spec, "default") == 0) {
+        return 0;
+    }
     
+    while (*spec) {
+        CacheConfig *level;
+        if (strncmp(spec, "i=", 2) == 0) {
+            level = icache;
+            spec += 2;
+        } else if (strncmp(spec, "d=", 2) == 0) {
+            level = dcache;
+            spec += 2;
+        } else if (strncmp(spec, "l2=", 3) == 0) {
+            level = l2;
+            *has_l2 = 1;
+            spec += 3;
+        } else {
+            return -1;
+        }
+        if (cachesim_parse_config(spec, level) != 0) {
+            return -1;
+        }
+        spec += strcspn(spec, ",");
+        if (*spec == ',') {
+            spec++;
+        }
+    }
+    return 0;
+}
+
+// Built-in R-type test program with preset register values
+static void load_demo_program(CPU *cpu) {
     // Comprehensive R-type test program
     uint32_t program[] = {
         // Test ADD with different registers
@@ -69,64 +131,341 @@ int main() {
     
     // Load program into instruction memory
     printf("\nLoading program into instruction memory...\n");
-    cpu_load_inst_program(&cpu, program, sizeof(program)/sizeof(uint32_t));
+    cpu_load_inst_program(cpu, program, sizeof(program)/sizeof(uint32_t));
     
     // Pre-load test values into registers
     printf("\nPre-loading test values:\n");
-    cpu_set_reg(&cpu, 2, 20);       // x2 = 20
-    cpu_set_reg(&cpu, 3, 15);       // x3 = 15
-    cpu_set_reg(&cpu, 4, 8);        // x4 = 8
-    cpu_set_reg(&cpu, 5, -10);      // x5 = -10 
-    cpu_set_reg(&cpu, 6, 0xFF);     // x6 = 255
-    cpu_set_reg(&cpu, 31, 0x80000); // x31 = 524288
+    cpu_set_reg(cpu, 2, 20);       // x2 = 20
+    cpu_set_reg(cpu, 3, 15);       // x3 = 15
+    cpu_set_reg(cpu, 4, 8);        // x4 = 8
+    cpu_set_reg(cpu, 5, -10);      // x5 = -10 
+    cpu_set_reg(cpu, 6, 0xFF);     // x6 = 255
+    cpu_set_reg(cpu, 31, 0x80000); // x31 = 524288
     
     printf("Initial register values:\n");
 
     printf("x2=%d, x3=%d, x4=%d, x5=%d, x6=%d, x31=%d\n", 
-           cpu_get_reg(&cpu, 2), cpu_get_reg(&cpu, 3), 
-           cpu_get_reg(&cpu, 4), (int32_t)cpu_get_reg(&cpu, 5), 
-           cpu_get_reg(&cpu, 6), cpu_get_reg(&cpu, 31));
+           cpu_get_reg(cpu, 2), cpu_get_reg(cpu, 3), 
+           cpu_get_reg(cpu, 4), (int32_t)cpu_get_reg(cpu, 5), 
+           cpu_get_reg(cpu, 6), cpu_get_reg(cpu, 31));
+}
+
+// Run the loaded program on the engine selected at build time for up to
+// budget instructions. pipeline, if not NULL, times the run on the
+// reference interpreter.
+static void run_program(CPU *cpu, PipelineModel *pipeline, uint64_t budget) {
+#if defined(USE_BLOCK_CACHE)
+    // Basic-block translation cache, selected at build time (-DUSE_BLOCK_CACHE)
+    BlockCache blocks;
+    block_cache_init(&blocks);
+#ifdef USE_JIT
+    // Compile blocks to native code (-DUSE_JIT), if the host supports it
+    block_cache_enable_jit(&blocks, BLOCK_JIT_DEFAULT_THRESHOLD);
+#endif
+    block_run(&blocks, cpu, budget);
+    block_cache_destroy(&blocks);
+    
+    if (cpu_should_halt(cpu)) {
+        printf("\nHALT\n");
+    } else {
+        printf("Instruction limit reached\n");
+    }
+#else
+#if defined(USE_THREADED_DISPATCH)
+    // Threaded-code core with fusion, selected at build time (-DUSE_THREADED_DISPATCH)
+    cpu_set_fusion(cpu, 1);
+#endif
+    CpuExitInfo exit_info;
+    if (pipeline) {
+        exit_info.executed = pipeline_run(pipeline, cpu, budget);
+        exit_info.reason = cpu_exit_reason(cpu);
+        exit_info.pc = cpu_get_pc(cpu);
+        exit_info.error = cpu_get_error(cpu);
+        exit_info.addr = cpu_get_error_addr(cpu);
+    } else {
+        cpu_run_budget(cpu, budget, &exit_info);
+    }
+    
+    switch (exit_info.reason) {
+        case CPU_EXIT_HALT:
+            printf("\nHALT\n");
+            break;
+        case CPU_EXIT_BUDGET:
+            printf("Instruction limit reached\n");
+            break;
+        case CPU_EXIT_BREAKPOINT:
+            printf("\nBreakpoint at 0x%08x\n", exit_info.pc);
+            break;
+        default:
+            break;      // Reported with the final state
+    }
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    CPU cpu;
+    const char *trace_path = NULL;
+    const char *program_path = NULL;
+    unsigned int mem_size = 64 * 1024;
+    uint64_t data_size = CPU_DATA_MEM_FULL;
+    uint64_t budget = UINT64_MAX;
+    TraceBuffer trace;
+    ElfImage image;
+    int have_image = 0;
+    int guard = 0;
+    const char *profile_format = NULL;
+    Profile profile;
+    const char *timing_mode = NULL;
+    PipelineModel pipeline;
+    const char *cache_spec = NULL;
+    CacheHierarchy caches;
+    const char *gdb_address = NULL;
+    int use_uart = 0;
+    static Uart uart;
+    MmioBus bus;
+    int use_syscalls = 0;
+    Syscalls syscalls;
+    
+    // Parse options
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-v") == 0 && arg + 1 < argc) {
+            trace_set_verbosity(atoi(argv[++arg]));
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            trace_path = argv[++arg];
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            budget = strtoull(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            mem_size = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+            data_size = strtoull(argv[++arg], NULL, 0);
+            if (data_size > CPU_DATA_MEM_FULL) {
+                data_size = CPU_DATA_MEM_FULL;
+            }
+        } else if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+            profile_format = argv[++arg];
+        } else if (strcmp(argv[arg], "-T") == 0 && arg + 1 < argc) {
+            timing_mode = argv[++arg];
+        } else if (strcmp(argv[arg], "-C") == 0 && arg + 1 < argc) {
+            cache_spec = argv[++arg];
+        } else if (strcmp(argv[arg], "-G") == 0 && arg + 1 < argc) {
+            gdb_address = argv[++arg];
+        } else if (strcmp(argv[arg], "-U") == 0) {
+            use_uart = 1;
+        } else if (strcmp(argv[arg], "-L") == 0) {
+            use_syscalls = 1;
+        } else if (strcmp(argv[arg], "-g") == 0) {
+            guard = 1;
+        } else if (argv[arg][0] != '-' && !program_path) {
+            program_path = argv[arg];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    // Initialize CPU
+    printf("Initializing CPU...\n");
+    cpu_init(&cpu, mem_size, data_size);
+    if (guard && cpu_enable_guard_memory(&cpu) != 0) {
+        printf("Falling back to checked memory accesses\n");
+    }
+    
+    // Load the program: an ELF image, a flat binary, or the built-in demo
+    if (program_path && elf_is_elf_file(program_path)) {
+        if (elf_load(&cpu, program_path, &image) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        have_image = 1;
+    } else if (program_path) {
+        if (cpu_load_inst_binary(&cpu, program_path) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+    } else {
+        load_demo_program(&cpu);
+    }
+    
+    // Devices go on data pages the program has not loaded anything into
+    if (use_uart) {
+        mmio_init(&bus);
+        uart_init(&uart, UART_DEFAULT_BASE, STDOUT_FILENO);
+        if (mmio_map(&bus, &cpu, &uart.device) != 0) {
+            mmio_destroy(&bus);
+            cpu_destroy(&cpu);
+            return 1;
+        }
+    }
+    
+    // The heap starts after the ELF's data segments
+    if (use_syscalls) {
+        uint32_t brk_base = have_image && image.data_end ? image.data_end : SYSCALL_DEFAULT_BRK;
+        syscall_init(&syscalls, &cpu, brk_base);
+    }
     
     // Show loaded instructions
     printf("\nFirst few instructions:\n");
-    cpu_dump_inst_memory(&cpu, 0, 40);
+    cpu_dump_inst_memory(&cpu, cpu_get_pc(&cpu), 40);
+    
+    // Binary tracing hooks the reference interpreter only
+    if (trace_path) {
+#if defined(USE_BLOCK_CACHE) || defined(USE_THREADED_DISPATCH)
+        printf("Binary tracing needs the reference interpreter; ignoring -t\n");
+        trace_path = NULL;
+#else
+        if (tracebuf_open(&trace, trace_path, TRACEBUF_DEFAULT_CAPACITY_LOG2) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        cpu.trace = &trace;
+#endif
+    }
+    
+    // Profiling hooks the reference interpreter and the threaded core
+    if (profile_format) {
+#if defined(USE_BLOCK_CACHE)
+        printf("Profiling needs the reference or threaded engine; ignoring -p\n");
+        profile_format = NULL;
+#else
+        if (profile_init(&profile, cpu.inst_mem_size) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        cpu.profile = &profile;
+#endif
+    }
+    
+    // Cache simulation sees the fetches of the reference interpreter
+    if (cache_spec) {
+        CacheConfig icache, dcache, l2;
+        int has_l2;
+        if (parse_cache_spec(cache_spec, &icache, &dcache, &l2, &has_l2) != 0) {
+            printf("Bad cache spec: %s\n", cache_spec);
+            usage(argv[0]);
+            cpu_destroy(&cpu);
+            return 1;
+        }
+#if defined(USE_BLOCK_CACHE) || defined(USE_THREADED_DISPATCH)
+        printf("Cache simulation needs the reference interpreter; ignoring -C\n");
+        cache_spec = NULL;
+#else
+        if (cachesim_init(&caches, &icache, &dcache, has_l2 ? &l2 : NULL, cpu.inst_mem_size) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        cpu.caches = &caches;
+#endif
+    }
+    
+    // The timing model drives the reference interpreter itself
+    if (timing_mode) {
+#if defined(USE_BLOCK_CACHE) || defined(USE_THREADED_DISPATCH)
+        printf("Pipeline timing needs the reference interpreter; ignoring -T\n");
+        timing_mode = NULL;
+#else
+        PipelineConfig config;
+        pipeline_config_default(&config);
+        if (strcmp(timing_mode, "none") == 0) {
+            config.forwarding = FORWARD_NONE;
+        } else if (strcmp(timing_mode, "mem") == 0) {
+            config.forwarding = FORWARD_MEM;
+        }
+        if (pipeline_init(&pipeline, &config, cpu.inst_mem_size) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+#endif
+    }
     
     printf("\n=== Executing ===\n\n");
+    fflush(stdout);     // UART output bypasses stdio
     
-    // Execute instructions
-    while (!cpu_should_halt(&cpu)) {
-        // Fetch
-        uint32_t inst = cpu_fetch_instruction(&cpu);
-        
-        
-        if (inst == 0x00000000) {
-            printf("\nHALT\n");
-            cpu_halt(&cpu);
-            break;
+    // Execute instructions, or hand control to a debugger
+    if (gdb_address) {
+        if (gdb_serve(&cpu, gdb_address) != 0) {
+            printf("Could not start the GDB stub on %s\n", gdb_address);
         }
-        
-        // Decode
-        Instruction decoded;
-        decode_instruction(inst, &decoded);
-        
-        // Execute
-        execute_instruction(&cpu, &decoded);
-        
-        // Increment instruction count
-        cpu.instruction_count++;
-        
-        
-        if (cpu.instruction_count > 50) {
-            printf("Instruction limit reached\n");
-            break;
+    } else {
+        // In guard mode a guest fault jumps back here with the error raised
+        sigjmp_buf guard_env;
+        if (sigsetjmp(guard_env, 0) == 0) {
+            guard_arm(&cpu, &guard_env);
+            run_program(&cpu, timing_mode ? &pipeline : NULL, budget);
         }
+        guard_disarm();
+    }
+    
+    if (trace_path) {
+        tracebuf_close(&trace);
+        cpu.trace = NULL;
+        printf("Wrote %llu trace records (%llu bytes) to %s\n",
+               (unsigned long long)trace.records_written,
+               (unsigned long long)trace.bytes_written, trace_path);
+    }
+    
+    if (use_uart) {
+        uart_flush(&uart);
     }
     
     // Show results
     printf("\n=== Final State ===\n");
     cpu_dump_registers(&cpu);
     
+#if defined(USE_THREADED_DISPATCH) && !defined(USE_BLOCK_CACHE)
+    printf("Fused pairs:");
+    for (int fusion = FUSE_NONE + 1; fusion < FUSE_COUNT; fusion++) {
+        printf(" %s=%llu", get_fusion_name((Fusion)fusion),
+               (unsigned long long)cpu_get_fusion_hits(&cpu, (Fusion)fusion));
+    }
+    printf("\n");
+#endif
+    
+    if (cpu_get_error(&cpu) != CPU_OK) {
+        printf("Stopped on error: %s (0x%08x)\n",
+               cpu_error_string(cpu_get_error(&cpu)), cpu_get_error_addr(&cpu));
+    }
+    
+    if (profile_format) {
+        ElfImage *symbols = have_image ? &image : NULL;
+        if (strcmp(profile_format, "json") == 0) {
+            profile_report_json(&profile, symbols, 10);
+        } else {
+            profile_report_text(&profile, symbols, 10);
+        }
+        cpu.profile = NULL;
+        profile_destroy(&profile);
+    }
+    
+    if (timing_mode) {
+        pipeline_report(&pipeline, 10);
+        pipeline_destroy(&pipeline);
+    }
+    
+    if (cache_spec) {
+        cachesim_report(&caches, 10);
+        cpu.caches = NULL;
+        cachesim_destroy(&caches);
+    }
+    
+    if (use_uart) {
+        printf("UART: %llu bytes sent in %llu writes\n",
+               (unsigned long long)uart.tx_bytes, (unsigned long long)uart.tx_writes);
+        cpu.bus = NULL;
+        mmio_destroy(&bus);
+    }
+    
+    if (use_syscalls) {
+        if (syscalls.exited) {
+            printf("Exited with status %d after %llu syscalls\n", syscalls.exit_code,
+                   (unsigned long long)syscalls.calls);
+        }
+        syscall_destroy(&syscalls, &cpu);
+    }
+    
     // Clean up
+    if (have_image) {
+        elf_image_destroy(&image);
+    }
     cpu_destroy(&cpu);
     
     return 0;
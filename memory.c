@@ -0,0 +1,413 @@
+// memory.c
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static uint32_t l1_index(uint32_t addr) {
+    return addr >> (MEM_PAGE_SHIFT + MEM_L2_BITS);
+}
+
+static uint32_t l2_index(uint32_t addr) {
+    return (addr >> MEM_PAGE_SHIFT) & (MEM_L2_ENTRIES - 1);
+}
+
+static int is_external(const PageTable *table, uint32_t index) {
+    return (table->external[index / 32] >> (index % 32)) & 1;
+}
+
+static int is_shared(const PageTable *table, uint32_t index) {
+    return (table->shared[index / 32] >> (index % 32)) & 1;
+}
+
+static int is_reserved(const PageTable *table, uint32_t index) {
+    return (table->reserved[index / 32] >> (index % 32)) & 1;
+}
+
+static void set_bit(uint32_t *bits, uint32_t index, int value) {
+    if (value) {
+        bits[index / 32] |= 1u << (index % 32);
+    } else {
+        bits[index / 32] &= ~(1u << (index % 32));
+    }
+}
+
+// A page from the spare list, or a new one. Zeroed only if asked.
+static uint8_t *page_alloc(PagedMemory *mem, int zero) {
+    if (mem->spare_count > 0) {
+        uint8_t *page = mem->spare[--mem->spare_count];
+        if (zero) {
+            memset(page, 0, MEM_PAGE_SIZE);
+        }
+        return page;
+    }
+    return zero ? calloc(1, MEM_PAGE_SIZE) : malloc(MEM_PAGE_SIZE);
+}
+
+// Keep a page restore dropped for the next write that needs one
+static void page_release(PagedMemory *mem, uint8_t *page) {
+    if (mem->spare_count == mem->spare_capacity) {
+        size_t capacity = mem->spare_capacity ? mem->spare_capacity * 2 : 64;
+        uint8_t **spare = realloc(mem->spare, capacity * sizeof(uint8_t *));
+        if (!spare) {
+            free(page);
+            return;
+        }
+        mem->spare = spare;
+        mem->spare_capacity = capacity;
+    }
+    mem->spare[mem->spare_count++] = page;
+}
+
+// Remember what a page held at snapshot time before it is first replaced
+static int record_dirty(PagedMemory *mem, PageTable *table, uint32_t addr) {
+    if (mem->dirty_count == mem->dirty_capacity) {
+        size_t capacity = mem->dirty_capacity ? mem->dirty_capacity * 2 : 64;
+        DirtyPage *dirty = realloc(mem->dirty, capacity * sizeof(DirtyPage));
+        if (!dirty) {
+            return -1;
+        }
+        mem->dirty = dirty;
+        mem->dirty_capacity = capacity;
+    }
+    
+    uint32_t index = l2_index(addr);
+    DirtyPage *entry = &mem->dirty[mem->dirty_count++];
+    entry->page = addr >> MEM_PAGE_SHIFT;
+    entry->original = table->pages[index];
+    entry->original_external = table->pages[index] && is_external(table, index);
+    return 0;
+}
+
+void paged_init(PagedMemory *mem) {
+    memset(mem, 0, sizeof(*mem));
+    mem->cached_page = MEM_NO_PAGE;
+}
+
+void paged_clear(PagedMemory *mem) {
+    paged_release_snapshot(mem);
+    free(mem->dirty);
+    mem->dirty = NULL;
+    mem->dirty_capacity = 0;
+    
+    while (mem->spare_count > 0) {
+        free(mem->spare[--mem->spare_count]);
+    }
+    free(mem->spare);
+    mem->spare = NULL;
+    mem->spare_capacity = 0;
+    
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        PageTable *table = mem->tables[t];
+        if (!table) {
+            continue;
+        }
+        for (uint32_t p = 0; p < MEM_L2_ENTRIES; p++) {
+            if (table->pages[p] && !is_external(table, p)) {
+                free(table->pages[p]);
+            }
+        }
+        free(table);
+        mem->tables[t] = NULL;
+    }
+    
+    for (size_t m = 0; m < mem->mapping_count; m++) {
+        munmap(mem->mappings[m].addr, mem->mappings[m].length);
+    }
+    free(mem->mappings);
+    mem->mappings = NULL;
+    mem->mapping_count = 0;
+    
+    mem->pages_allocated = 0;
+    mem->cached_page = MEM_NO_PAGE;
+    mem->cached_host = NULL;
+    mem->cached_writable = 0;
+}
+
+void paged_destroy(PagedMemory *mem) {
+    paged_clear(mem);
+}
+
+uint8_t *paged_lookup(PagedMemory *mem, uint32_t addr) {
+    PageTable *table = mem->tables[l1_index(addr)];
+    if (!table) {
+        return NULL;
+    }
+    
+    uint32_t index = l2_index(addr);
+    uint8_t *page = table->pages[index];
+    if (page) {
+        mem->cached_page = addr >> MEM_PAGE_SHIFT;
+        mem->cached_host = page;
+        mem->cached_writable = !is_shared(table, index);
+    }
+    return page;
+}
+
+uint8_t *paged_lookup_write(PagedMemory *mem, uint32_t addr) {
+    PageTable **slot = &mem->tables[l1_index(addr)];
+    if (!*slot) {
+        *slot = calloc(1, sizeof(PageTable));
+        if (!*slot) {
+            return NULL;
+        }
+    }
+    
+    PageTable *table = *slot;
+    uint32_t index = l2_index(addr);
+    uint8_t **page = &table->pages[index];
+    if (!*page && is_reserved(table, index)) {
+        return NULL;
+    }
+    if (!*page || is_shared(table, index)) {
+        // New pages and first writes to snapshot pages are recorded for restore
+        if (mem->tracking && record_dirty(mem, table, addr) != 0) {
+            return NULL;
+        }
+        uint8_t *fresh = page_alloc(mem, !*page);
+        if (!fresh) {
+            if (mem->tracking) {
+                mem->dirty_count--;
+            }
+            return NULL;
+        }
+        if (*page) {
+            memcpy(fresh, *page, MEM_PAGE_SIZE);
+        }
+        *page = fresh;
+        set_bit(table->shared, index, 0);
+        set_bit(table->external, index, 0);
+        mem->pages_allocated++;
+    }
+    
+    mem->cached_page = addr >> MEM_PAGE_SHIFT;
+    mem->cached_host = *page;
+    mem->cached_writable = 1;
+    return *page;
+}
+
+int paged_reserve(PagedMemory *mem, uint32_t addr) {
+    PageTable **slot = &mem->tables[l1_index(addr)];
+    if (!*slot) {
+        *slot = calloc(1, sizeof(PageTable));
+        if (!*slot) {
+            return -1;
+        }
+    }
+    
+    uint32_t index = l2_index(addr);
+    if ((*slot)->pages[index]) {
+        return -1;
+    }
+    set_bit((*slot)->reserved, index, 1);
+    return 0;
+}
+
+int paged_map_external(PagedMemory *mem, uint32_t addr, uint8_t *host) {
+    PageTable **slot = &mem->tables[l1_index(addr)];
+    if (!*slot) {
+        *slot = calloc(1, sizeof(PageTable));
+        if (!*slot) {
+            return -1;
+        }
+    }
+    
+    uint32_t index = l2_index(addr);
+    PageTable *table = *slot;
+    if (!table->pages[index] || is_shared(table, index)) {
+        // The snapshot keeps whatever was here
+        if (mem->tracking && record_dirty(mem, table, addr) != 0) {
+            return -1;
+        }
+    } else if (!is_external(table, index)) {
+        free(table->pages[index]);
+        mem->pages_allocated--;
+    }
+    table->pages[index] = host;
+    set_bit(table->shared, index, 0);
+    set_bit(table->external, index, 1);
+    
+    if ((addr >> MEM_PAGE_SHIFT) == mem->cached_page) {
+        mem->cached_page = MEM_NO_PAGE;
+    }
+    return 0;
+}
+
+int paged_add_mapping(PagedMemory *mem, void *addr, size_t length) {
+    HostMapping *mappings = realloc(mem->mappings, (mem->mapping_count + 1) * sizeof(HostMapping));
+    if (!mappings) {
+        return -1;
+    }
+    mem->mappings = mappings;
+    mem->mappings[mem->mapping_count].addr = addr;
+    mem->mappings[mem->mapping_count].length = length;
+    mem->mapping_count++;
+    return 0;
+}
+
+void paged_snapshot(PagedMemory *mem) {
+    paged_release_snapshot(mem);
+    
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        if (mem->tables[t]) {
+            memset(mem->tables[t]->shared, 0xFF, sizeof(mem->tables[t]->shared));
+        }
+    }
+    mem->tracking = 1;
+    mem->cached_page = MEM_NO_PAGE;
+}
+
+void paged_restore(PagedMemory *mem) {
+    if (!mem->tracking) {
+        return;
+    }
+    
+    // Newest first, so each page ends up as it was at the snapshot
+    while (mem->dirty_count > 0) {
+        DirtyPage *entry = &mem->dirty[--mem->dirty_count];
+        uint32_t addr = entry->page << MEM_PAGE_SHIFT;
+        PageTable *table = mem->tables[l1_index(addr)];
+        uint32_t index = l2_index(addr);
+        
+        if (table->pages[index] && !is_external(table, index) && !is_shared(table, index)) {
+            page_release(mem, table->pages[index]);
+            mem->pages_allocated--;
+        }
+        table->pages[index] = entry->original;
+        set_bit(table->external, index, entry->original_external);
+        set_bit(table->shared, index, 1);
+    }
+    mem->cached_page = MEM_NO_PAGE;
+}
+
+void paged_release_snapshot(PagedMemory *mem) {
+    if (!mem->tracking) {
+        return;
+    }
+    
+    // Originals that were replaced are no longer reachable from the tables
+    for (size_t n = 0; n < mem->dirty_count; n++) {
+        if (mem->dirty[n].original && !mem->dirty[n].original_external) {
+            free(mem->dirty[n].original);
+            mem->pages_allocated--;
+        }
+    }
+    mem->dirty_count = 0;
+    
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        if (mem->tables[t]) {
+            memset(mem->tables[t]->shared, 0, sizeof(mem->tables[t]->shared));
+        }
+    }
+    mem->tracking = 0;
+    mem->cached_page = MEM_NO_PAGE;
+}
+
+int paged_write(PagedMemory *mem, uint32_t addr, const void *src, size_t length) {
+    const uint8_t *bytes = src;
+    
+    while (length > 0) {
+        uint32_t offset = addr & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        
+        uint8_t *page = paged_lookup_write(mem, addr);
+        if (!page) {
+            return -1;
+        }
+        memcpy(page + offset, bytes, chunk);
+        
+        bytes += chunk;
+        addr += (uint32_t)chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+void paged_read(PagedMemory *mem, uint32_t addr, void *dst, size_t length) {
+    uint8_t *bytes = dst;
+    
+    while (length > 0) {
+        uint32_t offset = addr & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        
+        uint8_t *page = paged_lookup(mem, addr);
+        if (page) {
+            memcpy(bytes, page + offset, chunk);
+        } else {
+            memset(bytes, 0, chunk);
+        }
+        
+        bytes += chunk;
+        addr += (uint32_t)chunk;
+        length -= chunk;
+    }
+}
+
+static int page_is_zero(const uint8_t *page) {
+    for (uint32_t n = 0; n < MEM_PAGE_SIZE; n++) {
+        if (page[n]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint64_t paged_digest(PagedMemory *mem) {
+    uint64_t hash = FNV_OFFSET;
+    
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        PageTable *table = mem->tables[t];
+        if (!table) {
+            continue;
+        }
+        for (uint32_t p = 0; p < MEM_L2_ENTRIES; p++) {
+            const uint8_t *page = table->pages[p];
+            if (!page || page_is_zero(page)) {
+                continue;
+            }
+            
+            uint32_t number = (t << MEM_L2_BITS) | p;
+            for (int b = 0; b < 4; b++) {
+                hash = (hash ^ ((number >> (b * 8)) & 0xFF)) * FNV_PRIME;
+            }
+            for (uint32_t n = 0; n < MEM_PAGE_SIZE; n++) {
+                hash = (hash ^ page[n]) * FNV_PRIME;
+            }
+        }
+    }
+    return hash;
+}
+
+uint64_t paged_state_hash(PagedMemory *mem) {
+    uint64_t hash = 0;
+    
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        PageTable *table = mem->tables[t];
+        if (!table) {
+            continue;
+        }
+        for (uint32_t p = 0; p < MEM_L2_ENTRIES; p++) {
+            const uint8_t *page = table->pages[p];
+            if (!page) {
+                continue;
+            }
+            
+            uint32_t base = ((t << MEM_L2_BITS) | p) << MEM_PAGE_SHIFT;
+            for (uint32_t n = 0; n < MEM_PAGE_SIZE; n += 4) {
+                uint32_t word = page[n] | (page[n + 1] << 8) | (page[n + 2] << 16) |
+                                ((uint32_t)page[n + 3] << 24);
+                hash ^= paged_word_hash(base + n, word);
+            }
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,126 @@
+// memory.h
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sparse guest memory: a two-level table of 4 KiB pages covering the full
+// 32-bit address space. Pages are allocated on first write; reads of
+// pages never written return zero without allocating anything.
+#define MEM_PAGE_SHIFT  12
+#define MEM_PAGE_SIZE   (1u << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_L2_BITS     10
+#define MEM_L2_ENTRIES  (1u << MEM_L2_BITS)
+#define MEM_L1_ENTRIES  (1u << (32 - MEM_PAGE_SHIFT - MEM_L2_BITS))
+
+#define MEM_NO_PAGE     0xFFFFFFFFu     // Never a valid page number
+
+// Second-level table: 1024 pages, 4 MiB of guest address space
+typedef struct {
+    uint8_t *pages[MEM_L2_ENTRIES];
+    uint32_t external[MEM_L2_ENTRIES / 32];     // Page belongs to a host mapping, not malloc
+    uint32_t shared[MEM_L2_ENTRIES / 32];       // Page is held by the snapshot, copy before writing
+    uint32_t reserved[MEM_L2_ENTRIES / 32];     // Page belongs to a device, never allocated as RAM
+} PageTable;
+
+// Host mapping that backs external pages, unmapped on destroy
+typedef struct {
+    void *addr;
+    size_t length;
+} HostMapping;
+
+// Page written since the snapshot, with what to put back on restore
+typedef struct {
+    uint32_t page;              // Page number
+    uint8_t *original;          // Page as of the snapshot, NULL if it did not exist
+    int original_external;      // Original belongs to a host mapping
+} DirtyPage;
+
+typedef struct {
+    PageTable *tables[MEM_L1_ENTRIES];
+    uint32_t cached_page;       // Page number of the last access
+    uint8_t *cached_host;       // Host address of that page
+    int cached_writable;        // Cached page may be written in place
+    size_t pages_allocated;     // Pages allocated with malloc
+    HostMapping *mappings;
+    size_t mapping_count;
+    int tracking;               // A snapshot is active
+    DirtyPage *dirty;           // Pages written since the snapshot
+    size_t dirty_count;
+    size_t dirty_capacity;
+    uint8_t **spare;            // Pages dropped by restore, reused before malloc
+    size_t spare_count;
+    size_t spare_capacity;
+} PagedMemory;
+
+void paged_init(PagedMemory *mem);
+void paged_destroy(PagedMemory *mem);
+
+// Drop every page, leaving all of memory reading as zero
+void paged_clear(PagedMemory *mem);
+
+// Host address of the page holding addr, or NULL if it was never written
+uint8_t *paged_lookup(PagedMemory *mem, uint32_t addr);
+
+// Host address of the page holding addr, allocating it if needed.
+// Returns NULL only if allocation fails.
+uint8_t *paged_lookup_write(PagedMemory *mem, uint32_t addr);
+
+// Keep the page at addr out of RAM, e.g. for a memory-mapped device: it
+// reads as absent and paged_lookup_write() returns NULL for it. Fails if
+// the page already holds data. paged_clear() drops reservations.
+int paged_reserve(PagedMemory *mem, uint32_t addr);
+
+// Back the page at addr with host memory owned by a mapping
+int paged_map_external(PagedMemory *mem, uint32_t addr, uint8_t *host);
+int paged_add_mapping(PagedMemory *mem, void *addr, size_t length);
+
+// Copy-on-write snapshot: every page present now is shared with the
+// snapshot and copied on its next write, so restore only puts back the
+// pages written since. At most one snapshot is active per memory. Pages
+// dropped by a restore are kept for reuse, so a loop of runs restored to
+// the same snapshot stops allocating once the first run has warmed up.
+void paged_snapshot(PagedMemory *mem);
+void paged_restore(PagedMemory *mem);
+void paged_release_snapshot(PagedMemory *mem);
+
+// Bulk host-side copies, e.g. for loaders and debuggers
+int paged_write(PagedMemory *mem, uint32_t addr, const void *src, size_t length);
+void paged_read(PagedMemory *mem, uint32_t addr, void *dst, size_t length);
+
+// FNV-1a over the address and contents of every non-zero page
+uint64_t paged_digest(PagedMemory *mem);
+
+// Order-independent hash of memory: the XOR of paged_word_hash() over
+// every word. Zero words hash to 0, so a write of value to a word holding
+// old updates it by XORing in paged_word_hash() of both.
+uint64_t paged_state_hash(PagedMemory *mem);
+
+static inline uint64_t paged_word_hash(uint32_t addr, uint32_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    uint64_t x = ((uint64_t)(addr & ~3u) << 32) | value;
+    x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+    x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// Fast paths through the one-entry last-page cache
+static inline uint8_t *paged_page_for_read(PagedMemory *mem, uint32_t addr) {
+    if ((addr >> MEM_PAGE_SHIFT) == mem->cached_page) {
+        return mem->cached_host;
+    }
+    return paged_lookup(mem, addr);
+}
+
+static inline uint8_t *paged_page_for_write(PagedMemory *mem, uint32_t addr) {
+    if ((addr >> MEM_PAGE_SHIFT) == mem->cached_page && mem->cached_writable) {
+        return mem->cached_host;
+    }
+    return paged_lookup_write(mem, addr);
+}
+
+#endif
@@ -0,0 +1,89 @@
+// mmio.c
+#include "mmio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void mmio_init(MmioBus *bus) {
+    memset(bus, 0, sizeof(*bus));
+}
+
+void mmio_destroy(MmioBus *bus) {
+    for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+        free(bus->tables[t]);
+    }
+    memset(bus, 0, sizeof(*bus));
+}
+
+MmioDevice *mmio_find(MmioBus *bus, uint32_t addr) {
+    MmioDevice **table = bus->tables[addr >> (MEM_PAGE_SHIFT + MEM_L2_BITS)];
+    return table ? table[(addr >> MEM_PAGE_SHIFT) & (MEM_L2_ENTRIES - 1)] : NULL;
+}
+
+int mmio_map(MmioBus *bus, CPU *cpu, MmioDevice *device) {
+    uint64_t end = (uint64_t)device->base + device->size;
+    
+    if (cpu->guard_data) {
+        printf("MMIO devices need paged data memory, not guard-page mode\n");
+        return -1;
+    }
+    if ((device->base & MEM_PAGE_MASK) || device->size == 0 || end > cpu->data_mem_size ||
+        bus->device_count == MMIO_MAX_DEVICES) {
+        printf("Cannot map device %s at 0x%08x\n", device->name, device->base);
+        return -1;
+    }
+    
+    // Check the whole range before claiming any of it
+    for (uint64_t addr = device->base; addr < end; addr += MEM_PAGE_SIZE) {
+        if (mmio_find(bus, (uint32_t)addr) || paged_lookup(&cpu->data_memory, (uint32_t)addr)) {
+            printf("Device %s overlaps memory in use at 0x%08x\n", device->name, (uint32_t)addr);
+            return -1;
+        }
+    }
+    
+    for (uint64_t addr = device->base; addr < end; addr += MEM_PAGE_SIZE) {
+        MmioDevice ***slot = &bus->tables[addr >> (MEM_PAGE_SHIFT + MEM_L2_BITS)];
+        if (!*slot) {
+            *slot = calloc(MEM_L2_ENTRIES, sizeof(MmioDevice *));
+        }
+        if (!*slot || paged_reserve(&cpu->data_memory, (uint32_t)addr) != 0) {
+            printf("Failed to map device %s\n", device->name);
+            return -1;
+        }
+        (*slot)[(addr >> MEM_PAGE_SHIFT) & (MEM_L2_ENTRIES - 1)] = device;
+    }
+    
+    bus->devices[bus->device_count++] = device;
+    device->cpu = cpu;
+    cpu->bus = bus;
+    return 0;
+}
+
+uint32_t mmio_read(MmioBus *bus, uint32_t addr, int size) {
+    MmioDevice *device = mmio_find(bus, addr);
+    if (!device || !device->read) {
+        return 0;
+    }
+    bus->reads++;
+    return device->read(device, addr - device->base, size);
+}
+
+int mmio_write(MmioBus *bus, uint32_t addr, uint32_t value, int size) {
+    MmioDevice *device = mmio_find(bus, addr);
+    if (!device) {
+        return -1;
+    }
+    bus->writes++;
+    if (device->write) {
+        device->write(device, addr - device->base, value, size);
+    }
+    return 0;
+}
+
+void mmio_flush(MmioBus *bus) {
+    for (int n = 0; n < bus->device_count; n++) {
+        if (bus->devices[n]->flush) {
+            bus->devices[n]->flush(bus->devices[n]);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+// mmio.h
+#ifndef MMIO_H
+#define MMIO_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+#define MMIO_MAX_DEVICES 16
+
+// A device occupying whole pages of the data address space. Accesses are
+// 1, 2 or 4 bytes, naturally aligned; offset is relative to base.
+typedef struct MmioDevice {
+    const char *name;
+    uint32_t base;              // Page aligned
+    uint32_t size;              // Rounded up to whole pages when mapped
+    uint32_t (*read)(struct MmioDevice *device, uint32_t offset, int size);
+    void (*write)(struct MmioDevice *device, uint32_t offset, uint32_t value, int size);
+    void (*flush)(struct MmioDevice *device);   // Push buffered output to the host; may be NULL
+    void *context;              // For the device's own use
+    CPU *cpu;                   // Set by mmio_map
+} MmioDevice;
+
+// Device pages are reserved in data memory, so RAM accesses keep their
+// fast path unchanged: only an access that finds no RAM page asks the
+// bus, and the bus finds the device through a two-level page table
+// rather than by scanning address ranges.
+typedef struct MmioBus {
+    MmioDevice **tables[MEM_L1_ENTRIES];    // Device per page, NULL where none
+    MmioDevice *devices[MMIO_MAX_DEVICES];
+    int device_count;
+    uint64_t reads;             // Device accesses, for reports
+    uint64_t writes;
+} MmioBus;
+
+void mmio_init(MmioBus *bus);
+void mmio_destroy(MmioBus *bus);
+
+// Map device into cpu's data address space and attach the bus to cpu.
+// Fails if the range overlaps RAM already written, another device or the
+// end of data memory, or if the CPU uses guard-page memory.
+int mmio_map(MmioBus *bus, CPU *cpu, MmioDevice *device);
+
+// Device whose pages hold addr, NULL if none
+MmioDevice *mmio_find(MmioBus *bus, uint32_t addr);
+
+// Called by the data accessors for addresses without a RAM page. Reads
+// outside any device return 0. mmio_write returns -1 if no device is there.
+uint32_t mmio_read(MmioBus *bus, uint32_t addr, int size);
+int mmio_write(MmioBus *bus, uint32_t addr, uint32_t value, int size);
+
+// Push every device's buffered output to the host. Hosts that run the
+// CPU in slices call this between them so console output keeps up.
+void mmio_flush(MmioBus *bus);
+
+#endif
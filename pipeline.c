@@ -0,0 +1,230 @@
+// pipeline.c
+#include "pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EX_FIRST_CYCLE 2    // IF in cycle 0, ID in 1
+
+// Instruction classes by major opcode. Only ALU operations decode today;
+// the others are here so the model is ready for loads, stores and jumps.
+typedef enum {
+    CLASS_ALU,
+    CLASS_LOAD,
+    CLASS_STORE,
+    CLASS_CONTROL,
+    CLASS_OTHER
+} InstClass;
+
+static InstClass classify(const Instruction *inst) {
+    switch (inst->opcode) {
+        case 0x33: case 0x13: case 0x37: case 0x17: return CLASS_ALU;
+        case 0x03: return CLASS_LOAD;
+        case 0x23: return CLASS_STORE;
+        case 0x63: case 0x6F: case 0x67: return CLASS_CONTROL;
+        default:   return CLASS_OTHER;
+    }
+}
+
+void pipeline_config_default(PipelineConfig *config) {
+    config->forwarding = FORWARD_FULL;
+    config->branch_penalty = 2;
+    config->load_latency = 1;
+    for (int op = 0; op < OP_COUNT; op++) {
+        config->op_latency[op] = 1;
+    }
+}
+
+int pipeline_init(PipelineModel *model, const PipelineConfig *config, unsigned int inst_mem_size) {
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (model->config.op_latency[op] == 0) {
+            model->config.op_latency[op] = 1;
+        }
+    }
+    
+    model->slots = inst_mem_size / 4 + 1;
+    model->pc_stalls = calloc(model->slots, sizeof(*model->pc_stalls));
+    if (!model->pc_stalls) {
+        printf("Failed to allocate pipeline model\n");
+        return -1;
+    }
+    return 0;
+}
+
+void pipeline_destroy(PipelineModel *model) {
+    free(model->pc_stalls);
+    model->pc_stalls = NULL;
+    model->slots = 0;
+}
+
+static void add_stall(PipelineModel *model, uint32_t pc, StallKind kind, uint64_t cycles) {
+    if (cycles == 0) {
+        return;
+    }
+    model->stalls[kind] += cycles;
+    if ((pc >> 2) < model->slots) {
+        model->pc_stalls[pc >> 2][kind] += cycles;
+    }
+}
+
+void pipeline_account(PipelineModel *model, uint32_t pc, const Instruction *inst, uint32_t next_pc) {
+    const PipelineConfig *config = &model->config;
+    InstClass cls = classify(inst);
+    unsigned int latency = config->op_latency[inst->op];
+    
+    // Earliest EX slot if nothing stalls: one instruction per cycle
+    uint64_t base = model->instructions ? model->last_ex + 1 : EX_FIRST_CYCLE;
+    uint64_t start = base;
+    
+    if (model->instructions && model->redirect) {
+        add_stall(model, pc, STALL_BRANCH, config->branch_penalty);
+        start += config->branch_penalty;
+    }
+    
+    // EX is not pipelined for multi-cycle operations
+    uint64_t ex_free = model->last_ex + model->last_latency;
+    if (model->instructions && ex_free > start) {
+        add_stall(model, pc, STALL_STRUCTURAL, ex_free - start);
+        start = ex_free;
+    }
+    
+    // Source operands, x0 never waits
+    uint32_t sources[2] = { inst->rs1, inst->rs2 };
+    uint64_t ready = 0;
+    int from_load = 0;
+    for (int s = 0; s < 2; s++) {
+        uint32_t reg = sources[s];
+        if (reg != 0 && model->reg_ready[reg] > ready) {
+            ready = model->reg_ready[reg];
+            from_load = model->reg_from_load[reg];
+        }
+    }
+    if (ready > start) {
+        add_stall(model, pc, from_load ? STALL_LOAD_USE : STALL_DATA, ready - start);
+        start = ready;
+    }
+    
+    // When the result can feed a later EX, given the bypass network
+    uint64_t mem_end = start + latency + (cls == CLASS_LOAD ? config->load_latency : 1);
+    if (inst->rd != 0 && (cls == CLASS_ALU || cls == CLASS_LOAD || cls == CLASS_CONTROL)) {
+        uint64_t result;
+        if (cls == CLASS_LOAD) {
+            result = config->forwarding == FORWARD_NONE ? mem_end + 1 : mem_end;
+        } else {
+            result = config->forwarding == FORWARD_FULL ? start + latency :
+                     config->forwarding == FORWARD_MEM  ? start + latency + 1 :
+                                                          start + latency + 2;
+        }
+        model->reg_ready[inst->rd] = result;
+        model->reg_from_load[inst->rd] = cls == CLASS_LOAD;
+    }
+    
+    model->last_ex = start;
+    model->last_latency = latency;
+    model->redirect = next_pc != pc + 4;
+    model->last_cycle = mem_end;     // WB follows the last MEM cycle
+    model->instructions++;
+}
+
+uint64_t pipeline_run(PipelineModel *model, CPU *cpu, uint64_t max_instructions) {
+    uint64_t executed = 0;
+    
+    while (executed < max_instructions) {
+        uint32_t pc = cpu->pc;
+        Instruction *inst = cpu_step_reference(cpu);
+        if (!inst) {
+            break;
+        }
+        executed++;
+        pipeline_account(model, pc, inst, cpu->pc);
+    }
+    return executed;
+}
+
+uint64_t pipeline_cycles(const PipelineModel *model) {
+    return model->instructions ? model->last_cycle + 1 : 0;
+}
+
+double pipeline_cpi(const PipelineModel *model) {
+    return model->instructions ? (double)pipeline_cycles(model) / model->instructions : 0.0;
+}
+
+uint64_t pipeline_pc_stalls(const PipelineModel *model, uint32_t pc, StallKind kind) {
+    if ((pc >> 2) >= model->slots || kind < 0 || kind >= STALL_KINDS) {
+        return 0;
+    }
+    return model->pc_stalls[pc >> 2][kind];
+}
+
+const char *pipeline_stall_name(StallKind kind) {
+    static const char *names[STALL_KINDS] = {
+        [STALL_DATA]       = "data",
+        [STALL_LOAD_USE]   = "load-use",
+        [STALL_STRUCTURAL] = "structural",
+        [STALL_BRANCH]     = "branch",
+    };
+    if (kind < 0 || kind >= STALL_KINDS) {
+        return "unknown";
+    }
+    return names[kind];
+}
+
+static uint64_t slot_total(const PipelineModel *model, uint32_t slot) {
+    uint64_t total = 0;
+    for (int kind = 0; kind < STALL_KINDS; kind++) {
+        total += model->pc_stalls[slot][kind];
+    }
+    return total;
+}
+
+void pipeline_report(const PipelineModel *model, size_t top) {
+    static const char *forwarding[] = { "none", "mem", "full" };
+    uint32_t worst[top ? top : 1];
+    size_t used = 0;
+    
+    printf("\n=== Pipeline Timing ===\n");
+    printf("Forwarding: %s, branch penalty: %u, load latency: %u\n",
+           forwarding[model->config.forwarding], model->config.branch_penalty,
+           model->config.load_latency);
+    printf("Instructions: %llu\n", (unsigned long long)model->instructions);
+    printf("Cycles: %llu\n", (unsigned long long)pipeline_cycles(model));
+    printf("CPI: %.3f\n", pipeline_cpi(model));
+    
+    printf("\nStall cycles:\n");
+    for (int kind = 0; kind < STALL_KINDS; kind++) {
+        printf("  %-10s %12llu\n", pipeline_stall_name((StallKind)kind),
+               (unsigned long long)model->stalls[kind]);
+    }
+    
+    // Keep the top stalled slots, worst first
+    for (uint32_t slot = 0; slot < model->slots && top > 0; slot++) {
+        uint64_t total = slot_total(model, slot);
+        if (total == 0) {
+            continue;
+        }
+        size_t pos = used < top ? used : top;
+        while (pos > 0 && slot_total(model, worst[pos - 1]) < total) {
+            if (pos < top) {
+                worst[pos] = worst[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < top) {
+            worst[pos] = slot;
+        }
+        used = used < top ? used + 1 : top;
+    }
+    
+    printf("\nMost stalled PCs:\n");
+    for (size_t n = 0; n < used; n++) {
+        printf("  %08x %8llu  (", worst[n] << 2, (unsigned long long)slot_total(model, worst[n]));
+        for (int kind = 0; kind < STALL_KINDS; kind++) {
+            printf("%s%s %llu", kind ? ", " : "", pipeline_stall_name((StallKind)kind),
+                   (unsigned long long)model->pc_stalls[worst[n]][kind]);
+        }
+        printf(")\n");
+    }
+    printf("=======================\n\n");
+}
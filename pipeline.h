@@ -0,0 +1,73 @@
+// pipeline.h
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Cycle-approximate timing of a classic in-order IF/ID/EX/MEM/WB pipeline,
+// layered over execute_instruction. pipeline_run() is its own driver loop,
+// so the functional engines carry no timing code at all.
+//
+// Each retired instruction is placed in EX as early as the pipeline
+// allows: one issue per cycle, EX held for the operation's latency,
+// operands ready according to the forwarding paths, and a refetch penalty
+// after any change of control flow.
+
+typedef enum {
+    FORWARD_NONE,       // Results only through the register file after WB
+    FORWARD_MEM,        // MEM/WB -> EX bypass only
+    FORWARD_FULL        // EX/MEM and MEM/WB -> EX bypasses
+} ForwardingMode;
+
+// Why an instruction entered EX later than the cycle after its predecessor
+typedef enum {
+    STALL_DATA,         // Waiting for an ALU result
+    STALL_LOAD_USE,     // Waiting for a load result
+    STALL_STRUCTURAL,   // EX still busy with a multi-cycle operation
+    STALL_BRANCH,       // Refetch after a taken branch or jump
+    STALL_KINDS
+} StallKind;
+
+typedef struct {
+    ForwardingMode forwarding;
+    unsigned int branch_penalty;        // Cycles lost after a control transfer
+    unsigned int load_latency;          // MEM cycles before load data is available
+    unsigned int op_latency[OP_COUNT];  // EX cycles per operation
+} PipelineConfig;
+
+typedef struct {
+    PipelineConfig config;
+    uint64_t reg_ready[32];             // First cycle each register can enter EX
+    uint8_t reg_from_load[32];          // Register's pending value comes from a load
+    uint64_t last_ex;                   // EX start of the previous instruction
+    unsigned int last_latency;          // Its EX latency
+    int redirect;                       // Previous instruction changed control flow
+    uint64_t last_cycle;                // WB cycle of the youngest instruction
+    uint64_t instructions;
+    uint64_t stalls[STALL_KINDS];
+    uint64_t (*pc_stalls)[STALL_KINDS]; // Per 4-byte instruction slot
+    uint32_t slots;
+} PipelineModel;
+
+void pipeline_config_default(PipelineConfig *config);
+int pipeline_init(PipelineModel *model, const PipelineConfig *config, unsigned int inst_mem_size);
+void pipeline_destroy(PipelineModel *model);
+
+// Account one retired instruction that ran at pc and continued at next_pc
+void pipeline_account(PipelineModel *model, uint32_t pc, const Instruction *inst, uint32_t next_pc);
+
+// Execute up to max_instructions through the reference interpreter with
+// timing; returns the number retired
+uint64_t pipeline_run(PipelineModel *model, CPU *cpu, uint64_t max_instructions);
+
+// Results
+uint64_t pipeline_cycles(const PipelineModel *model);
+double pipeline_cpi(const PipelineModel *model);
+uint64_t pipeline_pc_stalls(const PipelineModel *model, uint32_t pc, StallKind kind);
+const char *pipeline_stall_name(StallKind kind);
+
+// Cycles, CPI, stalls by kind and the top most-stalled PCs, on stdout
+void pipeline_report(const PipelineModel *model, size_t top);
+
+#endif
@@ -0,0 +1,244 @@
+// profile.c
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_NO_PC 0xFFFFFFFFu   // Never a fall-through target
+
+int profile_init(Profile *profile, unsigned int inst_mem_size) {
+    memset(profile, 0, sizeof(*profile));
+    profile->slots = inst_mem_size / 4 + 1;
+    profile->pc_counts = calloc(profile->slots, sizeof(uint64_t));
+    profile->block_entries = calloc(profile->slots, sizeof(uint64_t));
+    if (!profile->pc_counts || !profile->block_entries) {
+        printf("Failed to allocate profile\n");
+        profile_destroy(profile);
+        return -1;
+    }
+    profile->next_pc = PROFILE_NO_PC;
+    return 0;
+}
+
+void profile_destroy(Profile *profile) {
+    free(profile->pc_counts);
+    free(profile->block_entries);
+    profile->pc_counts = NULL;
+    profile->block_entries = NULL;
+    profile->slots = 0;
+}
+
+void profile_reset(Profile *profile) {
+    memset(profile->op_counts, 0, sizeof(profile->op_counts));
+    memset(profile->pc_counts, 0, profile->slots * sizeof(uint64_t));
+    memset(profile->block_entries, 0, profile->slots * sizeof(uint64_t));
+    profile->next_pc = PROFILE_NO_PC;
+    profile->total = 0;
+}
+
+uint64_t profile_total(const Profile *profile) {
+    return profile->total;
+}
+
+uint64_t profile_op_count(const Profile *profile, Operation op) {
+    if (op < 0 || op >= OP_COUNT) {
+        return 0;
+    }
+    return profile->op_counts[op];
+}
+
+uint64_t profile_pc_count(const Profile *profile, uint32_t pc) {
+    if ((pc >> 2) >= profile->slots) {
+        return 0;
+    }
+    return profile->pc_counts[pc >> 2];
+}
+
+// Higher count first, then lower address
+static int hotter(const Profile *profile, uint32_t a, uint32_t b) {
+    uint64_t x = profile->pc_counts[a >> 2];
+    uint64_t y = profile->pc_counts[b >> 2];
+    return x > y || (x == y && a < b);
+}
+
+// Insert into a top-N list kept sorted hottest first
+static size_t top_insert_pc(const Profile *profile, uint32_t *pcs, size_t used, size_t max, uint32_t pc) {
+    size_t pos = used < max ? used : max;
+    while (pos > 0 && hotter(profile, pc, pcs[pos - 1])) {
+        if (pos < max) {
+            pcs[pos] = pcs[pos - 1];
+        }
+        pos--;
+    }
+    if (pos < max) {
+        pcs[pos] = pc;
+    }
+    return used < max ? used + 1 : max;
+}
+
+size_t profile_hot_pcs(const Profile *profile, uint32_t *pcs, size_t max) {
+    size_t used = 0;
+    if (max == 0) {
+        return 0;
+    }
+    for (uint32_t slot = 0; slot < profile->slots; slot++) {
+        if (profile->pc_counts[slot]) {
+            used = top_insert_pc(profile, pcs, used, max, slot << 2);
+        }
+    }
+    return used;
+}
+
+size_t profile_hot_blocks(const Profile *profile, ProfileBlock *blocks, size_t max) {
+    size_t used = 0;
+    if (max == 0) {
+        return 0;
+    }
+    
+    for (uint32_t slot = 0; slot < profile->slots; slot++) {
+        if (!profile->block_entries[slot]) {
+            continue;
+        }
+        
+        // A block runs until the next leader or the first slot never reached
+        ProfileBlock block = { slot << 2, 0, profile->block_entries[slot], 0 };
+        uint32_t end = slot;
+        do {
+            block.instructions += profile->pc_counts[end++];
+        } while (end < profile->slots && profile->pc_counts[end] && !profile->block_entries[end]);
+        block.end_pc = end << 2;
+        
+        size_t pos = used < max ? used : max;
+        while (pos > 0 && blocks[pos - 1].instructions < block.instructions) {
+            if (pos < max) {
+                blocks[pos] = blocks[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < max) {
+            blocks[pos] = block;
+        }
+        used = used < max ? used + 1 : max;
+    }
+    return used;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+static const char *symbol_name(ElfImage *symbols, uint32_t pc, uint32_t *offset) {
+    const ElfSymbol *symbol = symbols ? elf_symbol_for_addr(symbols, pc) : NULL;
+    if (!symbol) {
+        return NULL;
+    }
+    *offset = pc - symbol->addr;
+    return symbol->name;
+}
+
+void profile_report_text(const Profile *profile, ElfImage *symbols, size_t top) {
+    uint32_t pcs[top ? top : 1];
+    ProfileBlock blocks[top ? top : 1];
+    uint32_t offset;
+    
+    printf("\n=== Profile ===\n");
+    printf("Instructions: %llu\n", (unsigned long long)profile->total);
+    
+    // ECALL retires like any other instruction; EBREAK and halts do not
+    printf("\nBy operation:\n");
+    for (int op = OP_ECALL; op < OP_COUNT; op++) {
+        if (profile->op_counts[op]) {
+            printf("  %-6s %12llu  %5.1f%%\n", get_operation_name((Operation)op),
+                   (unsigned long long)profile->op_counts[op],
+                   percent(profile->op_counts[op], profile->total));
+        }
+    }
+    
+    size_t count = profile_hot_pcs(profile, pcs, top);
+    printf("\nHottest PCs:\n");
+    for (size_t n = 0; n < count; n++) {
+        uint64_t hits = profile->pc_counts[pcs[n] >> 2];
+        const char *name = symbol_name(symbols, pcs[n], &offset);
+        printf("  %08x %12llu  %5.1f%%", pcs[n], (unsigned long long)hits, percent(hits, profile->total));
+        if (name) {
+            printf("  %s+0x%x", name, offset);
+        }
+        printf("\n");
+    }
+    
+    count = profile_hot_blocks(profile, blocks, top);
+    printf("\nHottest blocks:\n");
+    for (size_t n = 0; n < count; n++) {
+        const char *name = symbol_name(symbols, blocks[n].start_pc, &offset);
+        printf("  %08x-%08x %4u insts %10llu entries %12llu executed  %5.1f%%",
+               blocks[n].start_pc, blocks[n].end_pc - 4,
+               (blocks[n].end_pc - blocks[n].start_pc) / 4,
+               (unsigned long long)blocks[n].entries, (unsigned long long)blocks[n].instructions,
+               percent(blocks[n].instructions, profile->total));
+        if (name) {
+            printf("  %s+0x%x", name, offset);
+        }
+        printf("\n");
+    }
+    printf("===============\n\n");
+}
+
+// Symbol names come from the ELF and may hold any byte
+static void print_json_string(const char *text) {
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20) {
+            printf("\\u%04x", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+void profile_report_json(const Profile *profile, ElfImage *symbols, size_t top) {
+    uint32_t pcs[top ? top : 1];
+    ProfileBlock blocks[top ? top : 1];
+    uint32_t offset;
+    const char *separator = "";
+    
+    printf("{\"instructions\":%llu,\"ops\":{", (unsigned long long)profile->total);
+    for (int op = OP_ECALL; op < OP_COUNT; op++) {
+        printf("%s\"%s\":%llu", separator, get_operation_name((Operation)op),
+               (unsigned long long)profile->op_counts[op]);
+        separator = ",";
+    }
+    
+    printf("},\"pcs\":[");
+    size_t count = profile_hot_pcs(profile, pcs, top);
+    for (size_t n = 0; n < count; n++) {
+        const char *name = symbol_name(symbols, pcs[n], &offset);
+        printf("%s{\"pc\":\"0x%08x\",\"count\":%llu", n ? "," : "", pcs[n],
+               (unsigned long long)profile->pc_counts[pcs[n] >> 2]);
+        if (name) {
+            printf(",\"symbol\":");
+            print_json_string(name);
+            printf(",\"offset\":%u", offset);
+        }
+        printf("}");
+    }
+    
+    printf("],\"blocks\":[");
+    count = profile_hot_blocks(profile, blocks, top);
+    for (size_t n = 0; n < count; n++) {
+        const char *name = symbol_name(symbols, blocks[n].start_pc, &offset);
+        printf("%s{\"start\":\"0x%08x\",\"end\":\"0x%08x\",\"length\":%u,\"entries\":%llu,"
+               "\"instructions\":%llu", n ? "," : "", blocks[n].start_pc, blocks[n].end_pc,
+               (blocks[n].end_pc - blocks[n].start_pc) / 4,
+               (unsigned long long)blocks[n].entries, (unsigned long long)blocks[n].instructions);
+        if (name) {
+            printf(",\"symbol\":");
+            print_json_string(name);
+            printf(",\"offset\":%u", offset);
+        }
+        printf("}");
+    }
+    printf("]}\n");
+}
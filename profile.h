@@ -0,0 +1,63 @@
+// profile.h
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "elf.h"
+
+// Dynamic execution profile: per-operation counts, a per-PC histogram and
+// basic-block entries. Attach with cpu->profile; the reference interpreter
+// records from execute_instruction and the threaded core switches to an
+// instrumented dispatch table, so nothing is paid while it is detached.
+typedef struct Profile {
+    uint64_t op_counts[OP_COUNT];   // Retired instructions per operation
+    uint64_t *pc_counts;            // Retired instructions per 4-byte slot
+    uint64_t *block_entries;        // Times each slot was reached other than by falling through
+    uint32_t slots;
+    uint32_t next_pc;               // Fall-through PC after the last record
+    uint64_t total;
+} Profile;
+
+// A straight-line run starting at a block leader
+typedef struct {
+    uint32_t start_pc;
+    uint32_t end_pc;                // PC after the last instruction
+    uint64_t entries;               // Times the block was entered
+    uint64_t instructions;          // Instructions retired inside it
+} ProfileBlock;
+
+// Size the profile for an instruction memory; returns -1 on allocation failure
+int profile_init(Profile *profile, unsigned int inst_mem_size);
+void profile_destroy(Profile *profile);
+void profile_reset(Profile *profile);
+
+static inline void profile_record(Profile *profile, uint32_t pc, Operation op) {
+    uint32_t slot = pc >> 2;
+    if (slot < profile->slots) {
+        profile->op_counts[op]++;
+        profile->pc_counts[slot]++;
+        if (pc != profile->next_pc) {
+            profile->block_entries[slot]++;
+        }
+        profile->next_pc = pc + 4;
+        profile->total++;
+    }
+}
+
+// Queries
+uint64_t profile_total(const Profile *profile);
+uint64_t profile_op_count(const Profile *profile, Operation op);
+uint64_t profile_pc_count(const Profile *profile, uint32_t pc);
+
+// Hottest PCs and blocks, most executed first; return the number filled in
+size_t profile_hot_pcs(const Profile *profile, uint32_t *pcs, size_t max);
+size_t profile_hot_blocks(const Profile *profile, ProfileBlock *blocks, size_t max);
+
+// End-of-run reports on stdout, showing the top entries of each table.
+// symbols may be NULL; otherwise PCs are annotated with function names.
+void profile_report_text(const Profile *profile, ElfImage *symbols, size_t top);
+void profile_report_json(const Profile *profile, ElfImage *symbols, size_t top);
+
+#endif
@@ -0,0 +1,460 @@
+// replay.c
+#include "replay.h"
+#include "syscalls.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t inst_page_count(const CPU *cpu) {
+    return (cpu->inst_mem_size + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT;
+}
+
+// Bytes of instruction memory in the page starting at start
+static uint32_t inst_page_length(const CPU *cpu, uint32_t start) {
+    return cpu->inst_mem_size - start < MEM_PAGE_SIZE ? cpu->inst_mem_size - start : MEM_PAGE_SIZE;
+}
+
+static PageHistory *history_find(Recording *rec, uint32_t key, int create) {
+    if (create && (rec->history_count + 1) * 2 > rec->history_capacity) {
+        uint32_t capacity = rec->history_capacity ? rec->history_capacity * 2 : 256;
+        PageHistory *table = calloc(capacity, sizeof(PageHistory));
+        if (!table) {
+            return NULL;
+        }
+        for (uint32_t n = 0; n < rec->history_capacity; n++) {
+            if (rec->history[n].versions) {
+                uint32_t slot = (rec->history[n].key * 0x9E3779B1u) & (capacity - 1);
+                while (table[slot].versions) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                table[slot] = rec->history[n];
+            }
+        }
+        free(rec->history);
+        rec->history = table;
+        rec->history_capacity = capacity;
+    }
+    if (rec->history_capacity == 0) {
+        return NULL;
+    }
+    
+    uint32_t slot = (key * 0x9E3779B1u) & (rec->history_capacity - 1);
+    while (rec->history[slot].versions) {
+        if (rec->history[slot].key == key) {
+            return &rec->history[slot];
+        }
+        slot = (slot + 1) & (rec->history_capacity - 1);
+    }
+    if (!create) {
+        return NULL;
+    }
+    
+    PageHistory *entry = &rec->history[slot];
+    entry->versions = malloc(4 * sizeof(PageVersion));
+    if (!entry->versions) {
+        return NULL;
+    }
+    entry->key = key;
+    entry->count = 0;
+    entry->capacity = 4;
+    rec->history_count++;
+    return entry;
+}
+
+// Contents of a page as of checkpoint index, NULL if it was all zero
+static const uint8_t *history_at(const PageHistory *entry, uint32_t index) {
+    if (entry->count == 0 || entry->versions[0].checkpoint > index) {
+        return NULL;
+    }
+    
+    uint32_t lo = 0, hi = entry->count - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (entry->versions[mid].checkpoint <= index) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return entry->versions[lo].data;
+}
+
+// Save the current contents of a page into the newest checkpoint
+static int save_page(Recording *rec, CPU *cpu, uint32_t key) {
+    Checkpoint *checkpoint = &rec->checkpoints[rec->checkpoint_count - 1];
+    PageHistory *entry = history_find(rec, key, 1);
+    uint8_t *data = calloc(1, MEM_PAGE_SIZE);
+    if (!entry || !data) {
+        free(data);
+        return -1;
+    }
+    
+    uint32_t start = (key & ~REPLAY_INST_PAGE) << MEM_PAGE_SHIFT;
+    if (key & REPLAY_INST_PAGE) {
+        memcpy(data, cpu->inst_memory + start, inst_page_length(cpu, start));
+    } else {
+        paged_read(&cpu->data_memory, start, data, MEM_PAGE_SIZE);
+    }
+    
+    if (entry->count == entry->capacity) {
+        PageVersion *versions = realloc(entry->versions, entry->capacity * 2 * sizeof(PageVersion));
+        if (!versions) {
+            free(data);
+            return -1;
+        }
+        entry->versions = versions;
+        entry->capacity *= 2;
+    }
+    entry->versions[entry->count].checkpoint = rec->checkpoint_count - 1;
+    entry->versions[entry->count].data = data;
+    entry->count++;
+    
+    checkpoint->pages[checkpoint->page_count++] = key;
+    return 0;
+}
+
+// Move the CPU's snapshot (and so dirty tracking) to the checkpoint it is at
+static int rebase(Recording *rec, CPU *cpu, uint32_t index) {
+    cpu_snapshot_free(cpu, &rec->snapshot);
+    if (cpu_snapshot(cpu, &rec->snapshot) != 0) {
+        return -1;
+    }
+    rec->base = index;
+    return 0;
+}
+
+// Append a checkpoint for the CPU's current state. The first one saves
+// every page in use; later ones save the pages written since the last.
+static int take_checkpoint(Recording *rec, CPU *cpu) {
+    if (rec->checkpoint_count == rec->checkpoint_capacity) {
+        uint32_t capacity = rec->checkpoint_capacity ? rec->checkpoint_capacity * 2 : 64;
+        Checkpoint *checkpoints = realloc(rec->checkpoints, capacity * sizeof(Checkpoint));
+        if (!checkpoints) {
+            printf("Failed to allocate checkpoint\n");
+            return -1;
+        }
+        rec->checkpoints = checkpoints;
+        rec->checkpoint_capacity = capacity;
+    }
+    
+    int first = rec->checkpoint_count == 0;
+    size_t max_pages = inst_page_count(cpu);
+    if (first) {
+        for (uint32_t t = 0; t < MEM_L1_ENTRIES; t++) {
+            max_pages += cpu->data_memory.tables[t] ? MEM_L2_ENTRIES : 0;
+        }
+    } else {
+        max_pages += cpu->data_memory.dirty_count;
+    }
+    
+    Checkpoint *checkpoint = &rec->checkpoints[rec->checkpoint_count++];
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    checkpoint->instruction_count = cpu->instruction_count;
+    memcpy(checkpoint->regs, cpu->regs, sizeof(checkpoint->regs));
+    checkpoint->pc = cpu->pc;
+    checkpoint->halted = cpu->halted;
+    checkpoint->breakpoint = cpu->breakpoint;
+    checkpoint->error = cpu->error;
+    checkpoint->error_addr = cpu->error_addr;
+    checkpoint->first_input = rec->input_count;
+    checkpoint->pages = malloc((max_pages ? max_pages : 1) * sizeof(uint32_t));
+    if (cpu->syscalls) {
+        checkpoint->syscalls = malloc(sizeof(Syscalls));
+    }
+    if (!checkpoint->pages || (cpu->syscalls && !checkpoint->syscalls)) {
+        free(checkpoint->pages);
+        free(checkpoint->syscalls);
+        rec->checkpoint_count--;
+        printf("Failed to allocate checkpoint\n");
+        return -1;
+    }
+    if (cpu->syscalls) {
+        *checkpoint->syscalls = *cpu->syscalls;
+    }
+    
+    int status = 0;
+    for (uint32_t page = 0; page < inst_page_count(cpu) && status == 0; page++) {
+        if (first || cpu->inst_dirty[page]) {
+            status = save_page(rec, cpu, page | REPLAY_INST_PAGE);
+        }
+    }
+    if (first) {
+        for (uint32_t t = 0; t < MEM_L1_ENTRIES && status == 0; t++) {
+            PageTable *table = cpu->data_memory.tables[t];
+            for (uint32_t n = 0; table && n < MEM_L2_ENTRIES && status == 0; n++) {
+                if (table->pages[n]) {
+                    status = save_page(rec, cpu, (t << MEM_L2_BITS) | n);
+                }
+            }
+        }
+    } else {
+        // A page can appear more than once if it was restored and rewritten
+        for (size_t n = 0; n < cpu->data_memory.dirty_count && status == 0; n++) {
+            uint32_t page = cpu->data_memory.dirty[n].page;
+            PageHistory *entry = history_find(rec, page, 0);
+            if (!entry || entry->count == 0 ||
+                entry->versions[entry->count - 1].checkpoint != rec->checkpoint_count - 1) {
+                status = save_page(rec, cpu, page);
+            }
+        }
+    }
+    
+    if (status != 0 || rebase(rec, cpu, rec->checkpoint_count - 1) != 0) {
+        printf("Failed to save checkpoint\n");
+        return -1;
+    }
+    return 0;
+}
+
+int replay_start(Recording *rec, CPU *cpu, uint64_t interval) {
+    memset(rec, 0, sizeof(*rec));
+    rec->interval = interval ? interval : 1;
+    
+    if (cpu->guard_data) {
+        printf("Recording needs paged data memory, not guard-page mode\n");
+        return -1;
+    }
+    
+    // Checkpoint 0 saves everything, so start from a fresh snapshot
+    if (cpu_snapshot(cpu, &rec->snapshot) != 0 || take_checkpoint(rec, cpu) != 0) {
+        replay_stop(rec, cpu);
+        return -1;
+    }
+    cpu->recording = rec;
+    return 0;
+}
+
+void replay_stop(Recording *rec, CPU *cpu) {
+    if (cpu->recording == rec) {
+        cpu->recording = NULL;
+    }
+    cpu_snapshot_free(cpu, &rec->snapshot);
+    
+    for (uint32_t n = 0; n < rec->checkpoint_count; n++) {
+        free(rec->checkpoints[n].pages);
+        free(rec->checkpoints[n].syscalls);
+    }
+    free(rec->checkpoints);
+    for (uint32_t n = 0; n < rec->history_capacity; n++) {
+        for (uint32_t v = 0; v < rec->history[n].count; v++) {
+            free(rec->history[n].versions[v].data);
+        }
+        free(rec->history[n].versions);
+    }
+    free(rec->history);
+    free(rec->inputs);
+    free(rec->input_data);
+    memset(rec, 0, sizeof(*rec));
+}
+
+// Called whenever execution stops on an interval boundary
+static int boundary_reached(Recording *rec, CPU *cpu) {
+    uint64_t index = (cpu->instruction_count - rec->checkpoints[0].instruction_count) / rec->interval;
+    
+    if (index < rec->checkpoint_count) {
+        return rec->base == index ? 0 : rebase(rec, cpu, (uint32_t)index);
+    }
+    return take_checkpoint(rec, cpu);
+}
+
+CpuExitReason replay_run(Recording *rec, CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info) {
+    uint64_t start = rec->checkpoints[0].instruction_count;
+    uint64_t executed = 0;
+    CpuExitInfo info;
+    
+    do {
+        uint64_t to_boundary = rec->interval - (cpu->instruction_count - start) % rec->interval;
+        uint64_t chunk = max_instructions - executed < to_boundary ? max_instructions - executed : to_boundary;
+        
+        cpu_run_budget(cpu, chunk, &info);
+        executed += info.executed;
+        if (info.reason != CPU_EXIT_BUDGET) {
+            break;
+        }
+        if ((cpu->instruction_count - start) % rec->interval == 0 && boundary_reached(rec, cpu) != 0) {
+            break;
+        }
+    } while (executed < max_instructions);
+    
+    if (exit_info) {
+        *exit_info = info;
+        exit_info->executed = executed;
+    }
+    return info.reason;
+}
+
+// paged_state_hash() of one data page's contents
+static uint64_t page_hash(uint32_t start, const uint8_t *data) {
+    uint64_t hash = 0;
+    for (uint32_t offset = 0; offset < MEM_PAGE_SIZE; offset += 4) {
+        uint32_t word = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) |
+                        ((uint32_t)data[offset + 3] << 24);
+        hash ^= paged_word_hash(start + offset, word);
+    }
+    return hash;
+}
+
+// Write a page as of a checkpoint back into memory, keeping the state
+// hash current
+static int load_page(CPU *cpu, uint32_t key, const uint8_t *data) {
+    static const uint8_t zero[MEM_PAGE_SIZE];
+    uint32_t start = (key & ~REPLAY_INST_PAGE) << MEM_PAGE_SHIFT;
+    
+    if (!data) {
+        data = zero;
+    }
+    if (key & REPLAY_INST_PAGE) {
+        uint32_t length = inst_page_length(cpu, start);
+        memcpy(cpu->inst_memory + start, data, length);
+        cpu_invalidate_decoded(cpu, start, length);
+        return 0;
+    }
+    
+    if (cpu->state_hashing) {
+        const uint8_t *old = paged_lookup(&cpu->data_memory, start);
+        cpu->state_hash ^= page_hash(start, old ? old : zero) ^ page_hash(start, data);
+    }
+    return paged_write(&cpu->data_memory, start, data, MEM_PAGE_SIZE);
+}
+
+// Put the CPU in the state of checkpoint index: back to the base
+// checkpoint through the snapshot, then fix up every page written
+// between the two checkpoints
+static int restore_checkpoint(Recording *rec, CPU *cpu, uint32_t index) {
+    if (cpu_restore(cpu, &rec->snapshot) != 0) {
+        return -1;
+    }
+    
+    uint32_t lo = index < rec->base ? index : rec->base;
+    uint32_t hi = index < rec->base ? rec->base : index;
+    rec->restores++;
+    for (uint32_t n = lo + 1; n <= hi; n++) {
+        const Checkpoint *between = &rec->checkpoints[n];
+        for (uint32_t p = 0; p < between->page_count; p++) {
+            PageHistory *entry = history_find(rec, between->pages[p], 0);
+            if (entry->restored == rec->restores) {
+                continue;
+            }
+            entry->restored = rec->restores;
+            if (load_page(cpu, entry->key, history_at(entry, index)) != 0) {
+                return -1;
+            }
+        }
+    }
+    
+    const Checkpoint *checkpoint = &rec->checkpoints[index];
+    memcpy(cpu->regs, checkpoint->regs, sizeof(cpu->regs));
+    cpu->pc = checkpoint->pc;
+    cpu->halted = checkpoint->halted;
+    cpu->breakpoint = checkpoint->breakpoint;
+    cpu->error = checkpoint->error;
+    cpu->error_addr = checkpoint->error_addr;
+    cpu->instruction_count = checkpoint->instruction_count;
+    rec->input_cursor = checkpoint->first_input;
+    
+    // Host fds in the table may have been closed since; nothing touches
+    // them until history has been re-executed up to the live state
+    if (cpu->syscalls && checkpoint->syscalls) {
+        *cpu->syscalls = *checkpoint->syscalls;
+    }
+    
+    return index == rec->base ? 0 : rebase(rec, cpu, index);
+}
+
+int replay_seek(Recording *rec, CPU *cpu, uint64_t instruction_count) {
+    uint64_t start = rec->checkpoints[0].instruction_count;
+    if (instruction_count < start) {
+        return -1;
+    }
+    
+    // Nearest checkpoint at or before the target
+    uint64_t index = (instruction_count - start) / rec->interval;
+    if (index >= rec->checkpoint_count) {
+        index = rec->checkpoint_count - 1;
+    }
+    
+    // Re-executing from where the CPU already is can be cheaper
+    uint64_t now = cpu->instruction_count;
+    if (now > instruction_count || now < rec->checkpoints[index].instruction_count || cpu->halted) {
+        if (restore_checkpoint(rec, cpu, (uint32_t)index) != 0) {
+            return -1;
+        }
+    }
+    
+    while (cpu->instruction_count < instruction_count) {
+        CpuExitInfo info;
+        uint32_t pc = cpu->pc;
+        int planted = cpu_has_breakpoint(cpu, pc);
+        
+        // A planted breakpoint is not part of the guest, so step over it
+        if (planted) {
+            cpu_clear_breakpoint(cpu, pc);
+            replay_run(rec, cpu, 1, &info);
+            cpu_set_breakpoint(cpu, pc);
+        } else {
+            replay_run(rec, cpu, instruction_count - cpu->instruction_count, &info);
+            if (info.reason == CPU_EXIT_BREAKPOINT && cpu_has_breakpoint(cpu, cpu->pc)) {
+                continue;
+            }
+        }
+        if (info.reason != CPU_EXIT_BUDGET) {
+            break;
+        }
+    }
+    return cpu->instruction_count == instruction_count ? 0 : -1;
+}
+
+int replay_reverse_step(Recording *rec, CPU *cpu) {
+    if (cpu->instruction_count == 0) {
+        return -1;
+    }
+    return replay_seek(rec, cpu, cpu->instruction_count - 1);
+}
+
+void replay_io(Recording *rec, const CPU *cpu, void *data, size_t length) {
+    if (rec->input_cursor < rec->input_count) {
+        const InputRecord *input = &rec->inputs[rec->input_cursor++];
+        if (input->length != length) {
+            printf("Replay input at %llu was %zu bytes, now %zu\n",
+                   (unsigned long long)input->instruction_count, input->length, length);
+        }
+        memcpy(data, rec->input_data + input->offset, input->length < length ? input->length : length);
+        return;
+    }
+    
+    if (rec->input_count == rec->input_capacity) {
+        size_t capacity = rec->input_capacity ? rec->input_capacity * 2 : 64;
+        InputRecord *inputs = realloc(rec->inputs, capacity * sizeof(InputRecord));
+        if (!inputs) {
+            printf("Failed to log replay input\n");
+            return;
+        }
+        rec->inputs = inputs;
+        rec->input_capacity = capacity;
+    }
+    if (rec->input_bytes + length > rec->input_data_capacity) {
+        size_t capacity = rec->input_data_capacity ? rec->input_data_capacity : 4096;
+        while (capacity < rec->input_bytes + length) {
+            capacity *= 2;
+        }
+        uint8_t *bytes = realloc(rec->input_data, capacity);
+        if (!bytes) {
+            printf("Failed to log replay input\n");
+            return;
+        }
+        rec->input_data = bytes;
+        rec->input_data_capacity = capacity;
+    }
+    
+    InputRecord *input = &rec->inputs[rec->input_count++];
+    input->instruction_count = cpu->instruction_count;
+    input->offset = rec->input_bytes;
+    input->length = length;
+    memcpy(rec->input_data + rec->input_bytes, data, length);
+    rec->input_bytes += length;
+    rec->input_cursor = rec->input_count;
+}
+
+int replay_replaying(const Recording *rec) {
+    return rec->input_cursor < rec->input_count;
+}
@@ -0,0 +1,111 @@
+// replay.h
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "snapshot.h"
+
+// Deterministic record/replay with periodic checkpoints. While a run is
+// recorded, a checkpoint is taken every interval instructions: registers,
+// PC, counters and the memory pages written since the previous checkpoint.
+// Seeking restores the nearest checkpoint at or before the target and
+// re-executes forward, so it costs at most one interval of execution plus
+// the pages written between the CPU's position and that checkpoint.
+//
+// The CPU's current snapshot (snapshot.h) always sits at a checkpoint and
+// provides the dirty-page tracking, so a CPU being recorded cannot take
+// snapshots of its own. Guard-page mode is not supported. With syscall
+// emulation attached, each checkpoint also keeps the emulated process
+// state (program break, mappings, fd table), so re-executed syscalls see
+// what they saw the first time.
+
+#define REPLAY_INST_PAGE 0x100000u      // Key flag: instruction rather than data page
+
+typedef struct {
+    uint64_t instruction_count;
+    uint32_t regs[32];
+    uint32_t pc;
+    int halted;
+    int breakpoint;
+    CpuError error;
+    uint32_t error_addr;
+    uint32_t *pages;                // Page keys written since the previous checkpoint
+    uint32_t page_count;
+    size_t first_input;             // Inputs logged before this checkpoint
+    struct Syscalls *syscalls;      // Copy of cpu->syscalls, NULL without emulation
+} Checkpoint;
+
+// Contents of one page as of a checkpoint
+typedef struct {
+    uint32_t checkpoint;
+    uint8_t *data;
+} PageVersion;
+
+typedef struct {
+    uint32_t key;                   // Page number, | REPLAY_INST_PAGE for instruction memory
+    uint32_t count;
+    uint32_t capacity;
+    PageVersion *versions;          // Ascending by checkpoint
+    uint32_t restored;              // Last restore that loaded this page
+} PageHistory;
+
+// One logged external input
+typedef struct {
+    uint64_t instruction_count;
+    size_t offset;                  // Into the input data buffer
+    size_t length;
+} InputRecord;
+
+typedef struct Recording {
+    uint64_t interval;
+    Checkpoint *checkpoints;
+    uint32_t checkpoint_count;
+    uint32_t checkpoint_capacity;
+    PageHistory *history;           // Open-addressed by page key
+    uint32_t history_capacity;
+    uint32_t history_count;
+    uint32_t base;                  // Checkpoint the CPU's snapshot was taken at
+    uint32_t restores;              // Restores so far, to load each page once per restore
+    CpuSnapshot snapshot;
+    InputRecord *inputs;
+    size_t input_count;
+    size_t input_capacity;
+    uint8_t *input_data;
+    size_t input_bytes;
+    size_t input_data_capacity;
+    size_t input_cursor;            // Next input to replay; at input_count, new inputs are logged
+} Recording;
+
+// Start recording from the CPU's current state (checkpoint 0), attaching
+// the recording as cpu->recording. Returns 0, or -1 on failure.
+int replay_start(Recording *rec, CPU *cpu, uint64_t interval);
+
+// Detach and free everything, leaving the CPU where it is
+void replay_stop(Recording *rec, CPU *cpu);
+
+// cpu_run_budget() that takes checkpoints as it passes new interval
+// boundaries, and re-anchors on existing ones when re-executing history
+CpuExitReason replay_run(Recording *rec, CPU *cpu, uint64_t max_instructions, CpuExitInfo *exit_info);
+
+// Put the CPU in the state it had after instruction_count instructions.
+// Targets past the recorded history are recorded on the way, and
+// breakpoints planted with cpu_set_breakpoint() do not stop it. Returns 0,
+// or -1 if the target is before the recording or the guest stops first
+// (the CPU is then left where it stopped).
+int replay_seek(Recording *rec, CPU *cpu, uint64_t instruction_count);
+
+// Seek one instruction back
+int replay_reverse_step(Recording *rec, CPU *cpu);
+
+// External inputs (device reads, host calls) pass through here with the
+// bytes the source produced. While recording they are logged; while
+// re-executing recorded history they are replaced by the logged bytes.
+void replay_io(Recording *rec, const CPU *cpu, void *data, size_t length);
+
+// Non-zero while re-executing recorded history, when the next replay_io()
+// comes from the log. Hosts skip side effects they performed the first time.
+int replay_replaying(const Recording *rec);
+
+#endif
@@ -0,0 +1,211 @@
+// rv2c.c
+// Ahead-of-time translator: turns an RV32 image into C source for aot.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aot.h"
+#include "decode.h"
+#include "elf.h"
+#include "trace.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-m bytes] [-n symbol] program output.c\n", prog);
+    printf("  -m bytes   Size of instruction memory (default 64 KiB)\n");
+    printf("  -n symbol  Name of the AotProgram to define (default aot_program)\n");
+    printf("  program    RV32 ELF executable or flat binary\n");
+}
+
+// Operand as a C expression; x0 reads as a constant
+static const char *reg(char *buffer, uint32_t r) {
+    if (r == 0) {
+        return "0u";
+    }
+    sprintf(buffer, "x[%u]", r);
+    return buffer;
+}
+
+static int translatable(const Instruction *inst) {
+    return inst->op >= OP_ADD && inst->op < OP_COUNT;
+}
+
+static void emit_instruction(FILE *out, const Instruction *inst) {
+    char a_buffer[16], b_buffer[16];
+    const char *a = reg(a_buffer, inst->rs1);
+    const char *b = reg(b_buffer, inst->rs2);
+    
+    if (inst->rd == 0) {
+        fprintf(out, "        // %s x0, x%u, x%u: no effect\n", get_operation_name(inst->op),
+                inst->rs1, inst->rs2);
+        return;
+    }
+    fprintf(out, "        x[%u] = ", inst->rd);
+    
+    // Comparing or cancelling a register with itself gives zero
+    int zero = inst->rs1 == inst->rs2 && (inst->op == OP_SUB || inst->op == OP_XOR ||
+                                          inst->op == OP_SLT || inst->op == OP_SLTU);
+    
+    switch (zero ? OP_ILLEGAL : inst->op) {
+        case OP_ADD:  fprintf(out, "%s + %s;", a, b); break;
+        case OP_SUB:  fprintf(out, "%s - %s;", a, b); break;
+        case OP_SLL:  fprintf(out, "%s << (%s & 0x1F);", a, b); break;
+        case OP_SLT:  fprintf(out, "(int32_t)%s < (int32_t)%s;", a, b); break;
+        case OP_SLTU: fprintf(out, "%s < %s;", a, b); break;
+        case OP_XOR:  fprintf(out, "%s ^ %s;", a, b); break;
+        case OP_SRL:  fprintf(out, "%s >> (%s & 0x1F);", a, b); break;
+        case OP_SRA:  fprintf(out, "(uint32_t)((int32_t)%s >> (%s & 0x1F));", a, b); break;
+        case OP_OR:   fprintf(out, "%s | %s;", a, b); break;
+        case OP_AND:  fprintf(out, "%s & %s;", a, b); break;
+        default:      fprintf(out, "0u;"); break;
+    }
+    fprintf(out, "    // %s x%u, x%u, x%u\n", get_operation_name(inst->op),
+            inst->rd, inst->rs1, inst->rs2);
+}
+
+// Every translated word is straight-line code, so the image becomes one
+// run of case labels that fall through into each other. A block starts at
+// the base, the entry point, after each untranslated word and every
+// AOT_BLOCK_MAX_OPS instructions; each checks the remaining budget once.
+static void translate(FILE *out, const char *source, const char *symbol, const uint32_t *words,
+                      uint32_t count, uint32_t entry) {
+    Instruction *insts = malloc((count ? count : 1) * sizeof(Instruction));
+    uint32_t blocks = 0;
+    uint32_t translated = 0;
+    
+    if (!insts) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        decode_instruction(words[n], &insts[n]);
+    }
+    
+    fprintf(out, "// Generated by rv2c from %s. Do not edit.\n", source);
+    fprintf(out, "#include \"aot.h\"\n\n");
+    fprintf(out, "static const uint32_t words[%u] = {", count ? count : 1);
+    for (uint32_t n = 0; n < count; n++) {
+        fprintf(out, "%s0x%08x,", n % 8 ? " " : "\n    ", words[n]);
+    }
+    fprintf(out, "\n};\n\n");
+    
+    fprintf(out, "static uint64_t run(CPU *cpu, uint64_t max_instructions) {\n");
+    fprintf(out, "    uint32_t *x = cpu->regs;\n");
+    fprintf(out, "    uint64_t executed = 0;\n\n");
+    fprintf(out, "    switch (cpu->pc) {\n");
+    
+    uint32_t n = 0;
+    while (n < count) {
+        if (!translatable(&insts[n])) {
+            n++;
+            continue;
+        }
+        
+        // Extend the block to the next untranslated word, block limit or entry point
+        uint32_t start = n;
+        uint32_t end = n + 1;
+        while (end < count && end - start < AOT_BLOCK_MAX_OPS && translatable(&insts[end]) &&
+               end * 4 != entry) {
+            end++;
+        }
+        
+        fprintf(out, "    case 0x%08x:\n", start * 4);
+        fprintf(out, "        if (max_instructions - executed < %u) {\n", end - start);
+        fprintf(out, "            cpu->pc = 0x%08x;\n", start * 4);
+        fprintf(out, "            break;\n");
+        fprintf(out, "        }\n");
+        for (uint32_t i = start; i < end; i++) {
+            emit_instruction(out, &insts[i]);
+        }
+        fprintf(out, "        executed += %u;\n", end - start);
+        
+        if (end < count && translatable(&insts[end])) {
+            fprintf(out, "        // fall through\n");
+        } else {
+            const char *what = end < count ? get_operation_name(insts[end].op) : "end of image";
+            fprintf(out, "        cpu->pc = 0x%08x;    // %s: left to the interpreter\n", end * 4, what);
+            fprintf(out, "        break;\n");
+        }
+        blocks++;
+        translated += end - start;
+        n = end;
+    }
+    
+    fprintf(out, "    default:\n");
+    fprintf(out, "        break;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return executed;\n");
+    fprintf(out, "}\n\n");
+    fprintf(out, "const AotProgram %s = { 0x00000000, %u, words, run };\n", symbol, count);
+    
+    printf("Translated %u of %u instructions into %u blocks\n", translated, count, blocks);
+    free(insts);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int mem_size = 64 * 1024;
+    const char *symbol = "aot_program";
+    const char *paths[2];
+    int path_count = 0;
+    
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            mem_size = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+            symbol = argv[++arg];
+        } else if (argv[arg][0] != '-' && path_count < 2) {
+            paths[path_count++] = argv[arg];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path_count != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // Load the image the way the emulator does, so addresses agree
+    CPU cpu;
+    ElfImage image;
+    int have_image = 0;
+    trace_set_verbosity(TRACE_LEVEL_ERRORS);
+    cpu_init(&cpu, mem_size, CPU_DATA_MEM_FULL);
+    if (elf_is_elf_file(paths[0])) {
+        if (elf_load(&cpu, paths[0], &image) != 0) {
+            cpu_destroy(&cpu);
+            return 1;
+        }
+        have_image = 1;
+    } else if (cpu_load_inst_binary(&cpu, paths[0]) != 0) {
+        cpu_destroy(&cpu);
+        return 1;
+    }
+    
+    // Trailing zero words are halts; the interpreter handles them
+    uint32_t count = mem_size / 4;
+    while (count > 0 && cpu_read_inst_word(&cpu, (count - 1) * 4) == 0) {
+        count--;
+    }
+    uint32_t *words = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!words) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        words[n] = cpu_read_inst_word(&cpu, n * 4);
+    }
+    
+    FILE *out = fopen(paths[1], "w");
+    if (!out) {
+        printf("Failed to open output file: %s\n", paths[1]);
+        return 1;
+    }
+    translate(out, paths[0], symbol, words, count, cpu_get_pc(&cpu));
+    fclose(out);
+    
+    free(words);
+    if (have_image) {
+        elf_image_destroy(&image);
+    }
+    cpu_destroy(&cpu);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// snapshot.c
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t inst_page_count(const CPU *cpu) {
+    return (cpu->inst_mem_size + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT;
+}
+
+int cpu_snapshot(CPU *cpu, CpuSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    
+    if (cpu->guard_data) {
+        printf("Snapshots need paged data memory, not guard-page mode\n");
+        return -1;
+    }
+    
+    snapshot->inst_memory = malloc(cpu->inst_mem_size ? cpu->inst_mem_size : 1);
+    if (!cpu->inst_dirty) {
+        cpu->inst_dirty = calloc(inst_page_count(cpu) + 1, 1);
+    }
+    if (!snapshot->inst_memory || !cpu->inst_dirty) {
+        printf("Failed to allocate snapshot\n");
+        free(snapshot->inst_memory);
+        snapshot->inst_memory = NULL;
+        return -1;
+    }
+    
+    memcpy(snapshot->regs, cpu->regs, sizeof(snapshot->regs));
+    snapshot->pc = cpu->pc;
+    snapshot->halted = cpu->halted;
+    snapshot->breakpoint = cpu->breakpoint;
+    snapshot->error = cpu->error;
+    snapshot->error_addr = cpu->error_addr;
+    snapshot->instruction_count = cpu->instruction_count;
+    snapshot->state_hash = cpu->state_hash;
+    
+    // Instruction memory is small and flat, so it is copied once here;
+    // data memory pages are shared until written
+    memcpy(snapshot->inst_memory, cpu->inst_memory, cpu->inst_mem_size);
+    memset(cpu->inst_dirty, 0, inst_page_count(cpu) + 1);
+    paged_snapshot(&cpu->data_memory);
+    
+    snapshot->epoch = ++cpu->snapshot_epoch;
+    return 0;
+}
+
+int cpu_restore(CPU *cpu, const CpuSnapshot *snapshot) {
+    if (!cpu->inst_dirty || snapshot->epoch != cpu->snapshot_epoch) {
+        printf("Snapshot is not current for this CPU\n");
+        return -1;
+    }
+    
+    memcpy(cpu->regs, snapshot->regs, sizeof(cpu->regs));
+    cpu->pc = snapshot->pc;
+    cpu->halted = snapshot->halted;
+    cpu->breakpoint = snapshot->breakpoint;
+    cpu->error = snapshot->error;
+    cpu->error_addr = snapshot->error_addr;
+    cpu->instruction_count = snapshot->instruction_count;
+    cpu->state_hash = snapshot->state_hash;
+    
+    // Put back written instruction pages and drop their predecoded slots
+    int code_changed = 0;
+    for (uint32_t page = 0; page < inst_page_count(cpu); page++) {
+        if (!cpu->inst_dirty[page]) {
+            continue;
+        }
+        
+        uint32_t start = page << MEM_PAGE_SHIFT;
+        uint32_t length = cpu->inst_mem_size - start < MEM_PAGE_SIZE ?
+                          cpu->inst_mem_size - start : MEM_PAGE_SIZE;
+        memcpy(cpu->inst_memory + start, snapshot->inst_memory + start, length);
+        memset(cpu->decoded_valid + start / 4, 0, (length + 3) / 4);
+        if (start > 0) {
+            cpu->decoded_valid[start / 4 - 1] = 0;  // May be fused into this page
+        }
+        cpu->inst_dirty[page] = 0;
+        code_changed = 1;
+    }
+    if (code_changed) {
+        cpu->code_generation++;
+    }
+    
+    paged_restore(&cpu->data_memory);
+    return 0;
+}
+
+void cpu_snapshot_free(CPU *cpu, CpuSnapshot *snapshot) {
+    // Freeing the current snapshot stops page tracking altogether
+    if (cpu->inst_dirty && snapshot->epoch == cpu->snapshot_epoch) {
+        paged_release_snapshot(&cpu->data_memory);
+        free(cpu->inst_dirty);
+        cpu->inst_dirty = NULL;
+    }
+    
+    free(snapshot->inst_memory);
+    snapshot->inst_memory = NULL;
+}
@@ -0,0 +1,38 @@
+// snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Full machine state captured once, for forking many runs from one
+// checkpoint. Memory is tracked per 4 KiB page: data pages are shared
+// copy-on-write with the snapshot, and instruction pages are marked when
+// written, so a restore only rewrites pages dirtied since the snapshot.
+//
+// A CPU has one current snapshot; taking a new one supersedes the last,
+// and restoring a superseded snapshot fails. Free snapshots before
+// destroying their CPU.
+typedef struct {
+    uint32_t regs[32];
+    uint32_t pc;
+    int halted;
+    int breakpoint;
+    CpuError error;
+    uint32_t error_addr;
+    uint64_t instruction_count;
+    uint64_t state_hash;
+    uint8_t *inst_memory;           // Instruction memory as of the snapshot
+    uint32_t epoch;                 // Matches cpu->snapshot_epoch while current
+} CpuSnapshot;
+
+// Returns 0 on success, -1 if the instruction memory copy cannot be
+// allocated or the CPU uses guard-page memory
+int cpu_snapshot(CPU *cpu, CpuSnapshot *snapshot);
+
+// Returns 0 on success, -1 if the snapshot is no longer the CPU's current one
+int cpu_restore(CPU *cpu, const CpuSnapshot *snapshot);
+
+void cpu_snapshot_free(CPU *cpu, CpuSnapshot *snapshot);
+
+#endif
@@ -0,0 +1,549 @@
+// syscalls.c
+#include "syscalls.h"
+#include "mmio.h"
+#include "replay.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+// Guest open flags and constants (asm-generic values)
+#define GUEST_O_ACCMODE   03
+#define GUEST_O_CREAT     0100
+#define GUEST_O_EXCL      0200
+#define GUEST_O_NOCTTY    0400
+#define GUEST_O_TRUNC     01000
+#define GUEST_O_APPEND    02000
+#define GUEST_O_NONBLOCK  04000
+#define GUEST_O_DIRECTORY 0200000
+#define GUEST_O_CLOEXEC   02000000
+#define GUEST_AT_FDCWD    -100
+#define GUEST_MAP_FIXED   0x10
+#define GUEST_MAP_ANON    0x20
+#define GUEST_PATH_MAX    4096
+
+// Results are -errno with the host's errno values. They match Linux on
+// Linux hosts, and for the common low-numbered codes elsewhere.
+
+static const uint8_t zero_page[MEM_PAGE_SIZE];
+
+static uint32_t page_round_up(uint32_t value) {
+    return (value + MEM_PAGE_MASK) & ~MEM_PAGE_MASK;
+}
+
+static int host_fd(const Syscalls *sys, uint32_t fd) {
+    return fd < SYSCALL_MAX_FDS ? sys->fds[fd] : -1;
+}
+
+// Under record/replay, host results are logged the first time and read
+// back from the log while history is re-executed
+static int replaying(CPU *cpu) {
+    return cpu->recording && replay_replaying(cpu->recording);
+}
+
+static void log_input(CPU *cpu, void *data, size_t length) {
+    if (cpu->recording) {
+        replay_io(cpu->recording, cpu, data, length);
+    }
+}
+
+static int range_ok(CPU *cpu, uint32_t addr, uint64_t length) {
+    return (uint64_t)addr + length <= cpu->data_mem_size;
+}
+
+// XOR of the state-hash contributions of the words overlapping a range
+static uint64_t hash_range(CPU *cpu, uint32_t addr, size_t length) {
+    uint64_t hash = 0;
+    uint64_t end = (uint64_t)addr + length;
+    
+    for (uint64_t word = addr & ~3u; word < end; word += 4) {
+        uint8_t bytes[4];
+        paged_read(&cpu->data_memory, (uint32_t)word, bytes, 4);
+        hash ^= paged_word_hash((uint32_t)word, bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+                                                ((uint32_t)bytes[3] << 24));
+    }
+    return hash;
+}
+
+// Describe guest [addr, addr + length) as iovecs pointing into the guest's
+// own pages, covering at most SYSCALL_IOV_PAGES pages. For host writes into
+// the guest (writable), pages are allocated, and unshared from any
+// snapshot, first. Returns the iovec count, or -1 if the range is bad.
+static int guest_iovecs(CPU *cpu, uint32_t addr, uint32_t length, int writable,
+                        struct iovec *iov, size_t *covered) {
+    int count = 0;
+    size_t total = 0;
+    
+    if (!range_ok(cpu, addr, length)) {
+        return -1;
+    }
+    if (cpu->guard_data) {
+        iov[0].iov_base = cpu->guard_data + addr;
+        iov[0].iov_len = length;
+        *covered = length;
+        return 1;
+    }
+    
+    for (int pages = 0; total < length && pages < SYSCALL_IOV_PAGES; pages++) {
+        uint32_t at = addr + (uint32_t)total;
+        uint32_t offset = at & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset;
+        if (chunk > length - total) {
+            chunk = length - total;
+        }
+        
+        uint8_t *page = writable ? paged_lookup_write(&cpu->data_memory, at) :
+                                   paged_lookup(&cpu->data_memory, at);
+        if (!page) {
+            // Device pages have no RAM; other absent pages read as zero
+            if (writable || (cpu->bus && mmio_find(cpu->bus, at))) {
+                return -1;
+            }
+            page = (uint8_t *)zero_page;
+        }
+        
+        // Pages mapped from one host mapping (e.g. ELF segments) are adjacent
+        uint8_t *base = page + offset;
+        if (count > 0 && (uint8_t *)iov[count - 1].iov_base + iov[count - 1].iov_len == base) {
+            iov[count - 1].iov_len += chunk;
+        } else {
+            iov[count].iov_base = base;
+            iov[count].iov_len = chunk;
+            count++;
+        }
+        total += chunk;
+    }
+    
+    *covered = total;
+    return count;
+}
+
+// Copy host data into the guest, keeping the state hash current
+static int put_guest(CPU *cpu, uint32_t addr, const void *data, size_t length) {
+    if (!range_ok(cpu, addr, length)) {
+        return -1;
+    }
+    if (cpu->guard_data) {
+        memcpy(cpu->guard_data + addr, data, length);
+        return 0;
+    }
+    
+    uint64_t before = cpu->state_hashing ? hash_range(cpu, addr, length) : 0;
+    if (paged_write(&cpu->data_memory, addr, data, length) != 0) {
+        return -1;
+    }
+    if (cpu->state_hashing) {
+        cpu->state_hash ^= before ^ hash_range(cpu, addr, length);
+    }
+    return 0;
+}
+
+// Zero a guest range, touching only pages that hold data
+static void zero_guest(CPU *cpu, uint32_t addr, uint32_t length) {
+    uint64_t end = (uint64_t)addr + length;
+    
+    for (uint64_t at = addr; at < end; ) {
+        uint64_t page_end = (at | MEM_PAGE_MASK) + 1;
+        size_t chunk = (page_end < end ? page_end : end) - at;
+        if (cpu->guard_data || paged_lookup(&cpu->data_memory, (uint32_t)at)) {
+            put_guest(cpu, (uint32_t)at, zero_page, chunk);
+        }
+        at += chunk;
+    }
+}
+
+static int get_guest_string(CPU *cpu, uint32_t addr, char *dst, size_t capacity) {
+    for (size_t n = 0; n < capacity; n++) {
+        if (!range_ok(cpu, addr + (uint32_t)n, 1)) {
+            return -1;
+        }
+        if (cpu->guard_data) {
+            dst[n] = (char)cpu->guard_data[addr + n];
+        } else {
+            paged_read(&cpu->data_memory, addr + (uint32_t)n, &dst[n], 1);
+        }
+        if (dst[n] == '\0') {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void put_le32(uint8_t *bytes, uint32_t value) {
+    for (int b = 0; b < 4; b++) {
+        bytes[b] = (value >> (b * 8)) & 0xFF;
+    }
+}
+
+static int32_t sys_read(Syscalls *sys, CPU *cpu, uint32_t fd, uint32_t addr, uint32_t length) {
+    int host = host_fd(sys, fd);
+    struct iovec iov[SYSCALL_IOV_PAGES];
+    size_t covered;
+    int32_t result;
+    
+    if (!range_ok(cpu, addr, length)) {
+        return -EFAULT;
+    }
+    
+    if (cpu->recording) {
+        // The bytes must be logged, so they are staged through a buffer.
+        // One call reads at most what one readv covers below.
+        if (length > SYSCALL_IOV_PAGES * MEM_PAGE_SIZE) {
+            length = SYSCALL_IOV_PAGES * MEM_PAGE_SIZE;
+        }
+        uint8_t *buffer = malloc(length ? length : 1);
+        if (!buffer) {
+            return -ENOMEM;
+        }
+        if (replaying(cpu)) {
+            result = 0;
+        } else if (host < 0) {
+            result = -EBADF;
+        } else {
+            ssize_t got = read(host, buffer, length);
+            result = got < 0 ? -errno : (int32_t)got;
+        }
+        log_input(cpu, &result, sizeof(result));
+        if (result > 0) {
+            log_input(cpu, buffer, (size_t)result);
+            if (put_guest(cpu, addr, buffer, (size_t)result) != 0) {
+                result = -EFAULT;
+            }
+        }
+        free(buffer);
+        return result;
+    }
+    
+    if (host < 0) {
+        return -EBADF;
+    }
+    int count = guest_iovecs(cpu, addr, length, 1, iov, &covered);
+    if (count < 0) {
+        return -EFAULT;
+    }
+    
+    uint64_t before = cpu->state_hashing ? hash_range(cpu, addr, covered) : 0;
+    ssize_t got = readv(host, iov, count);
+    if (cpu->state_hashing) {
+        cpu->state_hash ^= before ^ hash_range(cpu, addr, covered);
+    }
+    return got < 0 ? -errno : (int32_t)got;
+}
+
+static int32_t sys_write(Syscalls *sys, CPU *cpu, uint32_t fd, uint32_t addr, uint32_t length) {
+    int host = host_fd(sys, fd);
+    struct iovec iov[SYSCALL_IOV_PAGES];
+    int32_t result = 0;
+    
+    if (replaying(cpu)) {
+        log_input(cpu, &result, sizeof(result));
+        return result;
+    }
+    
+    if (host < 0) {
+        result = -EBADF;
+    } else if (!range_ok(cpu, addr, length)) {
+        result = -EFAULT;
+    }
+    
+    // Large buffers go out SYSCALL_IOV_PAGES pages per writev
+    while (result >= 0 && (uint32_t)result < length) {
+        size_t covered;
+        int count = guest_iovecs(cpu, addr + (uint32_t)result, length - (uint32_t)result, 0,
+                                 iov, &covered);
+        if (count < 0) {
+            result = result ? result : -EFAULT;
+            break;
+        }
+        ssize_t sent = writev(host, iov, count);
+        if (sent < 0) {
+            result = result ? result : -errno;
+            break;
+        }
+        result += (int32_t)sent;
+        if ((size_t)sent < covered) {
+            break;
+        }
+    }
+    
+    log_input(cpu, &result, sizeof(result));
+    return result;
+}
+
+static int open_flags(uint32_t flags) {
+    int host = (flags & GUEST_O_ACCMODE) == 1 ? O_WRONLY :
+               (flags & GUEST_O_ACCMODE) == 2 ? O_RDWR : O_RDONLY;
+    if (flags & GUEST_O_CREAT)     host |= O_CREAT;
+    if (flags & GUEST_O_EXCL)      host |= O_EXCL;
+    if (flags & GUEST_O_NOCTTY)    host |= O_NOCTTY;
+    if (flags & GUEST_O_TRUNC)     host |= O_TRUNC;
+    if (flags & GUEST_O_APPEND)    host |= O_APPEND;
+    if (flags & GUEST_O_NONBLOCK)  host |= O_NONBLOCK;
+    if (flags & GUEST_O_DIRECTORY) host |= O_DIRECTORY;
+    if (flags & GUEST_O_CLOEXEC)   host |= O_CLOEXEC;
+    return host;
+}
+
+static int32_t sys_openat(Syscalls *sys, CPU *cpu, int32_t dirfd, uint32_t path_addr,
+                          uint32_t flags, uint32_t mode) {
+    char path[GUEST_PATH_MAX];
+    int32_t result = 0;
+    int32_t host = -1;
+    int slot = 3;
+    
+    while (slot < SYSCALL_MAX_FDS && sys->fds[slot] >= 0) {
+        slot++;
+    }
+    
+    // The host fd is logged too, so a replayed open fills the same slot
+    // and later calls on it are replayed rather than failing
+    if (replaying(cpu)) {
+        log_input(cpu, &result, sizeof(result));
+        log_input(cpu, &host, sizeof(host));
+        if (result >= 0 && result < SYSCALL_MAX_FDS) {
+            sys->fds[result] = host;
+            sys->owned[result] = 1;
+        }
+        return result;
+    }
+    
+    if (get_guest_string(cpu, path_addr, path, sizeof(path)) != 0) {
+        result = -EFAULT;
+    } else if (slot == SYSCALL_MAX_FDS) {
+        result = -EMFILE;
+    } else {
+        int host_dir = dirfd == GUEST_AT_FDCWD ? AT_FDCWD : host_fd(sys, (uint32_t)dirfd);
+        host = host_dir == -1 ? -1 : openat(host_dir, path, open_flags(flags), (mode_t)mode);
+        if (host_dir == -1) {
+            result = -EBADF;
+        } else if (host < 0) {
+            result = -errno;
+        } else {
+            sys->fds[slot] = host;
+            sys->owned[slot] = 1;
+            result = slot;
+        }
+    }
+    
+    log_input(cpu, &result, sizeof(result));
+    log_input(cpu, &host, sizeof(host));
+    return result;
+}
+
+static int32_t sys_close(Syscalls *sys, CPU *cpu, uint32_t fd) {
+    int host = host_fd(sys, fd);
+    int32_t result = 0;
+    
+    if (host < 0) {
+        return -EBADF;
+    }
+    // The host's own stdin, stdout and stderr stay open
+    if (sys->owned[fd] && !replaying(cpu) && close(host) != 0) {
+        result = -errno;
+    }
+    sys->fds[fd] = -1;
+    sys->owned[fd] = 0;
+    return result;
+}
+
+static int32_t sys_llseek(Syscalls *sys, CPU *cpu, uint32_t fd, uint32_t high, uint32_t low,
+                          uint32_t result_addr, uint32_t whence) {
+    int host = host_fd(sys, fd);
+    int64_t offset = (int64_t)(((uint64_t)high << 32) | low);
+    int64_t position = 0;
+    int32_t result = 0;
+    
+    if (replaying(cpu)) {
+        result = 0;
+    } else if (host < 0) {
+        result = -EBADF;
+    } else if (whence > 2) {
+        result = -EINVAL;
+    } else {
+        off_t moved = lseek(host, (off_t)offset, whence == 0 ? SEEK_SET : whence == 1 ? SEEK_CUR : SEEK_END);
+        if (moved < 0) {
+            result = -errno;
+        } else {
+            position = moved;
+        }
+    }
+    log_input(cpu, &result, sizeof(result));
+    log_input(cpu, &position, sizeof(position));
+    
+    if (result == 0) {
+        uint8_t bytes[8];
+        put_le32(bytes, (uint32_t)position);
+        put_le32(bytes + 4, (uint32_t)((uint64_t)position >> 32));
+        if (put_guest(cpu, result_addr, bytes, sizeof(bytes)) != 0) {
+            result = -EFAULT;
+        }
+    }
+    return result;
+}
+
+static int32_t sys_clock_gettime(CPU *cpu, uint32_t clock, uint32_t addr, int time64) {
+    static const clockid_t clocks[] = {
+        CLOCK_REALTIME, CLOCK_MONOTONIC, CLOCK_PROCESS_CPUTIME_ID, CLOCK_THREAD_CPUTIME_ID,
+        CLOCK_MONOTONIC, CLOCK_REALTIME, CLOCK_MONOTONIC, CLOCK_MONOTONIC
+    };
+    struct timespec now = { 0, 0 };
+    uint8_t bytes[16];
+    int32_t result = 0;
+    
+    if (clock >= sizeof(clocks) / sizeof(clocks[0])) {
+        return -EINVAL;
+    }
+    if (!replaying(cpu) && clock_gettime(clocks[clock], &now) != 0) {
+        result = -errno;
+    }
+    
+    // The guest layout is what gets logged
+    int64_t seconds = now.tv_sec;
+    if (time64) {
+        put_le32(bytes, (uint32_t)seconds);
+        put_le32(bytes + 4, (uint32_t)((uint64_t)seconds >> 32));
+        put_le32(bytes + 8, (uint32_t)now.tv_nsec);
+        put_le32(bytes + 12, 0);
+    } else {
+        put_le32(bytes, (uint32_t)seconds);
+        put_le32(bytes + 4, (uint32_t)now.tv_nsec);
+    }
+    size_t length = time64 ? 16 : 8;
+    log_input(cpu, &result, sizeof(result));
+    log_input(cpu, bytes, length);
+    
+    if (result == 0 && put_guest(cpu, addr, bytes, length) != 0) {
+        result = -EFAULT;
+    }
+    return result;
+}
+
+static int32_t sys_brk(Syscalls *sys, CPU *cpu, uint32_t addr) {
+    // Out-of-range requests, including brk(0), report the current break
+    if (addr < sys->brk_base || addr > sys->mmap_bottom) {
+        return (int32_t)sys->brk;
+    }
+    // Shrinking clears the released memory, so growing again finds zeros
+    if (addr < sys->brk) {
+        zero_guest(cpu, addr, sys->brk - addr);
+    }
+    sys->brk = addr;
+    return (int32_t)addr;
+}
+
+static int32_t sys_mmap(Syscalls *sys, CPU *cpu, uint32_t length, uint32_t flags) {
+    if (!(flags & GUEST_MAP_ANON) || (flags & GUEST_MAP_FIXED)) {
+        return -ENODEV;     // Only fresh anonymous mappings
+    }
+    length = page_round_up(length);
+    if (length == 0 || length > sys->mmap_bottom ||
+        sys->mmap_bottom - length < page_round_up(sys->brk)) {
+        return -ENOMEM;
+    }
+    
+    sys->mmap_bottom -= length;
+    zero_guest(cpu, sys->mmap_bottom, length);
+    return (int32_t)sys->mmap_bottom;
+}
+
+static int32_t sys_munmap(Syscalls *sys, CPU *cpu, uint32_t addr, uint32_t length) {
+    length = page_round_up(length);
+    if ((addr & MEM_PAGE_MASK) || !range_ok(cpu, addr, length)) {
+        return -EINVAL;
+    }
+    zero_guest(cpu, addr, length);
+    // Only the lowest mapping gives its space back
+    if (addr == sys->mmap_bottom) {
+        sys->mmap_bottom += length;
+    }
+    return 0;
+}
+
+void syscall_handle(CPU *cpu) {
+    Syscalls *sys = cpu->syscalls;
+    uint32_t *a = &cpu->regs[10];
+    uint32_t number = cpu->regs[17];
+    int32_t result;
+    
+    sys->calls++;
+    switch (number) {
+        case SYS_READ:
+            result = sys_read(sys, cpu, a[0], a[1], a[2]);
+            break;
+        case SYS_WRITE:
+            result = sys_write(sys, cpu, a[0], a[1], a[2]);
+            break;
+        case SYS_OPENAT:
+            result = sys_openat(sys, cpu, (int32_t)a[0], a[1], a[2], a[3]);
+            break;
+        case SYS_CLOSE:
+            result = sys_close(sys, cpu, a[0]);
+            break;
+        case SYS_LSEEK:
+            result = sys_llseek(sys, cpu, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case SYS_BRK:
+            result = sys_brk(sys, cpu, a[0]);
+            break;
+        case SYS_MMAP:
+            result = sys_mmap(sys, cpu, a[1], a[3]);
+            break;
+        case SYS_MUNMAP:
+            result = sys_munmap(sys, cpu, a[0], a[1]);
+            break;
+        case SYS_CLOCK_GETTIME:
+        case SYS_CLOCK_GETTIME64:
+            result = sys_clock_gettime(cpu, a[0], a[1], number == SYS_CLOCK_GETTIME64);
+            break;
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            TRACE_INST("exit(%d) at PC=0x%08x\n", (int32_t)a[0], cpu->pc);
+            sys->exited = 1;
+            sys->exit_code = (int32_t)a[0];
+            cpu->halted = 1;
+            return;
+        default:
+            TRACE_ERROR("Unsupported syscall %u at PC=0x%08x\n", number, cpu->pc);
+            result = -ENOSYS;
+            break;
+    }
+    
+    TRACE_INST("syscall %u -> %d\n", number, result);
+    cpu->regs[10] = (uint32_t)result;
+}
+
+void syscall_init(Syscalls *sys, CPU *cpu, uint32_t brk_base) {
+    memset(sys, 0, sizeof(*sys));
+    for (int fd = 0; fd < SYSCALL_MAX_FDS; fd++) {
+        sys->fds[fd] = fd < 3 ? fd : -1;
+    }
+    
+    uint32_t stack_top = cpu->data_mem_size < SYSCALL_STACK_TOP ?
+                         (uint32_t)cpu->data_mem_size & ~MEM_PAGE_MASK : SYSCALL_STACK_TOP;
+    sys->brk_base = page_round_up(brk_base);
+    sys->brk = sys->brk_base;
+    sys->mmap_bottom = stack_top > SYSCALL_STACK_SIZE ? stack_top - SYSCALL_STACK_SIZE : 0;
+    
+    // Zeroed memory already reads as argc 0 and empty argv, envp and auxv
+    if (cpu->regs[2] == 0 && stack_top >= 16) {
+        cpu->regs[2] = stack_top - 16;
+    }
+    cpu->syscalls = sys;
+}
+
+void syscall_destroy(Syscalls *sys, CPU *cpu) {
+    for (int fd = 0; fd < SYSCALL_MAX_FDS; fd++) {
+        if (sys->owned[fd]) {
+            close(sys->fds[fd]);
+        }
+        sys->fds[fd] = -1;
+        sys->owned[fd] = 0;
+    }
+    if (cpu->syscalls == sys) {
+        cpu->syscalls = NULL;
+    }
+}
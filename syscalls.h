@@ -0,0 +1,60 @@
+// syscalls.h
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// RV32 Linux syscall numbers (the asm-generic table)
+#define SYS_OPENAT          56
+#define SYS_CLOSE           57
+#define SYS_LSEEK           62      // llseek: fd, offset high, offset low, result pointer, whence
+#define SYS_READ            63
+#define SYS_WRITE           64
+#define SYS_EXIT            93
+#define SYS_EXIT_GROUP      94
+#define SYS_CLOCK_GETTIME   113     // 32-bit timespec
+#define SYS_BRK             214
+#define SYS_MUNMAP          215
+#define SYS_MMAP            222     // mmap2: offset in 4 KiB units
+#define SYS_CLOCK_GETTIME64 403
+
+#define SYSCALL_MAX_FDS     64
+#define SYSCALL_STACK_TOP   0xC0000000u         // Initial sp, or the top of smaller data memories
+#define SYSCALL_STACK_SIZE  (8 * 1024 * 1024)   // Kept clear of anonymous mappings
+#define SYSCALL_IOV_PAGES   256                 // Guest pages handed to one readv/writev
+#define SYSCALL_DEFAULT_BRK 0x00100000u         // Heap start without an ELF data segment
+
+// Linux user-mode process state behind ECALL
+typedef struct Syscalls {
+    int fds[SYSCALL_MAX_FDS];       // Host fd behind each guest fd, -1 if closed
+    int owned[SYSCALL_MAX_FDS];     // Host fd was opened by the guest and is closed with it
+    uint32_t brk_base;              // Lowest program break
+    uint32_t brk;                   // Current program break
+    uint32_t mmap_bottom;           // Anonymous mappings grow down to here
+    int exited;                     // The guest called exit or exit_group
+    int exit_code;
+    uint64_t calls;
+} Syscalls;
+
+// Attach syscall emulation to cpu. ECALL then runs the syscall numbered in
+// a7 with arguments in a0-a5, and returns the result (or -errno) in a0.
+// Guest fds 0-2 are the host's stdin, stdout and stderr. The heap starts
+// at brk_base (e.g. ElfImage.data_end). If sp is still 0 it is pointed at
+// an empty argc/argv/envp/auxv block below SYSCALL_STACK_TOP.
+//
+// read and write hand guest pages to readv/writev directly after one range
+// check, so guest I/O is not copied through the emulator. Under record/
+// replay, host-facing calls are logged with replay_io() and not repeated
+// while history is re-executed; host files are not rewound. The rest of
+// this state is saved in replay checkpoints. A read under recording
+// returns at most SYSCALL_IOV_PAGES pages, as one readv would.
+void syscall_init(Syscalls *sys, CPU *cpu, uint32_t brk_base);
+
+// Close files the guest left open and detach
+void syscall_destroy(Syscalls *sys, CPU *cpu);
+
+// Run the syscall for the ECALL at cpu->pc. exit and exit_group halt the CPU.
+void syscall_handle(CPU *cpu);
+
+#endif
@@ -0,0 +1,240 @@
+// threaded.c
+#include "threaded.h"
+#include "execute.h"
+#include "profile.h"
+
+#ifndef USE_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define USE_COMPUTED_GOTO 1
+#else
+#define USE_COMPUTED_GOTO 0
+#endif
+#endif
+
+// Fused pairs get handlers after the plain operations
+#define OP_FUSED_ADDSUB (OP_COUNT + FUSE_ADDSUB)
+#define OP_FUSED_SHIFT  (OP_COUNT + FUSE_SHIFT)
+#define OP_FUSED_CARRY  (OP_COUNT + FUSE_CARRY)
+#define HANDLER_COUNT   (OP_COUNT + FUSE_COUNT)
+#define OP_PROFILE      HANDLER_COUNT   // Instrumented entry, see below
+
+// With a profile attached every dispatch goes through OP_PROFILE first;
+// without one the plain table is used and profiling costs nothing
+#if USE_COMPUTED_GOTO
+#define TARGET(op) L_##op
+#define DISPATCH() goto *table[inst->dispatch]
+#define DISPATCH_SINGLE() goto *labels[inst->op]
+#else
+#define TARGET(op) case op
+#define DISPATCH() do { handler = profile ? OP_PROFILE : inst->dispatch; goto dispatch; } while (0)
+#define DISPATCH_SINGLE() do { handler = inst->op; goto dispatch; } while (0)
+#endif
+
+// Advance past the current instruction and jump to the next handler.
+// x0 is re-zeroed after every write instead of testing rd.
+#define NEXT()                                              \
+    do {                                                    \
+        regs[0] = 0;                                        \
+        pc += 4;                                            \
+        if (++executed >= max_instructions) goto out;       \
+        inst = fetch(cpu, pc, ready);                       \
+        if (!inst) goto out;                                \
+        DISPATCH();                                         \
+    } while (0)
+
+// Run a fused pair: both instructions retire, then on to the one after
+#define NEXT_PAIR(fusion)                                   \
+    do {                                                    \
+        cpu->fusion_hits[fusion]++;                         \
+        regs[0] = 0;                                        \
+        pc += 8;                                            \
+        executed += 2;                                      \
+        if (executed >= max_instructions) goto out;         \
+        inst = fetch(cpu, pc, ready);                       \
+        if (!inst) goto out;                                \
+        DISPATCH();                                         \
+    } while (0)
+
+// A pair needs room for two instructions in the budget; otherwise the
+// first one runs on its own
+#define NEED_PAIR()                                         \
+    do {                                                    \
+        if (max_instructions - executed < 2) DISPATCH_SINGLE(); \
+    } while (0)
+
+// Predecoded fetch with the cache hit inlined; misses go through the CPU
+static inline Instruction *fetch(CPU *cpu, uint32_t pc, uint8_t ready) {
+    if (pc + 3 < cpu->inst_mem_size && (pc & 3) == 0 && cpu->decoded_valid[pc >> 2] >= ready) {
+        return &cpu->decoded[pc >> 2];
+    }
+    cpu->pc = pc;
+    return cpu_fetch_decoded(cpu);
+}
+
+uint64_t execute_threaded(CPU *cpu, uint64_t max_instructions) {
+    uint32_t *regs = cpu->regs;
+    uint32_t pc = cpu->pc;
+    uint64_t executed = 0;
+    uint64_t counted = 0;       // Part of executed already in instruction_count
+    uint8_t ready = cpu->fusion ? DECODED_FUSED : DECODED_VALID;
+    Profile *profile = cpu->profile;
+    Instruction *inst;
+    const Instruction *second;
+
+#if USE_COMPUTED_GOTO
+    static void *const labels[HANDLER_COUNT] = {
+        [OP_ILLEGAL] = &&L_OP_ILLEGAL,
+        [OP_HALT]    = &&L_OP_HALT,
+        [OP_EBREAK]  = &&L_OP_EBREAK,
+        [OP_ECALL]   = &&L_OP_ECALL,
+        [OP_ADD]     = &&L_OP_ADD,
+        [OP_SUB]     = &&L_OP_SUB,
+        [OP_SLL]     = &&L_OP_SLL,
+        [OP_SLT]     = &&L_OP_SLT,
+        [OP_SLTU]    = &&L_OP_SLTU,
+        [OP_XOR]     = &&L_OP_XOR,
+        [OP_SRL]     = &&L_OP_SRL,
+        [OP_SRA]     = &&L_OP_SRA,
+        [OP_OR]      = &&L_OP_OR,
+        [OP_AND]     = &&L_OP_AND,
+        [OP_FUSED_ADDSUB] = &&L_OP_FUSED_ADDSUB,
+        [OP_FUSED_SHIFT]  = &&L_OP_FUSED_SHIFT,
+        [OP_FUSED_CARRY]  = &&L_OP_FUSED_CARRY,
+    };
+    static void *const profiled[HANDLER_COUNT] = {
+        [0 ... HANDLER_COUNT - 1] = &&L_OP_PROFILE,
+    };
+    void *const *table = profile ? profiled : labels;
+#else
+    uint32_t handler;
+#endif
+
+    if (cpu->halted || max_instructions == 0) {
+        return 0;
+    }
+
+    inst = fetch(cpu, pc, ready);
+    if (!inst) {
+        return 0;
+    }
+
+#if USE_COMPUTED_GOTO
+    DISPATCH();
+#else
+    handler = profile ? OP_PROFILE : inst->dispatch;
+dispatch:
+    switch (handler) {
+#endif
+
+    TARGET(OP_ADD):
+        regs[inst->rd] = regs[inst->rs1] + regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_SUB):
+        regs[inst->rd] = regs[inst->rs1] - regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_SLL):
+        regs[inst->rd] = regs[inst->rs1] << (regs[inst->rs2] & 0x1F);
+        NEXT();
+
+    TARGET(OP_SLT):
+        regs[inst->rd] = (int32_t)regs[inst->rs1] < (int32_t)regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_SLTU):
+        regs[inst->rd] = regs[inst->rs1] < regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_XOR):
+        regs[inst->rd] = regs[inst->rs1] ^ regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_SRL):
+        regs[inst->rd] = regs[inst->rs1] >> (regs[inst->rs2] & 0x1F);
+        NEXT();
+
+    TARGET(OP_SRA):
+        regs[inst->rd] = (uint32_t)((int32_t)regs[inst->rs1] >> (regs[inst->rs2] & 0x1F));
+        NEXT();
+
+    TARGET(OP_OR):
+        regs[inst->rd] = regs[inst->rs1] | regs[inst->rs2];
+        NEXT();
+
+    TARGET(OP_AND):
+        regs[inst->rd] = regs[inst->rs1] & regs[inst->rs2];
+        NEXT();
+
+    // Fused pairs read the second instruction from the next predecode slot.
+    // x0 is re-zeroed between the two writes.
+    TARGET(OP_FUSED_ADDSUB):
+        NEED_PAIR();
+        second = inst + 1;
+        regs[inst->rd] = regs[inst->rs1] + (regs[inst->rs2] ^ inst->negate) - inst->negate;
+        regs[0] = 0;
+        regs[second->rd] = regs[second->rs1] + (regs[second->rs2] ^ second->negate) - second->negate;
+        NEXT_PAIR(FUSE_ADDSUB);
+
+    TARGET(OP_FUSED_SHIFT):
+        NEED_PAIR();
+        second = inst + 1;
+        regs[inst->rd] = regs[inst->rs1] << (regs[inst->rs2] & 0x1F);
+        regs[0] = 0;
+        regs[second->rd] = regs[second->rs1] >> (regs[second->rs2] & 0x1F);
+        NEXT_PAIR(FUSE_SHIFT);
+
+    TARGET(OP_FUSED_CARRY):
+        NEED_PAIR();
+        second = inst + 1;
+        regs[inst->rd] = regs[inst->rs1] < regs[inst->rs2];
+        regs[0] = 0;
+        regs[second->rd] = regs[second->rs1] + regs[second->rs2];
+        NEXT_PAIR(FUSE_CARRY);
+
+    // Instrumented dispatch: count the instruction, then run it unfused so
+    // each half of a pair is recorded at its own PC
+    TARGET(OP_PROFILE):
+        if (inst->op >= OP_ADD) {
+            profile_record(profile, pc, inst->op);
+        }
+        DISPATCH_SINGLE();
+
+    TARGET(OP_HALT):
+        cpu->halted = 1;
+        goto out;
+
+    TARGET(OP_ECALL):
+        // Syscalls run in the reference interpreter, which moves the PC on.
+        // They touch guest memory, and a guard-page fault jumps out past
+        // out, so the count so far goes to the CPU first.
+        cpu->pc = pc;
+        cpu->instruction_count += executed - counted;
+        counted = executed;
+        execute_instruction(cpu, inst);
+        if (cpu->halted) {
+            pc = cpu->pc;
+            goto out;
+        }
+        pc = cpu->pc - 4;
+        NEXT();
+
+    TARGET(OP_EBREAK):
+    TARGET(OP_ILLEGAL):
+        // Let the reference interpreter stop the CPU
+        cpu->pc = pc;
+        execute_instruction(cpu, inst);
+        pc = cpu->pc;
+        goto out;
+
+#if !USE_COMPUTED_GOTO
+    default:
+        goto out;
+    }
+#endif
+
+out:
+    cpu->pc = pc;
+    cpu->instruction_count += executed - counted;
+    return executed;
+}
@@ -0,0 +1,15 @@
+// threaded.h
+#ifndef THREADED_H
+#define THREADED_H
+
+#include "cpu.h"
+
+// Threaded-code interpreter core. Each predecoded instruction carries its
+// concrete operation, so dispatch is a single indirect jump per
+// instruction (computed goto on GCC/Clang, a switch elsewhere).
+//
+// Runs until the CPU halts or max_instructions have executed, and returns
+// the number of instructions executed.
+uint64_t execute_threaded(CPU *cpu, uint64_t max_instructions);
+
+#endif
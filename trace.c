@@ -0,0 +1,15 @@
+// trace.c
+#include "trace.h"
+
+int trace_verbosity = TRACE_LEVEL;
+
+void trace_set_verbosity(int level) {
+    if (level < TRACE_LEVEL_OFF) {
+        level = TRACE_LEVEL_OFF;
+    }
+    trace_verbosity = level;
+}
+
+int trace_get_verbosity(void) {
+    return trace_verbosity;
+}
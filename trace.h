@@ -0,0 +1,46 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+// Trace levels. TRACE_LEVEL selects at build time what is compiled in;
+// trace_set_verbosity() filters further at run time.
+#define TRACE_LEVEL_OFF     0   // Nothing
+#define TRACE_LEVEL_ERRORS  1   // Faults, illegal instructions
+#define TRACE_LEVEL_INST    2   // Per-instruction decode/execute lines
+
+#ifndef TRACE_LEVEL
+#ifdef NDEBUG
+#define TRACE_LEVEL TRACE_LEVEL_ERRORS
+#else
+#define TRACE_LEVEL TRACE_LEVEL_INST
+#endif
+#endif
+
+extern int trace_verbosity;
+
+void trace_set_verbosity(int level);
+int trace_get_verbosity(void);
+
+#if TRACE_LEVEL >= TRACE_LEVEL_INST
+#define TRACE_INST(...)                                     \
+    do {                                                    \
+        if (trace_verbosity >= TRACE_LEVEL_INST)            \
+            printf(__VA_ARGS__);                            \
+    } while (0)
+#else
+#define TRACE_INST(...) do { } while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_ERRORS
+#define TRACE_ERROR(...)                                    \
+    do {                                                    \
+        if (trace_verbosity >= TRACE_LEVEL_ERRORS)          \
+            fprintf(stderr, __VA_ARGS__);                   \
+    } while (0)
+#else
+#define TRACE_ERROR(...) do { } while (0)
+#endif
+
+#endif
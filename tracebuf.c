@@ -0,0 +1,284 @@
+// tracebuf.c
+#include "tracebuf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+// Worst-case encoded size of one record: pc varint, word, rd, value varint
+#define TRACEBUF_MAX_RECORD_BYTES 15
+
+// Chunk format, after the 8-byte magic:
+//   u32 payload length, u32 record count, payload
+// Each record is encoded against the previous one in the same chunk:
+//   varint zigzag(pc - (prev_pc + 4)), u32 inst, u8 rd, varint(value ^ last rd value)
+// Chunks start from a clean state so each can be decoded on its own.
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+static int get_varint(const uint8_t *in, uint32_t size, uint32_t *pos, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= size) {
+            return -1;
+        }
+        uint8_t byte = in[(*pos)++];
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Encode count records starting at ring index first into out
+static size_t encode_chunk(TraceBuffer *tb, uint64_t first, uint32_t count, uint8_t *out) {
+    uint32_t shadow[32] = { 0 };
+    uint32_t prev_pc = 0;
+    size_t len = 8;     // Room for the chunk header
+    
+    for (uint32_t n = 0; n < count; n++) {
+        const TraceRecord *record = &tb->records[(first + n) & tb->mask];
+        uint32_t rd = record->rd & 0x1F;
+        
+        len += put_varint(out + len, zigzag((int32_t)(record->pc - (prev_pc + 4))));
+        put_u32(out + len, record->inst);
+        len += 4;
+        out[len++] = (uint8_t)rd;
+        len += put_varint(out + len, record->value ^ shadow[rd]);
+        
+        shadow[rd] = record->value;
+        prev_pc = record->pc;
+    }
+    
+    put_u32(out, (uint32_t)(len - 8));
+    put_u32(out + 4, count);
+    return len;
+}
+
+static void *writer_main(void *arg) {
+    TraceBuffer *tb = arg;
+    uint8_t *chunk = tb->chunk;
+    struct timespec idle = { 0, 200000 };
+    
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&tb->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&tb->head, memory_order_acquire);
+        
+        if (head == tail) {
+            if (!atomic_load_explicit(&tb->running, memory_order_acquire)) {
+                // Re-check: the producer may have pushed before stopping
+                if (atomic_load_explicit(&tb->head, memory_order_acquire) == tail) {
+                    break;
+                }
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        
+        uint64_t available = head - tail;
+        uint32_t count = available > TRACEBUF_CHUNK_RECORDS ? TRACEBUF_CHUNK_RECORDS : (uint32_t)available;
+        size_t len = encode_chunk(tb, tail, count, chunk);
+        
+        // Slots are free again once encoded
+        atomic_store_explicit(&tb->tail, tail + count, memory_order_release);
+        
+        fwrite(chunk, 1, len, tb->file);
+        tb->records_written += count;
+        tb->bytes_written += len;
+    }
+    
+    return NULL;
+}
+
+int tracebuf_open(TraceBuffer *tb, const char *path, unsigned int capacity_log2) {
+    memset(tb, 0, sizeof(*tb));
+    
+    tb->file = fopen(path, "wb");
+    if (!tb->file) {
+        printf("Failed to open trace file: %s\n", path);
+        return -1;
+    }
+    
+    // Allocated here so the writer cannot fail after the producer starts
+    tb->records = calloc((size_t)1 << capacity_log2, sizeof(TraceRecord));
+    tb->chunk = malloc(8 + TRACEBUF_CHUNK_RECORDS * TRACEBUF_MAX_RECORD_BYTES);
+    if (!tb->records || !tb->chunk) {
+        printf("Failed to allocate trace buffer\n");
+        free(tb->records);
+        free(tb->chunk);
+        fclose(tb->file);
+        tb->file = NULL;
+        return -1;
+    }
+    tb->mask = ((uint64_t)1 << capacity_log2) - 1;
+    
+    fwrite(TRACEBUF_MAGIC, 1, 8, tb->file);
+    tb->bytes_written = 8;
+    
+    atomic_store(&tb->head, 0);
+    atomic_store(&tb->tail, 0);
+    atomic_store(&tb->running, 1);
+    
+    if (pthread_create(&tb->writer, NULL, writer_main, tb) != 0) {
+        printf("Failed to start trace writer\n");
+        free(tb->records);
+        free(tb->chunk);
+        fclose(tb->file);
+        tb->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void tracebuf_close(TraceBuffer *tb) {
+    if (!tb->file) {
+        return;
+    }
+    
+    atomic_store_explicit(&tb->running, 0, memory_order_release);
+    pthread_join(tb->writer, NULL);
+    
+    fclose(tb->file);
+    tb->file = NULL;
+    free(tb->records);
+    tb->records = NULL;
+    free(tb->chunk);
+    tb->chunk = NULL;
+}
+
+void tracebuf_wait_for_space(TraceBuffer *tb) {
+    uint64_t head = atomic_load_explicit(&tb->head, memory_order_relaxed);
+    for (;;) {
+        tb->cached_tail = atomic_load_explicit(&tb->tail, memory_order_acquire);
+        if (head - tb->cached_tail <= tb->mask) {
+            return;
+        }
+        sched_yield();
+    }
+}
+
+int trace_reader_open(TraceReader *reader, const char *path) {
+    char magic[8];
+    
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        printf("Failed to open trace file: %s\n", path);
+        return -1;
+    }
+    
+    if (fread(magic, 1, 8, reader->file) != 8 || memcmp(magic, TRACEBUF_MAGIC, 8) != 0) {
+        printf("Not a trace file: %s\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void trace_reader_close(TraceReader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+    free(reader->chunk);
+    reader->chunk = NULL;
+}
+
+// Load the next chunk. Returns 1 on success, 0 at end of file, -1 if corrupt.
+static int trace_reader_load_chunk(TraceReader *reader) {
+    uint8_t header[8];
+    size_t got = fread(header, 1, 8, reader->file);
+    
+    if (got == 0) {
+        return 0;
+    }
+    if (got != 8) {
+        return -1;
+    }
+    
+    uint32_t size = get_u32(header);
+    uint32_t count = get_u32(header + 4);
+    if (size > (uint32_t)TRACEBUF_CHUNK_RECORDS * TRACEBUF_MAX_RECORD_BYTES) {
+        return -1;
+    }
+    
+    if (size > reader->chunk_capacity || !reader->chunk) {
+        uint8_t *chunk = realloc(reader->chunk, size ? size : 1);
+        if (!chunk) {
+            return -1;
+        }
+        reader->chunk = chunk;
+        reader->chunk_capacity = size;
+    }
+    if (fread(reader->chunk, 1, size, reader->file) != size) {
+        return -1;
+    }
+    
+    reader->chunk_size = size;
+    reader->pos = 0;
+    reader->remaining = count;
+    reader->prev_pc = 0;
+    memset(reader->shadow, 0, sizeof(reader->shadow));
+    return 1;
+}
+
+int trace_reader_next(TraceReader *reader, TraceRecord *record) {
+    while (reader->remaining == 0) {
+        int status = trace_reader_load_chunk(reader);
+        if (status <= 0) {
+            return status;
+        }
+    }
+    
+    uint32_t pc_delta, value;
+    if (get_varint(reader->chunk, reader->chunk_size, &reader->pos, &pc_delta) != 0 ||
+        reader->pos + 5 > reader->chunk_size) {
+        return -1;
+    }
+    
+    record->pc = reader->prev_pc + 4 + (uint32_t)unzigzag(pc_delta);
+    record->inst = get_u32(reader->chunk + reader->pos);
+    record->rd = reader->chunk[reader->pos + 4] & 0x1F;
+    reader->pos += 5;
+    
+    if (get_varint(reader->chunk, reader->chunk_size, &reader->pos, &value) != 0) {
+        return -1;
+    }
+    record->value = value ^ reader->shadow[record->rd];
+    
+    reader->shadow[record->rd] = record->value;
+    reader->prev_pc = record->pc;
+    reader->remaining--;
+    return 1;
+}
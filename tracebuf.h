@@ -0,0 +1,82 @@
+// tracebuf.h
+#ifndef TRACEBUF_H
+#define TRACEBUF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define TRACEBUF_DEFAULT_CAPACITY_LOG2 16   // 64Ki records in flight
+#define TRACEBUF_CHUNK_RECORDS 4096         // Records per file chunk
+#define TRACEBUF_MAGIC "RV32TRC1"
+
+// One executed instruction
+typedef struct {
+    uint32_t pc;            // Address of the instruction
+    uint32_t inst;          // Raw instruction word
+    uint32_t value;         // Value written to rd
+    uint8_t rd;             // Destination register
+    uint8_t pad[3];
+} TraceRecord;
+
+// Single-producer ring drained to a file by a background writer thread.
+// The emulator thread pushes; the writer compresses and writes chunks.
+typedef struct TraceBuffer {
+    TraceRecord *records;
+    uint64_t mask;              // Capacity - 1
+    _Atomic uint64_t head;      // Next slot the producer fills
+    char pad[64 - sizeof(uint64_t)];
+    _Atomic uint64_t tail;      // Next slot the writer drains
+    uint64_t cached_tail;       // Producer's last view of tail
+    _Atomic int running;
+    FILE *file;
+    uint8_t *chunk;             // Writer's encode buffer
+    pthread_t writer;
+    uint64_t records_written;
+    uint64_t bytes_written;
+} TraceBuffer;
+
+// Open a trace file and start the writer thread
+int tracebuf_open(TraceBuffer *tb, const char *path, unsigned int capacity_log2);
+
+// Drain everything pushed so far, stop the writer and close the file
+void tracebuf_close(TraceBuffer *tb);
+
+// Block until the ring has room for one more record
+void tracebuf_wait_for_space(TraceBuffer *tb);
+
+static inline void tracebuf_push(TraceBuffer *tb, uint32_t pc, uint32_t inst,
+                                 uint32_t rd, uint32_t value) {
+    uint64_t head = atomic_load_explicit(&tb->head, memory_order_relaxed);
+    if (head - tb->cached_tail > tb->mask) {
+        tracebuf_wait_for_space(tb);
+    }
+    
+    TraceRecord *record = &tb->records[head & tb->mask];
+    record->pc = pc;
+    record->inst = inst;
+    record->value = value;
+    record->rd = (uint8_t)rd;
+    atomic_store_explicit(&tb->head, head + 1, memory_order_release);
+}
+
+// Sequential reader for trace files
+typedef struct {
+    FILE *file;
+    uint8_t *chunk;
+    uint32_t chunk_capacity;    // Bytes allocated for chunk
+    uint32_t chunk_size;        // Bytes in the current chunk
+    uint32_t pos;               // Read offset in the current chunk
+    uint32_t remaining;         // Records left in the current chunk
+    uint32_t prev_pc;
+    uint32_t shadow[32];        // Last value written to each register
+} TraceReader;
+
+int trace_reader_open(TraceReader *reader, const char *path);
+void trace_reader_close(TraceReader *reader);
+
+// Returns 1 and fills record, 0 at end of file, -1 on a corrupt file
+int trace_reader_next(TraceReader *reader, TraceRecord *record);
+
+#endif
@@ -0,0 +1,50 @@
+// tracedump.c
+// Offline decoder for binary execution traces written with -t
+#include <stdio.h>
+#include <stdlib.h>
+#include "decode.h"
+#include "tracebuf.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s trace-file\n", argv[0]);
+        return 1;
+    }
+    
+    TraceReader reader;
+    if (trace_reader_open(&reader, argv[1]) != 0) {
+        return 1;
+    }
+    
+    TraceRecord record;
+    uint64_t count = 0;
+    int status;
+    
+    while ((status = trace_reader_next(&reader, &record)) == 1) {
+        // Rebuild the decoded fields from the raw word
+        Instruction inst;
+        inst.raw = record.inst;
+        inst.opcode = extract_opcode(record.inst);
+        inst.type = get_instruction_type(inst.opcode);
+        inst.rd = extract_rd(record.inst);
+        inst.rs1 = extract_rs1(record.inst);
+        inst.rs2 = extract_rs2(record.inst);
+        inst.funct3 = extract_funct3(record.inst);
+        inst.funct7 = extract_funct7(record.inst);
+        inst.imm = 0;
+        
+        printf("%08x: %08x  %-5s x%d, x%d, x%d  x%d <- 0x%08x\n",
+               record.pc, record.inst, get_operation_name(get_operation(&inst)),
+               inst.rd, inst.rs1, inst.rs2, record.rd, record.value);
+        count++;
+    }
+    
+    trace_reader_close(&reader);
+    
+    if (status < 0) {
+        printf("Trace file is corrupt after %llu records\n", (unsigned long long)count);
+        return 1;
+    }
+    printf("%llu records\n", (unsigned long long)count);
+    return 0;
+}
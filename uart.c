@@ -0,0 +1,158 @@
+// uart.c
+#include "uart.h"
+#include "replay.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+int uart_flush(Uart *uart) {
+    size_t done = 0;
+    
+    while (done < uart->tx_length) {
+        ssize_t written = write(uart->fd, uart->tx + done, uart->tx_length - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            uart->tx_length = 0;    // Drop output the host will not take
+            return -1;
+        }
+        done += (size_t)written;
+        uart->tx_writes++;
+    }
+    uart->tx_length = 0;
+    return 0;
+}
+
+size_t uart_receive(Uart *uart, const uint8_t *data, size_t length) {
+    size_t accepted = 0;
+    
+    while (accepted < length && uart->rx_count < UART_RX_BUFFER) {
+        uart->rx[(uart->rx_head + uart->rx_count) % UART_RX_BUFFER] = data[accepted++];
+        uart->rx_count++;
+    }
+    return accepted;
+}
+
+static void transmit(Uart *uart, uint8_t value) {
+    if (uart->mcr & 0x10) {
+        uart_receive(uart, &value, 1);      // Loopback
+        return;
+    }
+    
+    // The host already has what recorded history sent
+    CPU *cpu = uart->device.cpu;
+    if (cpu && cpu->recording && replay_replaying(cpu->recording)) {
+        return;
+    }
+    
+    uart->tx[uart->tx_length++] = value;
+    uart->tx_bytes++;
+    if (uart->tx_length == UART_TX_BUFFER || (value == '\n' && uart->line_buffered)) {
+        uart_flush(uart);
+    }
+}
+
+static void uart_device_flush(MmioDevice *device) {
+    uart_flush(device->context);
+}
+
+static uint32_t uart_read(MmioDevice *device, uint32_t offset, int size) {
+    Uart *uart = device->context;
+    int dlab = uart->lcr & 0x80;
+    (void)size;     // Registers are bytes; wider reads see the byte zero-extended
+    
+    switch (offset) {
+        case UART_RBR: {
+            if (dlab) {
+                return uart->dll;
+            }
+            if (uart->rx_count == 0) {
+                return 0;
+            }
+            uint8_t value = uart->rx[uart->rx_head];
+            uart->rx_head = (uart->rx_head + 1) % UART_RX_BUFFER;
+            uart->rx_count--;
+            return value;
+        }
+        case UART_IER:
+            return dlab ? uart->dlm : uart->ier;
+        case UART_IIR: {
+            uint8_t fifo = (uart->fcr & 0x01) ? 0xC0 : 0x00;
+            if ((uart->ier & 0x01) && uart->rx_count) {
+                return fifo | 0x04;     // Received data available
+            }
+            if (uart->ier & 0x02) {
+                return fifo | 0x02;     // Transmitter holding register empty
+            }
+            return fifo | 0x01;         // Nothing pending
+        }
+        case UART_LCR:
+            return uart->lcr;
+        case UART_MCR:
+            return uart->mcr;
+        case UART_LSR:
+            return UART_LSR_THRE | UART_LSR_TEMT | (uart->rx_count ? UART_LSR_DR : 0);
+        case UART_MSR:
+            return 0xB0;                // CTS, DSR and DCD asserted
+        case UART_SCR:
+            return uart->scr;
+        default:
+            return 0;
+    }
+}
+
+static void uart_write(MmioDevice *device, uint32_t offset, uint32_t value, int size) {
+    Uart *uart = device->context;
+    int dlab = uart->lcr & 0x80;
+    (void)size;
+    
+    switch (offset) {
+        case UART_RBR:
+            if (dlab) {
+                uart->dll = (uint8_t)value;
+            } else {
+                transmit(uart, (uint8_t)value);
+            }
+            break;
+        case UART_IER:
+            if (dlab) {
+                uart->dlm = (uint8_t)value;
+            } else {
+                uart->ier = value & 0x0F;
+            }
+            break;
+        case UART_IIR:
+            uart->fcr = (uint8_t)value;
+            if (value & 0x02) {
+                uart->rx_head = 0;      // Clear the receive FIFO
+                uart->rx_count = 0;
+            }
+            break;
+        case UART_LCR:
+            uart->lcr = (uint8_t)value;
+            break;
+        case UART_MCR:
+            uart->mcr = value & 0x1F;
+            break;
+        case UART_SCR:
+            uart->scr = (uint8_t)value;
+            break;
+        default:
+            break;                      // LSR and MSR are read-only
+    }
+}
+
+void uart_init(Uart *uart, uint32_t base, int fd) {
+    memset(uart, 0, sizeof(*uart));
+    uart->fd = fd;
+    uart->line_buffered = isatty(fd);
+    uart->lcr = 0x03;                   // 8N1
+    uart->device.name = "uart";
+    uart->device.base = base;
+    uart->device.size = MEM_PAGE_SIZE;
+    uart->device.read = uart_read;
+    uart->device.write = uart_write;
+    uart->device.flush = uart_device_flush;
+    uart->device.context = uart;
+}
@@ -0,0 +1,64 @@
+// uart.h
+#ifndef UART_H
+#define UART_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mmio.h"
+
+#define UART_DEFAULT_BASE 0x10000000    // Where QEMU's virt machine puts its 16550
+#define UART_TX_BUFFER    (64 * 1024)   // Output batched per write(2)
+#define UART_RX_BUFFER    256
+
+// 16550 register offsets (one byte apart)
+#define UART_RBR 0      // Receive buffer (read) / transmit holding (write); DLL when DLAB
+#define UART_IER 1      // Interrupt enable; DLM when DLAB
+#define UART_IIR 2      // Interrupt identification (read) / FIFO control (write)
+#define UART_LCR 3      // Line control, bit 7 is DLAB
+#define UART_MCR 4      // Modem control, bit 4 is loopback
+#define UART_LSR 5      // Line status
+#define UART_MSR 6      // Modem status
+#define UART_SCR 7      // Scratch
+
+#define UART_LSR_DR   0x01  // Receive data ready
+#define UART_LSR_THRE 0x20  // Transmit holding register empty
+#define UART_LSR_TEMT 0x40  // Transmitter empty
+
+// A 16550-style UART. Transmitted bytes collect in a buffer that goes to
+// the host in one write(2) when it fills or on uart_flush() (also the
+// device's MMIO flush), so console output costs a syscall per
+// UART_TX_BUFFER bytes rather than per byte. Output to a terminal is also
+// flushed at each newline, as stdio does. Bytes sent while record/replay
+// re-executes history are not written again.
+// The transmitter always reads as empty. There is no interrupt line; IIR
+// still reports what would be pending.
+typedef struct {
+    MmioDevice device;
+    int fd;                     // Host file descriptor for output
+    int line_buffered;          // Flush at each newline; set when fd is a terminal
+    uint8_t ier;
+    uint8_t lcr;
+    uint8_t mcr;
+    uint8_t fcr;
+    uint8_t scr;
+    uint8_t dll;
+    uint8_t dlm;
+    uint8_t rx[UART_RX_BUFFER];
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint8_t tx[UART_TX_BUFFER];
+    size_t tx_length;
+    uint64_t tx_bytes;          // Bytes transmitted
+    uint64_t tx_writes;         // write(2) calls made
+} Uart;
+
+// Set up a UART at base writing to fd; map it with mmio_map(bus, cpu, &uart->device)
+void uart_init(Uart *uart, uint32_t base, int fd);
+
+// Send buffered output to the host. Returns -1 if write(2) fails.
+int uart_flush(Uart *uart);
+
+// Queue host input for the guest to read. Returns the bytes accepted.
+size_t uart_receive(Uart *uart, const uint8_t *data, size_t length);
+
+#endif